@@ -0,0 +1,309 @@
+// synthetic large board benchmark.
+// builds boards of the given stroke counts and times the render thread hot
+// paths on them. every result is printed as a single json line on stdout,
+// so runs can be diffed or loaded into anything that reads json lines.
+//
+// usage: board_bench [strokes...]   (default 1000 10000 100000 1000000)
+
+#include "board.h"
+#include "config.h"
+#include "import.h"
+#include "path.h"
+#include "pdll.h"
+#include "simd.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BENCH_WIDTH 1920
+#define BENCH_HEIGHT 1080
+// strokes per screen worth of board, the board grows with the stroke count
+#define STROKES_PER_SCREEN 1000
+// keeps the exported image of the largest boards within reason
+#define BENCH_MAX_SIDE 8192
+#define PAN_STEPS 120
+#define ERASE_PASSES 50
+#define UNDO_STEPS 100
+#define SAVE_PATH "build/bench.png"
+#define IMPORT_JSON_PATH "build/bench-import.jsonl"
+#define IMPORT_BINARY_PATH "build/bench-import.sbs"
+// feeds of the largest boards would take gigabytes of disk
+#define IMPORT_MAX_STROKES 100000
+
+static uint64_t rng_state = 0x2545F4914F6CDD1DULL;
+
+// xorshift, so every run generates the very same boards.
+static double rng_uniform(void) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return (rng_state >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double rng_range(double min, double max) {
+  return min + (max - min) * rng_uniform();
+}
+
+static double now_ms(void) {
+  return SDL_GetPerformanceCounter() * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+static void report(const char *name, int strokes, int iterations, double total_ms) {
+  printf("{\"case\": \"%s\", \"simd\": \"%s\", \"strokes\": %d, \"iterations\": %d, \"total_ms\": %.3f, "
+         "\"per_iteration_ms\": %.6f}\n",
+         name, simd.name, strokes, iterations, total_ms, total_ms / iterations);
+  fflush(stdout);
+}
+
+// a hand drawn looking stroke: a wandering run of smooth segments,
+// mostly short scribbles with the occasional long line.
+static cairo_path_t *make_stroke(Board *board, double side) {
+  int segments = rng_uniform() < 0.9 ? (int)rng_range(3, 30) : (int)rng_range(30, 200);
+  double x = rng_range(0, side);
+  double y = rng_range(0, side * BENCH_HEIGHT / BENCH_WIDTH);
+  double heading = rng_range(0, 2 * M_PI);
+  double step = rng_range(2, 12);
+
+  cairo_new_path(board->cr);
+  cairo_move_to(board->cr, x, y);
+  for (int i = 0; i < segments; ++i) {
+    double turn = rng_range(-0.6, 0.6);
+    double x1 = x + cos(heading) * step / 3;
+    double y1 = y + sin(heading) * step / 3;
+    heading += turn;
+    double x3 = x + cos(heading) * step;
+    double y3 = y + sin(heading) * step;
+    double x2 = x3 - cos(heading) * step / 3;
+    double y2 = y3 - sin(heading) * step / 3;
+    // merged strokes keep a move_to in front of every segment.
+    cairo_move_to(board->cr, x, y);
+    cairo_curve_to(board->cr, x1, y1, x2, y2, x3, y3);
+    x = x3;
+    y = y3;
+  }
+
+  cairo_path_t *path = cairo_copy_path(board->cr);
+  cairo_new_path(board->cr);
+  return path;
+}
+
+static void populate(Board *board, int count) {
+  static const double widths[] = {STROKE_WIDTH_THIN, STROKE_WIDTH_MEDIUM, STROKE_WIDTH_THICK};
+  static const unsigned int colors[] = {COLOR_PRIMARY, COLOR_SECONDARY};
+  double side = BENCH_WIDTH * sqrt((double)count / STROKES_PER_SCREEN);
+  for (int i = 0; i < count; ++i) {
+    cairo_path_t *stroke = make_stroke(board, fmin(fmax(side, BENCH_WIDTH), BENCH_MAX_SIDE));
+    Path *path = path_create(stroke, colors[i % 2], widths[(int)rng_range(0, 3)]);
+    if (path == NULL || !pdll_append(board->strokes, path)) {
+      fprintf(stderr, "out of memory after %d strokes\n", i);
+      exit(1);
+    }
+    chunk_store_add(board->chunks, path);
+  }
+}
+
+// refreshes are progressive, draw them to the end in one go.
+static void finish_refresh(Board *board) {
+  while (board_refresh_step(board, INFINITY)) {
+  }
+}
+
+static void bench_draw(Board *board, int count) {
+  int iterations = count <= 10000 ? 10 : 2;
+  double start = now_ms();
+  for (int i = 0; i < iterations; ++i) {
+    board_refresh(board);
+    finish_refresh(board);
+  }
+  report("draw", count, iterations, now_ms() - start);
+
+  // how long the first slice keeps the render thread from input.
+  double slice = 0;
+  for (int i = 0; i < iterations; ++i) {
+    board_refresh(board);
+    start = now_ms();
+    board_refresh_step(board, REFRESH_BUDGET_MS);
+    slice += now_ms() - start;
+    finish_refresh(board);
+  }
+  report("draw_slice", count, iterations, slice);
+}
+
+static void bench_pan(Board *board, int count) {
+  // a slow diagonal drag and back, like a right button pan.
+  double start = now_ms();
+  for (int i = 0; i < PAN_STEPS; ++i) {
+    double direction = i < PAN_STEPS / 2 ? 1 : -1;
+    board_translate(board, 7 * direction, 3 * direction);
+  }
+  report("pan", count, PAN_STEPS, now_ms() - start);
+  board_reset_translation(board);
+  finish_refresh(board);
+
+  // the same drag with the render thread idle between steps, only the
+  // translations are timed: the band ahead is rendered while idle.
+  double total = 0;
+  for (int i = 0; i < PAN_STEPS; ++i) {
+    double direction = i < PAN_STEPS / 2 ? 1 : -1;
+    start = now_ms();
+    board_translate(board, 7 * direction, 3 * direction);
+    total += now_ms() - start;
+    board_prefetch(board);
+  }
+  report("pan_prefetched", count, PAN_STEPS, total);
+  board_reset_translation(board);
+  finish_refresh(board);
+}
+
+static void bench_erase(Board *board, int count) {
+  // every pass is its own eraser gesture with a short zigzag.
+  size_t version = board->strokes->latest_version;
+  double start = now_ms();
+  for (int i = 0; i < ERASE_PASSES; ++i) {
+    double x = rng_range(0, BENCH_WIDTH);
+    double y = rng_range(0, BENCH_HEIGHT);
+    cairo_new_path(board->cr);
+    cairo_move_to(board->cr, x, y);
+    cairo_curve_to(board->cr, x + 20, y - 10, x + 40, y + 10, x + 60, y);
+    cairo_path_t *segment = cairo_copy_path(board->cr);
+    cairo_new_path(board->cr);
+
+    board->erase_version = 0;
+    board_delete_intersecting_paths(board, segment);
+    cairo_path_destroy(segment);
+  }
+  report("erase", count, ERASE_PASSES, now_ms() - start);
+
+  // leave the board as it was for the next cases.
+  while (board->strokes->latest_version > version) {
+    pdll_undo(board->strokes);
+  }
+}
+
+static void bench_undo(Board *board, int count) {
+  int steps = count < UNDO_STEPS ? count : UNDO_STEPS;
+  double start = now_ms();
+  for (int i = 0; i < steps; ++i) {
+    pdll_undo(board->strokes);
+  }
+  report("undo", count, steps, now_ms() - start);
+}
+
+static void bench_save(Board *board, int count) {
+  double start = now_ms();
+  board_save_image(board, SAVE_PATH);
+  report("save", count, 1, now_ms() - start);
+}
+
+static void bench_memory(Board *board, int count) {
+  BoardMemory usage;
+  board_memory_usage(board, &usage);
+  printf("{\"case\": \"memory\", \"strokes\": %d, \"live_data\": %zu, \"history_data\": %zu, \"nodes\": %zu, "
+         "\"versions\": %zu}\n",
+         count, usage.strokes.live_data, usage.strokes.history_data, usage.strokes.nodes, usage.strokes.versions);
+  fflush(stdout);
+}
+
+// random walks of 3 to 60 points, written to both feed formats.
+static void write_feeds(int count) {
+  FILE *json = fopen(IMPORT_JSON_PATH, "w");
+  FILE *binary = fopen(IMPORT_BINARY_PATH, "wb");
+  if (json == NULL || binary == NULL) {
+    fprintf(stderr, "can't write the import feeds\n");
+    exit(1);
+  }
+  fwrite(IMPORT_MAGIC, 1, strlen(IMPORT_MAGIC), binary);
+  double side = fmin(fmax(BENCH_WIDTH * sqrt((double)count / STROKES_PER_SCREEN), BENCH_WIDTH), BENCH_MAX_SIDE);
+  for (int i = 0; i < count; ++i) {
+    uint32_t color = i % 2 ? COLOR_SECONDARY : COLOR_PRIMARY;
+    float width = STROKE_WIDTH_MEDIUM;
+    uint32_t points = (uint32_t)rng_range(3, 60);
+    fprintf(json, "{\"color\": %u, \"width\": %g, \"points\": [", color, width);
+    fwrite(&color, sizeof(color), 1, binary);
+    fwrite(&width, sizeof(width), 1, binary);
+    fwrite(&points, sizeof(points), 1, binary);
+    float x = rng_range(0, side);
+    float y = rng_range(0, side * BENCH_HEIGHT / BENCH_WIDTH);
+    for (uint32_t j = 0; j < points; ++j) {
+      x += rng_range(-6, 6);
+      y += rng_range(-6, 6);
+      float point[2] = {x, y};
+      fprintf(json, "%s[%g, %g]", j > 0 ? ", " : "", x, y);
+      fwrite(point, sizeof(float), 2, binary);
+    }
+    fprintf(json, "]}\n");
+  }
+  fclose(json);
+  fclose(binary);
+}
+
+// from the file being opened to the strokes being on the board.
+static void bench_import(int count) {
+  count = count < IMPORT_MAX_STROKES ? count : IMPORT_MAX_STROKES;
+  write_feeds(count);
+  const char *cases[][2] = {{"import_json", IMPORT_JSON_PATH}, {"import_binary", IMPORT_BINARY_PATH}};
+  for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); ++i) {
+    Board *board = board_create(BENCH_WIDTH, BENCH_HEIGHT);
+    if (board == NULL) {
+      fprintf(stderr, "can't create a board: %s\n", SDL_GetError());
+      exit(1);
+    }
+    double start = now_ms();
+    board_import(board, cases[i][1]);
+    while (board->imports != NULL) {
+      SDL_SemWait(board->commands_available);
+      board_finish_imports(board);
+    }
+    report(cases[i][0], count, 1, now_ms() - start);
+    board_free(board);
+  }
+  remove(IMPORT_JSON_PATH);
+  remove(IMPORT_BINARY_PATH);
+}
+
+static void bench_board(int count) {
+  Board *board = board_create(BENCH_WIDTH, BENCH_HEIGHT);
+  if (board == NULL) {
+    fprintf(stderr, "can't create a board: %s\n", SDL_GetError());
+    exit(1);
+  }
+
+  double start = now_ms();
+  populate(board, count);
+  report("populate", count, count, now_ms() - start);
+
+  bench_memory(board, count);
+  bench_draw(board, count);
+  bench_pan(board, count);
+  bench_erase(board, count);
+  bench_save(board, count);
+  bench_undo(board, count);
+  board_free(board);
+
+  bench_import(count);
+}
+
+int main(int argc, char **argv) {
+  // no window is ever shown, and no accelerated renderer is needed.
+  SDL_setenv("SDL_VIDEODRIVER", "dummy", 0);
+  SDL_SetHint(SDL_HINT_RENDER_DRIVER, "software");
+  if (SDL_Init(SDL_INIT_VIDEO) != 0) {
+    fprintf(stderr, "can't initialize SDL: %s\n", SDL_GetError());
+    return 1;
+  }
+
+  if (argc > 1) {
+    for (int i = 1; i < argc; ++i) {
+      bench_board(atoi(argv[i]));
+    }
+  } else {
+    int sizes[] = {1000, 10000, 100000, 1000000};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(*sizes); ++i) {
+      bench_board(sizes[i]);
+    }
+  }
+
+  SDL_Quit();
+  return 0;
+}
@@ -0,0 +1,662 @@
+// micro benchmarks of the pdll versioned list and the List container.
+//
+// usage: pdll_bench                      time the hot operations, json lines on stdout
+//        pdll_bench --check [steps] [seed]
+//                                        run random operations against a plain
+//                                        reference model and stop at the first mismatch.
+//                                        a replica fed by the observer has to keep up.
+
+#include "list.h"
+#include "pdll.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_NODES 1000000
+#define BENCH_DELETE_NODES 100000
+#define CHECK_STEPS 20000
+#define CHECK_MAX_LENGTH 200
+// the full memory walk is done every that many steps
+#define CHECK_MEMORY_INTERVAL 64
+
+static uint64_t rng_state = 0x2545F4914F6CDD1DULL;
+
+static uint64_t rng_next(void) {
+  rng_state ^= rng_state << 13;
+  rng_state ^= rng_state >> 7;
+  rng_state ^= rng_state << 17;
+  return rng_state;
+}
+
+static double rng_uniform(void) {
+  return (rng_next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double now_ns(void) {
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec * 1e9 + time.tv_nsec;
+}
+
+static void report(const char *name, const char *parameter, double value, long operations, double total_ns) {
+  printf("{\"case\": \"%s\", \"%s\": %g, \"operations\": %ld, \"total_ms\": %.3f, \"per_operation_ns\": %.3f}\n", name,
+         parameter, value, operations, total_ns / 1e6, total_ns / operations);
+  fflush(stdout);
+}
+
+// every data is a heap allocated id, frees are counted to catch leaks and
+// double frees, and asan catches anything read after it was freed.
+static long alive = 0;
+static int next_id = 1;
+
+static int *data_new(void) {
+  int *data = malloc(sizeof(int));
+  if (data == NULL) {
+    fprintf(stderr, "out of memory\n");
+    exit(1);
+  }
+  *data = next_id++;
+  ++alive;
+  return data;
+}
+
+static void data_free(void *data) {
+  --alive;
+  free(data);
+}
+
+static size_t data_size(void *data) {
+  (void)data;
+  return sizeof(int);
+}
+
+static void *data_replace(void *data) {
+  (void)data;
+  return data_new();
+}
+
+static pdll *make_list(int count) {
+  pdll *list = pdll_init(data_free);
+  for (int i = 0; i < count; ++i) {
+    pdll_append(list, data_new());
+  }
+  return list;
+}
+
+static void bench_append(void) {
+  pdll *list = pdll_init(data_free);
+  double start = now_ns();
+  for (int i = 0; i < BENCH_NODES; ++i) {
+    pdll_append(list, data_new());
+  }
+  report("pdll_append", "nodes", BENCH_NODES, BENCH_NODES, now_ns() - start);
+
+  pdll_memory usage;
+  pdll_memory_usage(list, data_size, &usage);
+  printf("{\"case\": \"pdll_memory_append\", \"versions\": %zu, \"bytes_per_version\": %.3f}\n", list->latest_version,
+         (double)(usage.versions + usage.nodes) / list->latest_version);
+
+  volatile long sum = 0;
+  start = now_ns();
+  pdll_iter(list, node) {
+    sum += *(int *)node->data;
+  }
+  report("pdll_iter", "nodes", BENCH_NODES, BENCH_NODES, now_ns() - start);
+
+  start = now_ns();
+  while (pdll_undo(list)) {
+  }
+  report("pdll_undo_append", "nodes", BENCH_NODES, BENCH_NODES, now_ns() - start);
+  pdll_free(list);
+}
+
+static void bench_delete(double ratio) {
+  pdll *list = make_list(BENCH_DELETE_NODES);
+
+  double start = now_ns();
+  pdll_iter(list, node) {
+    if (rng_uniform() < ratio) {
+      pdll_node_mark_for_deletion(node);
+    }
+  }
+  pdll_delete_marked_nodes(list);
+  report("pdll_delete_marked_nodes", "ratio", ratio, BENCH_DELETE_NODES, now_ns() - start);
+
+  // a delete copies every surviving node into the new version.
+  size_t nodes = pdll_version_nodes(list, list->latest_version);
+  printf("{\"case\": \"pdll_memory_delete\", \"ratio\": %g, \"version_bytes\": %zu}\n", ratio,
+         nodes * sizeof(pdll_node));
+
+  start = now_ns();
+  pdll_undo(list);
+  report("pdll_undo_delete", "ratio", ratio, 1, now_ns() - start);
+  pdll_free(list);
+}
+
+static void bench_undo_chain(void) {
+  // alternating appends and small deletes, then undo all of it.
+  pdll *list = make_list(BENCH_DELETE_NODES / 10);
+  for (int i = 0; i < 100; ++i) {
+    pdll_append(list, data_new());
+    pdll_iter(list, node) {
+      if (rng_uniform() < 0.01) {
+        pdll_node_mark_for_deletion(node);
+      }
+    }
+    pdll_delete_marked_nodes(list);
+  }
+
+  long versions = list->latest_version;
+  double start = now_ns();
+  while (pdll_undo(list)) {
+  }
+  report("pdll_undo_chain", "versions", versions, versions, now_ns() - start);
+  pdll_free(list);
+}
+
+static void bench_transaction(void) {
+  // a bulk paste onto an existing list, committed and undone as one version.
+  pdll *list = make_list(BENCH_DELETE_NODES);
+  double start = now_ns();
+  pdll_begin(list);
+  for (int i = 0; i < BENCH_DELETE_NODES; ++i) {
+    pdll_append(list, data_new());
+  }
+  pdll_commit(list);
+  report("pdll_transaction_append", "nodes", BENCH_DELETE_NODES, BENCH_DELETE_NODES, now_ns() - start);
+
+  start = now_ns();
+  pdll_undo(list);
+  report("pdll_undo_transaction", "nodes", BENCH_DELETE_NODES, 1, now_ns() - start);
+  pdll_free(list);
+}
+
+static void bench_list(void) {
+  List *list = list_create(free);
+  double start = now_ns();
+  for (int i = 0; i < BENCH_NODES; ++i) {
+    list_append(list, malloc(sizeof(int)));
+  }
+  report("list_append", "nodes", BENCH_NODES, BENCH_NODES, now_ns() - start);
+
+  volatile long count = 0;
+  ListNode *node, *next_node;
+  start = now_ns();
+  list_foreach(list, node, next_node) {
+    count += node->data != NULL;
+  }
+  report("list_foreach", "nodes", BENCH_NODES, BENCH_NODES, now_ns() - start);
+
+  start = now_ns();
+  for (int i = 0; i < BENCH_NODES / 2; ++i) {
+    list_pop(list);
+  }
+  report("list_pop", "nodes", BENCH_NODES / 2, BENCH_NODES / 2, now_ns() - start);
+
+  start = now_ns();
+  list_reset(list);
+  report("list_reset", "nodes", BENCH_NODES / 2, BENCH_NODES / 2, now_ns() - start);
+  list_free(list);
+}
+
+// reference model: every version is a plain array of ids.
+typedef struct {
+  int *ids;
+  int length;
+  // created by an append on a non-empty version, sharing its nodes
+  bool shared;
+} ModelVersion;
+
+typedef struct {
+  ModelVersion *versions;
+  size_t latest;
+  size_t capacity;
+  // amount of versions holding every id, and of ids held by any version
+  int *refs;
+  int refs_capacity;
+  long distinct;
+} Model;
+
+static void model_ref(Model *model, int id, int delta) {
+  if (id >= model->refs_capacity) {
+    int capacity = id * 2;
+    model->refs = realloc(model->refs, sizeof(int) * capacity);
+    if (model->refs == NULL) {
+      fprintf(stderr, "out of memory\n");
+      exit(1);
+    }
+    memset(model->refs + model->refs_capacity, 0, sizeof(int) * (capacity - model->refs_capacity));
+    model->refs_capacity = capacity;
+  }
+
+  model->distinct -= model->refs[id] > 0;
+  model->refs[id] += delta;
+  model->distinct += model->refs[id] > 0;
+}
+
+static void model_ref_version(Model *model, ModelVersion *version, int delta) {
+  for (int i = 0; i < version->length; ++i) {
+    model_ref(model, version->ids[i], delta);
+  }
+}
+
+static ModelVersion *model_push(Model *model, int length, bool shared) {
+  if (model->latest + 1 == model->capacity) {
+    model->capacity *= 2;
+    model->versions = realloc(model->versions, sizeof(ModelVersion) * model->capacity);
+  }
+  ModelVersion *version = &model->versions[++model->latest];
+  version->ids = malloc(sizeof(int) * (length + 1));
+  version->length = length;
+  version->shared = shared;
+  if (model->versions == NULL || version->ids == NULL) {
+    fprintf(stderr, "out of memory\n");
+    exit(1);
+  }
+  return version;
+}
+
+static void fail(long step, const char *operation, const char *reason) {
+  fprintf(stderr, "mismatch at step %ld after %s: %s\n", step, operation, reason);
+  exit(1);
+}
+
+// a second list replaying every change reported by pdll_observe(), the way
+// a board shared with other instances replays the changes sent to it. its
+// data are copies of the ids, which aren't counted as alive.
+static pdll *replica = NULL;
+static int replica_next_id = 0;
+
+static void replica_data_free(void *data) {
+  free(data);
+}
+
+static void *replica_data_replace(void *data) {
+  (void)data;
+  int *copy = malloc(sizeof(int));
+  if (copy == NULL) {
+    fprintf(stderr, "out of memory\n");
+    exit(1);
+  }
+  *copy = replica_next_id++;
+  return copy;
+}
+
+// mark the nodes of the replica holding the ids marked in list.
+static void replica_mark(pdll *list) {
+  pdll_node *node = replica->versions[replica->latest_version].head;
+  pdll_iter(list, marked) {
+    if (!marked->to_delete) {
+      continue;
+    }
+    // both lists hold the ids in the same order.
+    while (node != NULL && *(int *)node->data != *(int *)marked->data) {
+      node = node->next;
+    }
+    if (node == NULL) {
+      fail(-1, "replica", "marked id missing");
+    }
+    pdll_node_mark_for_deletion(node);
+  }
+}
+
+static void replica_observe(pdll *list, pdll_event event, void *data, void *context) {
+  (void)context;
+  switch (event) {
+  case PDLL_APPEND: {
+    int *copy = malloc(sizeof(int));
+    if (copy == NULL) {
+      fprintf(stderr, "out of memory\n");
+      exit(1);
+    }
+    *copy = *(int *)data;
+    pdll_append(replica, copy);
+  } break;
+  case PDLL_DELETE:
+    replica_mark(list);
+    pdll_delete_marked_nodes(replica);
+    break;
+  case PDLL_AMEND:
+    replica_mark(list);
+    if (!pdll_amend_marked_nodes(replica)) {
+      fail(-1, "replica", "amend refused");
+    }
+    break;
+  case PDLL_REPLACE: {
+    // the list has created its replacements in order, one per marked node,
+    // the last one just before next_id.
+    int marked = 0;
+    pdll_iter(list, node) {
+      marked += node->to_delete;
+    }
+    replica_next_id = next_id - marked;
+    replica_mark(list);
+    pdll_replace_marked_nodes(replica, replica_data_replace);
+  } break;
+  case PDLL_UNDO:
+    pdll_undo(replica);
+    break;
+  case PDLL_BEGIN:
+    pdll_begin(replica);
+    break;
+  case PDLL_COMMIT:
+    replica_mark(list);
+    pdll_commit(replica);
+    break;
+  case PDLL_ROLLBACK:
+    pdll_rollback(replica);
+    break;
+  }
+}
+
+// compare the latest version and the bookkeeping against the model.
+static void check_state(pdll *list, Model *model, long step, const char *operation) {
+  if (list->latest_version != model->latest) {
+    fail(step, operation, "latest version");
+  }
+  if (replica->latest_version != model->latest) {
+    fail(step, operation, "replica version");
+  }
+
+  ModelVersion *version = &model->versions[model->latest];
+  int i = 0;
+  pdll_iter(list, node) {
+    if (i == version->length || *(int *)node->data != version->ids[i]) {
+      fail(step, operation, "contents");
+    }
+    ++i;
+  }
+  if (i != version->length) {
+    fail(step, operation, "length");
+  }
+  i = 0;
+  pdll_iter(replica, node) {
+    if (i == version->length || *(int *)node->data != version->ids[i]) {
+      fail(step, operation, "replica contents");
+    }
+    ++i;
+  }
+  if (i != version->length) {
+    fail(step, operation, "replica length");
+  }
+
+  // every id kept by any version must still be allocated, nothing else.
+  if (model->distinct != alive) {
+    fail(step, operation, "allocated data");
+  }
+
+  if (step % CHECK_MEMORY_INTERVAL != 0) {
+    return;
+  }
+  pdll_memory usage;
+  pdll_memory_usage(list, data_size, &usage);
+  if (usage.live_data != version->length * sizeof(int) ||
+      usage.live_data + usage.history_data != model->distinct * sizeof(int)) {
+    fail(step, operation, "memory usage");
+  }
+}
+
+// mark about ratio of the latest version, the model keeps what is marked.
+static int mark_random(pdll *list, double ratio, bool *marked) {
+  int i = 0;
+  pdll_iter(list, node) {
+    marked[i] = rng_uniform() < ratio;
+    if (marked[i]) {
+      pdll_node_mark_for_deletion(node);
+    }
+    ++i;
+  }
+  return i;
+}
+
+static void model_delete(Model *model, bool *marked) {
+  ModelVersion *version = model_push(model, model->versions[model->latest].length, false);
+  ModelVersion *current = &model->versions[model->latest - 1];
+  version->length = 0;
+  for (int i = 0; i < current->length; ++i) {
+    if (!marked[i]) {
+      version->ids[version->length++] = current->ids[i];
+    }
+  }
+  model_ref_version(model, version, 1);
+}
+
+typedef struct {
+  int *ids;
+  int count;
+} Visited;
+
+static void visit_id(void *data, void *context) {
+  Visited *visited = context;
+  visited->ids[visited->count++] = *(int *)data;
+}
+
+static int compare_ids(const void *a, const void *b) {
+  return *(const int *)a - *(const int *)b;
+}
+
+static bool model_contains(ModelVersion *version, int id) {
+  for (int i = 0; i < version->length; ++i) {
+    if (version->ids[i] == id) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// pdll_diff_latest() must visit exactly the ids in only one of the two
+// latest versions.
+static void check_diff(pdll *list, Model *model, long step) {
+  ModelVersion *current = &model->versions[model->latest];
+  ModelVersion *previous = &model->versions[model->latest - 1];
+  int capacity = current->length + previous->length + 1;
+  Visited visited = {.ids = malloc(sizeof(int) * capacity), .count = 0};
+  int *expected = malloc(sizeof(int) * capacity);
+  pdll_diff_latest(list, visit_id, &visited);
+
+  int count = 0;
+  for (int v = 0; v < 2; ++v) {
+    ModelVersion *version = v == 0 ? current : previous;
+    ModelVersion *other = v == 0 ? previous : current;
+    for (int i = 0; i < version->length; ++i) {
+      if (!model_contains(other, version->ids[i])) {
+        expected[count++] = version->ids[i];
+      }
+    }
+  }
+
+  qsort(visited.ids, visited.count, sizeof(int), compare_ids);
+  qsort(expected, count, sizeof(int), compare_ids);
+  if (visited.count != count || memcmp(visited.ids, expected, sizeof(int) * count) != 0) {
+    fail(step, "diff", "visited data");
+  }
+  free(visited.ids);
+  free(expected);
+}
+
+static void check(long steps, uint64_t seed) {
+  rng_state = seed != 0 ? seed : rng_state;
+  pdll *list = pdll_init(data_free);
+  replica = pdll_init(replica_data_free);
+  pdll_observe(list, replica_observe, NULL);
+  Model model = {.versions = malloc(sizeof(ModelVersion) * 16), .latest = 0, .capacity = 16, .refs = NULL};
+  model.versions[0] = (ModelVersion){.ids = malloc(sizeof(int)), .length = 0, .shared = false};
+  bool *marked = malloc(sizeof(bool) * (CHECK_MAX_LENGTH + 1));
+
+  for (long step = 0; step < steps; ++step) {
+    ModelVersion *current = &model.versions[model.latest];
+    double ratio = rng_uniform() * 0.5;
+    double operation = rng_uniform();
+    // keep lists short enough for a full comparison every step.
+    if (current->length >= CHECK_MAX_LENGTH) {
+      operation = 0.5;
+    }
+
+    if (operation < 0.4) {
+      int *data = data_new();
+      if (!pdll_append(list, data)) {
+        fail(step, "append", "returned false");
+      }
+      int length = current->length;
+      ModelVersion *version = model_push(&model, length + 1, length > 0);
+      current = &model.versions[model.latest - 1];
+      memcpy(version->ids, current->ids, sizeof(int) * length);
+      version->ids[length] = *data;
+      model_ref_version(&model, version, 1);
+      check_state(list, &model, step, "append");
+    } else if (operation < 0.55) {
+      mark_random(list, ratio, marked);
+      pdll_delete_marked_nodes(list);
+      model_delete(&model, marked);
+      check_state(list, &model, step, "delete");
+    } else if (operation < 0.65) {
+      // amend only works on a version owning its nodes, like the eraser
+      // the fallback is a regular delete.
+      mark_random(list, ratio, marked);
+      bool expected = model.latest > 0 && !current->shared;
+      if (pdll_amend_marked_nodes(list) != expected) {
+        fail(step, "amend", "unexpected result");
+      }
+      if (expected) {
+        int length = 0;
+        for (int i = 0; i < current->length; ++i) {
+          if (!marked[i]) {
+            current->ids[length++] = current->ids[i];
+          } else {
+            model_ref(&model, current->ids[i], -1);
+          }
+        }
+        current->length = length;
+      } else {
+        pdll_delete_marked_nodes(list);
+        model_delete(&model, marked);
+      }
+      check_state(list, &model, step, "amend");
+    } else if (operation < 0.75) {
+      int first_id = next_id;
+      mark_random(list, ratio, marked);
+      pdll_replace_marked_nodes(list, data_replace);
+      ModelVersion *version = model_push(&model, current->length, false);
+      current = &model.versions[model.latest - 1];
+      // replacements are created in list order.
+      for (int i = 0; i < current->length; ++i) {
+        version->ids[i] = marked[i] ? first_id++ : current->ids[i];
+      }
+      model_ref_version(&model, version, 1);
+      check_state(list, &model, step, "replace");
+    } else if (operation < 0.82) {
+      // a transaction of deletions and a few appends, sometimes nested,
+      // sometimes rolled back, sometimes appends only. grouped as a single
+      // version, owned unless it only appends.
+      int first_id = next_id;
+      int appends = rng_next() % 4;
+      bool rollback = rng_uniform() < 0.1;
+      bool nested = rng_uniform() < 0.3;
+      if (rng_uniform() < 0.3) {
+        ratio = 0;
+      }
+      pdll_begin(list);
+      int length = mark_random(list, ratio, marked);
+      pdll_delete_marked_nodes(list);
+      if (nested) {
+        pdll_begin(list);
+      }
+      for (int i = 0; i < appends; ++i) {
+        pdll_append(list, data_new());
+      }
+      if (nested && !pdll_commit(list)) {
+        fail(step, "transaction", "nested commit returned false");
+      }
+      if (rollback) {
+        pdll_rollback(list);
+        check_state(list, &model, step, "rollback");
+        continue;
+      }
+      if (!pdll_commit(list)) {
+        fail(step, "transaction", "commit returned false");
+      }
+
+      int kept = 0;
+      for (int i = 0; i < length; ++i) {
+        kept += !marked[i];
+      }
+      if (kept == length) {
+        // nothing deleted, the appends share the nodes like regular ones.
+        if (appends > 0) {
+          ModelVersion *version = model_push(&model, length + appends, length > 0);
+          current = &model.versions[model.latest - 1];
+          memcpy(version->ids, current->ids, sizeof(int) * length);
+          for (int i = 0; i < appends; ++i) {
+            version->ids[length + i] = first_id + i;
+          }
+          model_ref_version(&model, version, 1);
+          if (pdll_version_nodes(list, list->latest_version) != (size_t)appends) {
+            fail(step, "transaction", "appends copied the shared nodes");
+          }
+        }
+      } else {
+        model_delete(&model, marked);
+        ModelVersion *version = &model.versions[model.latest];
+        version->ids = realloc(version->ids, sizeof(int) * (version->length + appends + 1));
+        if (version->ids == NULL) {
+          fprintf(stderr, "out of memory\n");
+          exit(1);
+        }
+        for (int i = 0; i < appends; ++i) {
+          version->ids[version->length++] = first_id + i;
+          model_ref(&model, first_id + i, 1);
+        }
+      }
+      check_state(list, &model, step, "transaction");
+    } else {
+      bool expected = model.latest > 0;
+      if (expected) {
+        check_diff(list, &model, step);
+      }
+      if (pdll_undo(list) != expected) {
+        fail(step, "undo", "unexpected result");
+      }
+      if (expected) {
+        model_ref_version(&model, current, -1);
+        free(current->ids);
+        --model.latest;
+      }
+      check_state(list, &model, step, "undo");
+    }
+  }
+
+  pdll_free(list);
+  pdll_free(replica);
+  if (alive != 0) {
+    fail(steps, "free", "leaked data");
+  }
+  for (size_t v = 0; v <= model.latest; ++v) {
+    free(model.versions[v].ids);
+  }
+  free(model.versions);
+  free(model.refs);
+  free(marked);
+  printf("{\"case\": \"check\", \"steps\": %ld, \"ok\": true}\n", steps);
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1 && strcmp(argv[1], "--check") == 0) {
+    long steps = argc > 2 ? atol(argv[2]) : CHECK_STEPS;
+    uint64_t seed = argc > 3 ? strtoull(argv[3], NULL, 0) : 0;
+    check(steps, seed);
+    return 0;
+  }
+
+  bench_append();
+  double ratios[] = {0.01, 0.1, 0.5, 0.9};
+  for (size_t i = 0; i < sizeof(ratios) / sizeof(*ratios); ++i) {
+    bench_delete(ratios[i]);
+  }
+  bench_undo_chain();
+  bench_transaction();
+  bench_list();
+  return 0;
+}
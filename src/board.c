@@ -2,6 +2,11 @@
 #include "config.h"
 #include "path.h"
 #include "point.h"
+#include "simd.h"
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
 
 #define DEFER_IF_NULL(x)                                                                                               \
   do {                                                                                                                 \
@@ -10,18 +15,122 @@
     }                                                                                                                  \
   } while (0)
 
+static void layer_free_surface(Layer *layer) {
+  if (layer->cr != NULL)
+    cairo_destroy(layer->cr);
+  if (layer->surface != NULL)
+    cairo_surface_destroy(layer->surface);
+  free(layer->pixels);
+  layer->cr = NULL;
+  layer->surface = NULL;
+  layer->pixels = NULL;
+  layer->capacity = 0;
+}
+
+// create into next a surface for the layer matching the canvas. like the
+// canvas, the backing buffer only grows and is reused when it's big enough.
+// the layer itself is left as it is until layer_swap().
+static bool layer_prepare(Layer *layer, cairo_surface_t *canvas, Layer *next) {
+  int width = cairo_image_surface_get_width(canvas);
+  int height = cairo_image_surface_get_height(canvas);
+  int stride = cairo_format_stride_for_width(CAIRO_FORMAT_ARGB32, width);
+  size_t size = (size_t)stride * height;
+  *next = *layer;
+  if (size > layer->capacity) {
+    next->pixels = malloc(size);
+    if (next->pixels == NULL) {
+      return false;
+    }
+    next->capacity = size;
+  }
+
+  next->surface = cairo_image_surface_create_for_data(next->pixels, CAIRO_FORMAT_ARGB32, width, height, stride);
+  if (cairo_surface_status(next->surface) != CAIRO_STATUS_SUCCESS) {
+    cairo_surface_destroy(next->surface);
+    if (next->pixels != layer->pixels) {
+      free(next->pixels);
+    }
+    return false;
+  }
+
+  double scale_x, scale_y;
+  cairo_surface_get_device_scale(canvas, &scale_x, &scale_y);
+  cairo_surface_set_device_scale(next->surface, scale_x, scale_y);
+  next->cr = NULL;
+  return true;
+}
+
+// give up a surface made by layer_prepare().
+static void layer_discard(Layer *layer, Layer *next) {
+  cairo_surface_destroy(next->surface);
+  if (next->pixels != layer->pixels) {
+    free(next->pixels);
+  }
+}
+
+// replace the layer's surface by the one made by layer_prepare(), cleared
+// and translated by (dx, dy).
+static void layer_swap(Layer *layer, Layer *next, double dx, double dy) {
+  if (layer->cr != NULL)
+    cairo_destroy(layer->cr);
+  if (layer->surface != NULL)
+    cairo_surface_destroy(layer->surface);
+  if (layer->pixels != next->pixels) {
+    free(layer->pixels);
+  }
+
+  memset(next->pixels, 0,
+         (size_t)cairo_image_surface_get_stride(next->surface) * cairo_image_surface_get_height(next->surface));
+  cairo_surface_mark_dirty(next->surface);
+  next->cr = cairo_create(next->surface);
+  cairo_translate(next->cr, dx, dy);
+  cairo_set_line_cap(next->cr, CAIRO_LINE_CAP_ROUND);
+  cairo_set_line_join(next->cr, CAIRO_LINE_JOIN_ROUND);
+  next->stale = true;
+  *layer = *next;
+}
+
+// give the layer a transparent surface matching the canvas, translated by (dx, dy).
+// the old surface is kept when a new one can't be created.
+static bool layer_resize(Layer *layer, cairo_surface_t *canvas, double dx, double dy) {
+  Layer next;
+  if (!layer_prepare(layer, canvas, &next)) {
+    return false;
+  }
+  layer_swap(layer, &next, dx, dy);
+  return true;
+}
+
+// set every pixel of an image surface to value, ignoring any transform or clip.
+static void surface_fill(cairo_surface_t *surface, uint32_t value) {
+  cairo_surface_flush(surface);
+  simd.fill_rect(cairo_image_surface_get_data(surface), cairo_image_surface_get_stride(surface), value,
+                 cairo_image_surface_get_width(surface), cairo_image_surface_get_height(surface));
+  cairo_surface_mark_dirty(surface);
+}
+
 Board *board_create(int width, int height) {
+  simd_init();
   Board *board = malloc(sizeof(Board));
   SDL_Window *window = NULL;
   SDL_Renderer *renderer = NULL;
   SDL_Surface *sdl_surface = NULL;
-  SDL_Texture *sdl_texture = NULL;
+  unsigned char *frame_pixels = NULL;
   cairo_surface_t *cr_surface = NULL;
+  unsigned char *canvas_pixels = NULL;
   cairo_t *canvas = NULL;
   SDL_Cursor *default_cursor = NULL;
   List *current_stroke_points = NULL;
   List *current_stroke_paths = NULL;
   pdll *strokes = NULL;
+  Layer *layers = NULL;
+  Layer back = {0};
+  SpriteCache *sprites = NULL;
+  OutlineCache *outlines = NULL;
+  ChunkStore *chunks = NULL;
+  Ring *commands = NULL;
+  SDL_sem *commands_available = NULL;
+  SDL_mutex *frame_lock = NULL;
 
   DEFER_IF_NULL(board);
 
@@ -29,7 +138,7 @@ Board *board_create(int width, int height) {
                             SDL_WINDOW_SHOWN | SDL_WINDOW_ALLOW_HIGHDPI | SDL_WINDOW_RESIZABLE);
   DEFER_IF_NULL(window);
 
-  renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+  renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
   DEFER_IF_NULL(renderer);
 
   int window_width;
@@ -40,13 +149,20 @@ Board *board_create(int width, int height) {
   int renderer_height;
   SDL_GetRendererOutputSize(renderer, &renderer_width, &renderer_height);
 
-  sdl_surface = SDL_CreateRGBSurface(0, renderer_width, renderer_height, 32, R_MASK, G_MASK, B_MASK, 0);
+  // the pixel buffers are kept around and reused by later resizes.
+  size_t frame_size = (size_t)renderer_width * 4 * renderer_height;
+  frame_pixels = malloc(frame_size);
+  DEFER_IF_NULL(frame_pixels);
+  sdl_surface = SDL_CreateRGBSurfaceFrom(frame_pixels, renderer_width, renderer_height, 32, renderer_width * 4, R_MASK,
+                                         G_MASK, B_MASK, 0);
   DEFER_IF_NULL(sdl_surface);
 
-  sdl_texture = SDL_CreateTextureFromSurface(renderer, sdl_surface);
-  DEFER_IF_NULL(sdl_texture);
-
-  cr_surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, sdl_surface->w, sdl_surface->h);
+  int canvas_stride = cairo_format_stride_for_width(CAIRO_FORMAT_RGB24, renderer_width);
+  size_t canvas_size = (size_t)canvas_stride * renderer_height;
+  canvas_pixels = malloc(canvas_size);
+  DEFER_IF_NULL(canvas_pixels);
+  cr_surface = cairo_image_surface_create_for_data(canvas_pixels, CAIRO_FORMAT_RGB24, renderer_width, renderer_height,
+                                                   canvas_stride);
   DEFER_IF_NULL(cr_surface);
 
   int x_multiplier = renderer_width / window_width;
@@ -55,6 +171,17 @@ Board *board_create(int width, int height) {
 
   canvas = cairo_create(cr_surface);
 
+  layers = malloc(sizeof(Layer));
+  DEFER_IF_NULL(layers);
+  layers[0] = (Layer){.strokes = NULL, .surface = NULL, .cr = NULL, .visible = true, .stale = true};
+  if (!layer_resize(&layers[0], cr_surface, 0, 0)) {
+    goto defer;
+  }
+  // the refresh draws into a surface of its own, see Refresh.
+  if (!layer_resize(&back, cr_surface, 0, 0)) {
+    goto defer;
+  }
+
   SDL_SetRenderDrawColor(renderer, BOARD_BG_CAIRO);
   SDL_RenderClear(renderer);
   DEFER_IF_NULL(canvas);
@@ -68,30 +195,87 @@ Board *board_create(int width, int height) {
   DEFER_IF_NULL(current_stroke_paths);
   strokes = pdll_init((pdll_free_node_data_func)path_free);
   DEFER_IF_NULL(strokes);
+  layers[0].strokes = strokes;
+  sprites = sprite_cache_create(SPRITE_CACHE_SIZE);
+  DEFER_IF_NULL(sprites);
+  outlines = outline_cache_create(OUTLINE_CACHE_SIZE);
+  DEFER_IF_NULL(outlines);
+  commands = ring_create(sizeof(Command), COMMANDS_CAPACITY);
+  DEFER_IF_NULL(commands);
+  commands_available = SDL_CreateSemaphore(0);
+  DEFER_IF_NULL(commands_available);
+  // chunks read ahead wake the render thread up to install them.
+  chunks = chunk_store_create(commands_available);
+  DEFER_IF_NULL(chunks);
+  frame_lock = SDL_CreateMutex();
+  DEFER_IF_NULL(frame_lock);
 
   board->window = window;
   board->renderer = renderer;
   board->sdl_surface = sdl_surface;
+  board->frame_pixels = frame_pixels;
+  board->frame_capacity = frame_size;
   board->cursor = NULL;
   board->default_cursor = default_cursor;
-  board->sdl_texture = sdl_texture;
+  board->tiles = NULL;
+  board->tile_columns = 0;
+  board->tile_rows = 0;
+  board->tiles_capacity = 0;
+  board->viewport = (SDL_Rect){0};
+  board->present_pending = false;
+  board->resize_pending = false;
+  board->resize_deadline = 0;
   board->cr_surface = cr_surface;
+  board->canvas_pixels = canvas_pixels;
+  board->canvas_capacity = canvas_size;
   board->cr = canvas;
   board->width = window_width;
   board->height = window_height;
   board->current_stroke_points = current_stroke_points;
   board->current_stroke_paths = current_stroke_paths;
+  board->layers = layers;
+  board->layers_count = 1;
+  board->active_layer = 0;
   board->strokes = strokes;
+  board->sprites = sprites;
+  board->outlines = outlines;
+  board->chunks = chunks;
+  board->prefetch = (Prefetch){.surfaces = NULL, .count = 0, .valid = false};
+  board->refresh = (Refresh){.active = false, .layer = 0, .node = NULL, .back = back};
+  board->pan_dx = 0;
+  board->pan_dy = 0;
   board->dx = 0;
   board->dy = 0;
   board->stroke_width = STROKE_WIDTH_MEDIUM;
   board->stroke_color = COLOR_PRIMARY;
   board->stroke_width_previous = board->stroke_width;
+  board->current_stroke_width = board->stroke_width;
+  board->current_stroke_color = board->stroke_color;
   board->mouse_x = 0;
   board->mouse_x_raw = 0;
   board->mouse_y = 0;
   board->mouse_y_raw = 0;
   board->state = STATE_IDLE;
+  board->dirty = false;
+  board->erase_version = 0;
+  board->gesture = GESTURE_NONE;
+  board->selection.paths = NULL;
+  board->selection.count = 0;
+  board->selection.capacity = 0;
+  board->selection.band_area = (SDL_Rect){0};
+  cairo_matrix_init_identity(&board->selection.matrix);
+  board->clipboard = (Clipboard){0};
+  board->imports = NULL;
+  board->control = NULL;
+  board->sync = NULL;
+  board->commands = commands;
+  board->commands_pending = false;
+  board->commands_available = commands_available;
+  board->frame_lock = frame_lock;
+  board->frame_x = 0;
+  board->frame_y = 0;
+  board->frame_dirty = false;
+  board->frame_event = SDL_RegisterEvents(1);
   return board;
 
 defer:
@@ -100,10 +284,10 @@ defer:
     cairo_destroy(canvas);
   if (cr_surface != NULL)
     cairo_surface_destroy(cr_surface);
-  if (sdl_texture != NULL)
-    SDL_DestroyTexture(sdl_texture);
   if (sdl_surface != NULL)
     SDL_FreeSurface(sdl_surface);
+  free(frame_pixels);
+  free(canvas_pixels);
   if (renderer != NULL)
     SDL_DestroyRenderer(renderer);
   if (window != NULL)
@@ -114,72 +298,387 @@ defer:
     list_free(current_stroke_paths);
   if (strokes != NULL)
     pdll_free(strokes);
+  if (layers != NULL)
+    layer_free_surface(&layers[0]);
+  free(layers);
+  layer_free_surface(&back);
+  if (sprites != NULL)
+    sprite_cache_free(sprites);
+  if (outlines != NULL)
+    outline_cache_free(outlines);
+  if (chunks != NULL)
+    chunk_store_free(chunks);
   if (default_cursor != NULL)
     SDL_FreeCursor(default_cursor);
+  if (commands != NULL)
+    ring_free(commands);
+  if (commands_available != NULL)
+    SDL_DestroySemaphore(commands_available);
+  if (frame_lock != NULL)
+    SDL_DestroyMutex(frame_lock);
   return NULL;
 }
 
+static void board_free_tiles(Board *board) {
+  for (int i = 0; i < board->tiles_capacity; ++i) {
+    SDL_DestroyTexture(board->tiles[i].texture);
+  }
+  free(board->tiles);
+  board->tiles = NULL;
+  board->tiles_capacity = 0;
+  board->tile_columns = 0;
+  board->tile_rows = 0;
+}
+
+static bool board_create_tiles(Board *board, int pixel_width, int pixel_height) {
+  // a viewport of w pixels overlaps at most w / TILE_SIZE + 2 tiles.
+  // tiles are assigned to slots modulo the pool dimensions,
+  // which guarantees the visible tiles never share a slot.
+  int columns = pixel_width / TILE_SIZE + 2;
+  int rows = pixel_height / TILE_SIZE + 2;
+
+  // textures are kept when the pool shrinks, only missing ones are created.
+  if (columns * rows > board->tiles_capacity) {
+    Tile *tiles = realloc(board->tiles, sizeof(Tile) * columns * rows);
+    if (tiles == NULL) {
+      return false;
+    }
+    board->tiles = tiles;
+
+    for (int i = board->tiles_capacity; i < columns * rows; ++i) {
+      tiles[i].texture =
+          SDL_CreateTexture(board->renderer, SDL_PIXELFORMAT_RGB888, SDL_TEXTUREACCESS_STATIC, TILE_SIZE, TILE_SIZE);
+      if (tiles[i].texture == NULL) {
+        board->tiles_capacity = i;
+        board_free_tiles(board);
+        return false;
+      }
+    }
+    board->tiles_capacity = columns * rows;
+  }
+
+  board->tile_columns = columns;
+  board->tile_rows = rows;
+  for (int i = 0; i < board->tiles_capacity; ++i) {
+    // no tile sits at INT_MIN, mark the slot as unused.
+    board->tiles[i].x = INT_MIN;
+    board->tiles[i].y = INT_MIN;
+    board->tiles[i].valid = (SDL_Rect){0};
+  }
+  return true;
+}
+
+static int floor_div(int a, int b) {
+  return a / b - (a % b != 0 && (a < 0) != (b < 0));
+}
+
+static int positive_mod(int a, int b) {
+  return ((a % b) + b) % b;
+}
+
+static bool rect_contains(SDL_Rect *outer, SDL_Rect *inner) {
+  return inner->x >= outer->x && inner->y >= outer->y && inner->x + inner->w <= outer->x + outer->w &&
+         inner->y + inner->h <= outer->y + outer->h;
+}
+
+// upload the part of the frame that covers area (in board pixels) to a tile.
+static void tile_upload(Tile *tile, SDL_Surface *frame, int frame_x, int frame_y, SDL_Rect *area) {
+  SDL_Rect local = {.x = area->x - tile->x, .y = area->y - tile->y, .w = area->w, .h = area->h};
+  unsigned char *pixels = frame->pixels;
+  pixels += (area->y + frame_y) * frame->pitch + (area->x + frame_x) * 4;
+  SDL_UpdateTexture(tile->texture, &local, pixels, frame->pitch);
+}
+
+static void clipboard_clear(Clipboard *clipboard) {
+  for (int i = 0; i < clipboard->count; ++i) {
+    path_free(clipboard->paths[i]);
+  }
+  clipboard->count = 0;
+}
+
 void board_free(Board *board) {
-  pdll_free(board->strokes);
+  // the render thread is gone, batches still queued are answered here.
+  control_free(board->control);
+  sync_free(board->sync);
+  while (board->imports != NULL) {
+    Import *import = board->imports;
+    board->imports = import->next;
+    import_free(import);
+  }
+
+  // strokes release their sprites and outlines, free them before the caches.
+  for (int i = 0; i < board->layers_count; ++i) {
+    pdll_free(board->layers[i].strokes);
+    layer_free_surface(&board->layers[i]);
+  }
+  free(board->layers);
+  layer_free_surface(&board->refresh.back);
+  clipboard_clear(&board->clipboard);
+  free(board->clipboard.paths);
+  sprite_cache_free(board->sprites);
+  outline_cache_free(board->outlines);
+  chunk_store_free(board->chunks);
+  for (int i = 0; i < board->prefetch.count; ++i) {
+    if (board->prefetch.surfaces[i] != NULL)
+      cairo_surface_destroy(board->prefetch.surfaces[i]);
+  }
+  free(board->prefetch.surfaces);
+  free(board->prefetch.changes);
   list_free(board->current_stroke_paths);
   list_free(board->current_stroke_points);
+  free(board->selection.paths);
+  ring_free(board->commands);
+  SDL_DestroySemaphore(board->commands_available);
+  SDL_DestroyMutex(board->frame_lock);
 
   cairo_destroy(board->cr);
   cairo_surface_destroy(board->cr_surface);
+  free(board->canvas_pixels);
   SDL_FreeCursor(board->cursor);
   SDL_FreeCursor(board->default_cursor);
-  SDL_DestroyTexture(board->sdl_texture);
+  board_free_tiles(board);
   SDL_FreeSurface(board->sdl_surface);
+  free(board->frame_pixels);
   SDL_DestroyRenderer(board->renderer);
   SDL_DestroyWindow(board->window);
 
   free(board);
 }
 
-void board_resize_surface(Board *board) {
-  SDL_GetWindowSize(board->window, &board->width, &board->height);
+void board_push_command(Board *board, Command *command) {
+  // never drop input. if the render thread fell that far behind,
+  // make sure it is awake and wait for it to make room.
+  while (!ring_push(board->commands, command)) {
+    SDL_SemPost(board->commands_available);
+    SDL_Delay(1);
+  }
+  board->commands_pending = true;
+}
+
+void board_flush_commands(Board *board) {
+  if (board->commands_pending) {
+    board->commands_pending = false;
+    SDL_SemPost(board->commands_available);
+  }
+}
 
-  int renderer_width;
-  int renderer_height;
-  SDL_GetRendererOutputSize(board->renderer, &renderer_width, &renderer_height);
+// strokes changed, what was rendered ahead no longer matches them.
+// edits also mean the pan is over, so nothing is rendered ahead until the next one.
+static void board_prefetch_invalidate(Board *board) {
+  board->prefetch.valid = false;
+  board->pan_dx = 0;
+  board->pan_dy = 0;
+}
 
-  SDL_Surface *sdl_surface =
-      SDL_CreateRGBSurface(0, renderer_width, renderer_height, 32, 0x00ff0000, 0x0000ff00, 0x000000ff, 0);
-  if (sdl_surface == NULL) {
-    return;
+// whether area (window coordinates) lies within the prefetched band,
+// which also has to sit on whole device pixels to be copied as is.
+static bool board_prefetch_covers(Board *board, SDL_Rect *area) {
+  Prefetch *prefetch = &board->prefetch;
+  if (!prefetch->valid || prefetch->count != board->layers_count) {
+    return false;
+  }
+  // any path that changes strokes, invalidating or not, shows up here.
+  for (int i = 0; i < prefetch->count; ++i) {
+    if (prefetch->changes[i] != board->layers[i].strokes->changes) {
+      return false;
+    }
   }
 
-  SDL_FreeSurface(board->sdl_surface);
-  board->sdl_surface = sdl_surface;
+  double scale_x, scale_y;
+  cairo_surface_get_device_scale(board->cr_surface, &scale_x, &scale_y);
+  double x = prefetch->area.x - prefetch->dx + board->dx;
+  double y = prefetch->area.y - prefetch->dy + board->dy;
+  if (x * scale_x != floor(x * scale_x) || y * scale_y != floor(y * scale_y)) {
+    return false;
+  }
+  return area->x >= x && area->y >= y && area->x + area->w <= x + prefetch->area.w &&
+         area->y + area->h <= y + prefetch->area.h;
+}
+
+static void board_prefetch_copy(Board *board, int index, SDL_Rect *area) {
+  Prefetch *prefetch = &board->prefetch;
+  cairo_t *cr = board->layers[index].cr;
+  cairo_save(cr);
+  cairo_rectangle(cr, area->x - board->dx, area->y - board->dy, area->w, area->h);
+  cairo_clip(cr);
+  cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+  cairo_set_source_surface(cr, prefetch->surfaces[index], prefetch->area.x - prefetch->dx,
+                           prefetch->area.y - prefetch->dy);
+  cairo_paint(cr);
+  cairo_restore(cr);
+}
 
-  SDL_Texture *sdl_texture = SDL_CreateTextureFromSurface(board->renderer, sdl_surface);
+// render the band ahead of the pan into a surface per visible layer.
+static bool board_prefetch_render(Board *board, SDL_Rect *area) {
+  Prefetch *prefetch = &board->prefetch;
+  prefetch->valid = false;
+  if (prefetch->count != board->layers_count) {
+    cairo_surface_t **surfaces = realloc(prefetch->surfaces, sizeof(cairo_surface_t *) * board->layers_count);
+    if (surfaces == NULL) {
+      return false;
+    }
+    for (int i = prefetch->count; i < board->layers_count; ++i) {
+      surfaces[i] = NULL;
+    }
+    prefetch->surfaces = surfaces;
+    size_t *changes = realloc(prefetch->changes, sizeof(size_t) * board->layers_count);
+    if (changes == NULL) {
+      return false;
+    }
+    prefetch->changes = changes;
+    prefetch->count = board->layers_count;
+  }
 
-  if (sdl_texture == NULL) {
-    SDL_FreeSurface(sdl_surface);
+  double scale_x, scale_y;
+  cairo_surface_get_device_scale(board->cr_surface, &scale_x, &scale_y);
+  int pixel_width = area->w * scale_x;
+  int pixel_height = area->h * scale_y;
+  for (int i = 0; i < board->layers_count; ++i) {
+    Layer *layer = &board->layers[i];
+    cairo_surface_t *surface = prefetch->surfaces[i];
+    if (surface != NULL && (!layer->visible || cairo_image_surface_get_width(surface) != pixel_width ||
+                            cairo_image_surface_get_height(surface) != pixel_height)) {
+      cairo_surface_destroy(surface);
+      surface = NULL;
+    }
+    prefetch->surfaces[i] = surface;
+    prefetch->changes[i] = layer->strokes->changes;
+    if (!layer->visible) {
+      continue;
+    }
+
+    if (surface == NULL) {
+      surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, pixel_width, pixel_height);
+      if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+        cairo_surface_destroy(surface);
+        return false;
+      }
+      cairo_surface_set_device_scale(surface, scale_x, scale_y);
+      prefetch->surfaces[i] = surface;
+    }
+
+    // the same user space as the layer: board coordinates, here shifted
+    // so the band's top left corner is the surface origin.
+    surface_fill(surface, 0);
+    cairo_t *cr = cairo_create(surface);
+    cairo_translate(cr, board->dx - area->x, board->dy - area->y);
+    cairo_set_line_cap(cr, CAIRO_LINE_CAP_ROUND);
+    cairo_set_line_join(cr, CAIRO_LINE_JOIN_ROUND);
+    board_draw_strokes(board, layer, cr);
+    cairo_destroy(cr);
+    cairo_surface_flush(surface);
+  }
+
+  prefetch->area = *area;
+  prefetch->dx = board->dx;
+  prefetch->dy = board->dy;
+  prefetch->valid = true;
+  return true;
+}
+
+// called when the render thread has nothing else to do. renders the band
+// the pan is heading to, deeper the faster it goes, unless the nearer half
+// of it is already prefetched.
+void board_prefetch(Board *board) {
+  double vx = board->pan_dx;
+  double vy = board->pan_dy;
+  if ((vx == 0 && vy == 0) || board->refresh.active) {
+    return;
+  }
+
+  // only along the main direction, the other strip is thin and drawn as usual.
+  // the band is longer than the window edge to absorb some drift across it.
+  bool horizontal = fabs(vx) >= fabs(vy);
+  double speed = horizontal ? fabs(vx) : fabs(vy);
+  int depth = fmin(fmax(speed * PREFETCH_FRAMES, PREFETCH_MIN_DEPTH), PREFETCH_MAX_DEPTH);
+  SDL_Rect band, ahead;
+  if (horizontal) {
+    // a positive translation moves the board right and exposes its left edge.
+    band = (SDL_Rect){.x = vx > 0 ? -depth : board->width, .y = -depth, .w = depth, .h = board->height + 2 * depth};
+    ahead = (SDL_Rect){.x = vx > 0 ? -depth / 2 : board->width, .y = 0, .w = depth / 2, .h = board->height};
+  } else {
+    band = (SDL_Rect){.x = -depth, .y = vy > 0 ? -depth : board->height, .w = board->width + 2 * depth, .h = depth};
+    ahead = (SDL_Rect){.x = 0, .y = vy > 0 ? -depth / 2 : board->height, .w = board->width, .h = depth / 2};
+  }
+
+  if (!board_prefetch_covers(board, &ahead)) {
+    board_prefetch_render(board, &band);
   }
+}
 
-  SDL_DestroyTexture(board->sdl_texture);
-  board->sdl_texture = sdl_texture;
+// the layers by index, followed by the refresh's back buffer.
+static Layer *board_surface_layer(Board *board, int index) {
+  return index < board->layers_count ? &board->layers[index] : &board->refresh.back;
+}
 
-  cairo_surface_t *cr_surface = cairo_image_surface_create_for_data(
-      (unsigned char *)sdl_surface->pixels, CAIRO_FORMAT_RGB24, sdl_surface->w, sdl_surface->h, sdl_surface->pitch);
+void board_resize_surface(Board *board, int width, int height, int pixel_width, int pixel_height) {
+  // the backing buffer only grows, shrinking or growing back
+  // within its capacity reuses it without allocating.
+  int stride = cairo_format_stride_for_width(CAIRO_FORMAT_RGB24, pixel_width);
+  size_t size = (size_t)stride * pixel_height;
+  unsigned char *pixels = board->canvas_pixels;
+  cairo_surface_t *cr_surface = NULL;
+  Layer *layers = NULL;
+  int prepared = 0;
+  if (size > board->canvas_capacity) {
+    pixels = malloc(size);
+    DEFER_IF_NULL(pixels);
+  }
 
-  if (board->cr_surface != cr_surface) {
-    cairo_surface_destroy(board->cr_surface);
-    board->cr_surface = cr_surface;
+  cr_surface = cairo_image_surface_create_for_data(pixels, CAIRO_FORMAT_RGB24, pixel_width, pixel_height, stride);
+  if (cairo_surface_status(cr_surface) != CAIRO_STATUS_SUCCESS) {
+    goto defer;
   }
 
-  cairo_t *canvas = cairo_create(board->cr_surface);
+  int x_multiplier = pixel_width / width;
+  int y_multiplier = pixel_height / height;
+  cairo_surface_set_device_scale(cr_surface, x_multiplier, y_multiplier);
+
+  // the layers and the refresh's back buffer follow the canvas. their surfaces
+  // are all made before anything is replaced, so a failure leaves the old size in place.
+  layers = malloc(sizeof(Layer) * (board->layers_count + 1));
+  DEFER_IF_NULL(layers);
+  for (; prepared <= board->layers_count; ++prepared) {
+    if (!layer_prepare(board_surface_layer(board, prepared), cr_surface, &layers[prepared])) {
+      goto defer;
+    }
+  }
 
-  if (board->cr != canvas) {
-    cairo_destroy(board->cr);
-    board->cr = canvas;
+  cairo_t *canvas = cairo_create(cr_surface);
+  cairo_destroy(board->cr);
+  cairo_surface_destroy(board->cr_surface);
+  if (pixels != board->canvas_pixels) {
+    free(board->canvas_pixels);
+    board->canvas_pixels = pixels;
+    board->canvas_capacity = size;
   }
+  board->cr_surface = cr_surface;
+  board->cr = canvas;
+  board->width = width;
+  board->height = height;
 
   // cairo canvas (cr) is recreated so we need to update its translation.
   cairo_translate(board->cr, board->dx, board->dy);
-  cairo_set_source_surface(board->cr, cr_surface, 0, 0);
-  cairo_paint(board->cr);
+
+  // their content is redrawn by the next refresh.
+  for (int i = 0; i <= board->layers_count; ++i) {
+    layer_swap(board_surface_layer(board, i), &layers[i], board->dx, board->dy);
+  }
+  free(layers);
+  board_prefetch_invalidate(board);
+  return;
+
+defer:
+  fprintf(stderr, "resize: can't create a %dx%d canvas, keeping the old one\n", pixel_width, pixel_height);
+  for (int i = 0; i < prepared; ++i) {
+    layer_discard(board_surface_layer(board, i), &layers[i]);
+  }
+  free(layers);
+  if (cr_surface != NULL)
+    cairo_surface_destroy(cr_surface);
+  if (pixels != board->canvas_pixels) {
+    free(pixels);
+  }
 }
 
 void board_clear(Board *board) {
@@ -188,56 +687,391 @@ void board_clear(Board *board) {
   cairo_fill(board->cr);
 }
 
-void board_render(Board *board, SDL_Rect *update_area) {
+// redraw the strokes of a layer within area, or all of it when area is NULL.
+static void layer_redraw_clipped(Board *board, Layer *layer, SDL_Rect *area) {
+  // area is in window coordinates, undo the board translation for the clip.
+  cairo_save(layer->cr);
+  if (area != NULL) {
+    cairo_rectangle(layer->cr, area->x - board->dx, area->y - board->dy, area->w, area->h);
+    cairo_clip(layer->cr);
+  }
+  cairo_set_operator(layer->cr, CAIRO_OPERATOR_CLEAR);
+  cairo_paint(layer->cr);
+  cairo_set_operator(layer->cr, CAIRO_OPERATOR_OVER);
+  board_draw_strokes(board, layer, layer->cr);
+  cairo_restore(layer->cr);
+  if (area == NULL) {
+    layer->stale = false;
+  }
+}
+
+// paint the visible layers over the background, bottom to top, and the
+// selection on top of them. area is NULL for the whole canvas.
+static void board_composite_clipped(Board *board, SDL_Rect *area) {
+  cairo_save(board->cr);
+  if (area != NULL) {
+    cairo_rectangle(board->cr, area->x - board->dx, area->y - board->dy, area->w, area->h);
+    cairo_clip(board->cr);
+  }
+  board_clear(board);
+  for (int i = 0; i < board->layers_count; ++i) {
+    Layer *layer = &board->layers[i];
+    if (!layer->visible) {
+      continue;
+    }
+    // layer pixels line up with the canvas pixels, paint them untransformed.
+    cairo_save(board->cr);
+    cairo_identity_matrix(board->cr);
+    cairo_set_source_surface(board->cr, layer->surface, 0, 0);
+    cairo_paint(board->cr);
+    cairo_restore(board->cr);
+  }
+  board_draw_selection(board);
+  cairo_restore(board->cr);
+}
+
+// only the active layer is edited, the others are composited as they are.
+// a refresh in progress notices the edit by itself, see board_refresh_step().
+static void board_redraw_clipped(Board *board, SDL_Rect *area) {
+  board_prefetch_invalidate(board);
+  layer_redraw_clipped(board, &board->layers[board->active_layer], area);
+  board_composite_clipped(board, area);
+}
+
+void board_redraw_area(Board *board, SDL_Rect *area) {
+  board_redraw_clipped(board, area);
+  board_invalidate(board, area);
+}
+
+void board_invalidate(Board *board, SDL_Rect *area) {
+  SDL_Rect full = {.x = 0, .y = 0, .w = board->width, .h = board->height};
+  if (area == NULL) {
+    area = &full;
+  }
+
+  if (board->dirty) {
+    SDL_UnionRect(&board->dirty_area, area, &board->dirty_area);
+  } else {
+    board->dirty_area = *area;
+    board->dirty = true;
+  }
+}
+
+void board_publish_frame(Board *board) {
+  // the dirty area is stored in window coordinates,
+  // the frame is in renderer (possibly HiDPI) pixels.
+  double scale_x, scale_y;
+  cairo_surface_get_device_scale(board->cr_surface, &scale_x, &scale_y);
+  int pixel_width = cairo_image_surface_get_width(board->cr_surface);
+  int pixel_height = cairo_image_surface_get_height(board->cr_surface);
+  SDL_Rect canvas_area = {.x = 0, .y = 0, .w = pixel_width, .h = pixel_height};
+
+  // frame_x and frame_y are only written by this thread, no need to lock.
+  int frame_x = lround(board->dx * scale_x);
+  int frame_y = lround(board->dy * scale_y);
+  bool moved = frame_x != board->frame_x || frame_y != board->frame_y;
+  if (!board->dirty && !moved) {
+    return;
+  }
+
+  SDL_Rect area = {0};
+  if (board->dirty) {
+    SDL_Rect dirty_area = {
+        .x = board->dirty_area.x * scale_x,
+        .y = board->dirty_area.y * scale_y,
+        .w = board->dirty_area.w * scale_x,
+        .h = board->dirty_area.h * scale_y,
+    };
+    if (!SDL_IntersectRect(&dirty_area, &canvas_area, &area)) {
+      area = (SDL_Rect){0};
+    }
+    board->dirty = false;
+  }
+
+  if (area.w == 0 && !moved) {
+    return;
+  }
+
+  cairo_surface_flush(board->cr_surface);
   unsigned char *data = cairo_image_surface_get_data(board->cr_surface);
-  if (update_area != NULL) {
-    // transform the data and "offset" it in such way
-    // that when we update the surface, it appears as
-    // if it is rendered in the right place.
-    unsigned char *new_data = malloc(board->width * board->height * 4);
-    int line = board->width * 4;
-    for (int l = 0; l < board->height; ++l) {
-      for (int i = l * line; i < update_area->w * 4 + l * line; ++i) {
-        int transformation = i + update_area->x * 4 + update_area->y * line;
-        if (transformation < board->width * board->height * 4) {
-          new_data[i] = data[transformation];
-        }
+  int stride = cairo_image_surface_get_stride(board->cr_surface);
+
+  SDL_LockMutex(board->frame_lock);
+  bool frame_pending = board->frame_dirty;
+
+  if (board->sdl_surface->w != pixel_width || board->sdl_surface->h != pixel_height) {
+    // the canvas was resized, the whole frame is stale.
+    // like the canvas, the frame buffer is reused when the new size fits.
+    size_t size = (size_t)pixel_width * 4 * pixel_height;
+    unsigned char *pixels = board->frame_pixels;
+    if (size > board->frame_capacity) {
+      pixels = malloc(size);
+    }
+
+    SDL_Surface *frame = NULL;
+    if (pixels != NULL) {
+      frame = SDL_CreateRGBSurfaceFrom(pixels, pixel_width, pixel_height, 32, pixel_width * 4, R_MASK, G_MASK, B_MASK,
+                                       0);
+    }
+    if (frame == NULL) {
+      if (pixels != board->frame_pixels) {
+        free(pixels);
+      }
+      SDL_UnlockMutex(board->frame_lock);
+      return;
+    }
+
+    SDL_FreeSurface(board->sdl_surface);
+    if (pixels != board->frame_pixels) {
+      free(board->frame_pixels);
+      board->frame_pixels = pixels;
+      board->frame_capacity = size;
+    }
+    board->sdl_surface = frame;
+    area = canvas_area;
+    board->frame_dirty = false;
+  }
+
+  // copy only the damaged rows into the front buffer.
+  // after panning every pixel moved, even though nothing is
+  // reported as damaged, so copy everything.
+  SDL_Rect copy_area = moved ? canvas_area : area;
+  unsigned char *frame_pixels = board->sdl_surface->pixels;
+  int frame_pitch = board->sdl_surface->pitch;
+  size_t offset = copy_area.x * 4;
+  simd.copy_rect(frame_pixels + copy_area.y * frame_pitch + offset, frame_pitch, data + copy_area.y * stride + offset,
+                 stride, copy_area.w * 4, copy_area.h);
+
+  // damage is kept in board pixels so frames published
+  // with different translations can be merged.
+  // an empty area still publishes a frame, to show the new translation.
+  area.x -= frame_x;
+  area.y -= frame_y;
+  board->frame_x = frame_x;
+  board->frame_y = frame_y;
+  if (board->frame_dirty) {
+    SDL_UnionRect(&board->frame_dirty_area, &area, &board->frame_dirty_area);
+  } else {
+    board->frame_dirty_area = area;
+    board->frame_dirty = true;
+  }
+  SDL_UnlockMutex(board->frame_lock);
+
+  // wake up the input thread, unless it wasn't done with the previous frame yet.
+  if (!frame_pending) {
+    SDL_Event event = {.type = board->frame_event};
+    SDL_PushEvent(&event);
+  }
+}
+
+// bring the tiles up to date with the published frame.
+// must be called with frame_lock held.
+static bool board_upload_tiles(Board *board) {
+  board->frame_dirty = false;
+
+  SDL_Surface *frame = board->sdl_surface;
+  int columns = frame->w / TILE_SIZE + 2;
+  int rows = frame->h / TILE_SIZE + 2;
+  if (columns != board->tile_columns || rows != board->tile_rows) {
+    if (!board_create_tiles(board, frame->w, frame->h)) {
+      return false;
+    }
+  }
+
+  // the visible part of the board, in board pixels.
+  SDL_Rect viewport = {.x = -board->frame_x, .y = -board->frame_y, .w = frame->w, .h = frame->h};
+  board->viewport = viewport;
+  int first_column = floor_div(viewport.x, TILE_SIZE);
+  int first_row = floor_div(viewport.y, TILE_SIZE);
+  int last_column = floor_div(viewport.x + viewport.w - 1, TILE_SIZE);
+  int last_row = floor_div(viewport.y + viewport.h - 1, TILE_SIZE);
+
+  // tiles that left the viewport are not kept up to date by the
+  // render thread, forget whatever they hold.
+  for (int i = 0; i < columns * rows; ++i) {
+    Tile *tile = &board->tiles[i];
+    int column = floor_div(tile->x, TILE_SIZE);
+    int row = floor_div(tile->y, TILE_SIZE);
+    if (column < first_column || column > last_column || row < first_row || row > last_row) {
+      tile->valid = (SDL_Rect){0};
+    }
+  }
+
+  // upload only tiles that are stale or damaged.
+  // newly exposed parts are uploaded, tiles that just moved are reused as is.
+  // only the visible part of a tile is kept valid, the rest may change unnoticed.
+  for (int row = first_row; row <= last_row; ++row) {
+    for (int column = first_column; column <= last_column; ++column) {
+      Tile *tile = &board->tiles[positive_mod(row, rows) * columns + positive_mod(column, columns)];
+      if (tile->x != column * TILE_SIZE || tile->y != row * TILE_SIZE) {
+        tile->x = column * TILE_SIZE;
+        tile->y = row * TILE_SIZE;
+        tile->valid = (SDL_Rect){0};
+      }
+
+      SDL_Rect bounds = {.x = tile->x, .y = tile->y, .w = TILE_SIZE, .h = TILE_SIZE};
+      SDL_Rect needed, damaged;
+      SDL_IntersectRect(&bounds, &viewport, &needed);
+      if (!rect_contains(&tile->valid, &needed)) {
+        tile_upload(tile, frame, board->frame_x, board->frame_y, &needed);
+      } else if (SDL_IntersectRect(&needed, &board->frame_dirty_area, &damaged)) {
+        tile_upload(tile, frame, board->frame_x, board->frame_y, &damaged);
       }
+      tile->valid = needed;
     }
-    data = new_data;
   }
-  SDL_UpdateTexture(board->sdl_texture, update_area, data, board->sdl_surface->pitch);
+  return true;
+}
+
+void board_render(Board *board) {
+  SDL_LockMutex(board->frame_lock);
+  bool uploaded = board->frame_dirty && board_upload_tiles(board);
+  SDL_UnlockMutex(board->frame_lock);
+
+  if (!uploaded && !board->present_pending) {
+    return;
+  }
+  board->present_pending = false;
+
+  // while a resize is being debounced the output no longer matches the frame,
+  // stretch the last frame over the whole window until a new one arrives.
+  int output_width, output_height;
+  SDL_GetRendererOutputSize(board->renderer, &output_width, &output_height);
+  SDL_Rect *viewport = &board->viewport;
+  double scale_x = viewport->w > 0 ? (double)output_width / viewport->w : 1;
+  double scale_y = viewport->h > 0 ? (double)output_height / viewport->h : 1;
 
   SDL_RenderClear(board->renderer);
-  SDL_RenderCopy(board->renderer, board->sdl_texture, NULL, NULL);
-  SDL_RenderPresent(board->renderer);
+  for (int i = 0; i < board->tile_columns * board->tile_rows; ++i) {
+    Tile *tile = &board->tiles[i];
+    if (SDL_RectEmpty(&tile->valid)) {
+      continue;
+    }
 
-  if (update_area != NULL) {
-    free(data);
+    SDL_Rect src = {
+        .x = tile->valid.x - tile->x,
+        .y = tile->valid.y - tile->y,
+        .w = tile->valid.w,
+        .h = tile->valid.h,
+    };
+    // round the edges rather than the sizes, so stretched tiles stay seamless.
+    int x1 = lround((tile->valid.x - viewport->x) * scale_x);
+    int y1 = lround((tile->valid.y - viewport->y) * scale_y);
+    int x2 = lround((tile->valid.x + tile->valid.w - viewport->x) * scale_x);
+    int y2 = lround((tile->valid.y + tile->valid.h - viewport->y) * scale_y);
+    SDL_Rect dst = {.x = x1, .y = y1, .w = x2 - x1, .h = y2 - y1};
+    SDL_RenderCopy(board->renderer, tile->texture, &src, &dst);
   }
+  // the renderer is created with vsync, so this blocks until the next vblank
+  // and paces the main loop to one frame per refresh.
+  SDL_RenderPresent(board->renderer);
 }
 
 void board_setup_draw(Board *board) {
   Uint8 r, g, b, a;
-  SDL_GetRGBA(board->stroke_color, board->sdl_surface->format, &r, &g, &b, &a);
+  SDL_GetRGBA(board->current_stroke_color, board->sdl_surface->format, &r, &g, &b, &a);
   cairo_set_source_rgba(board->cr, r / 255.0, g / 255.0, b / 255.0, a / 255.0);
-  cairo_set_line_width(board->cr, board->stroke_width);
+  cairo_set_line_width(board->cr, board->current_stroke_width);
   cairo_set_line_cap(board->cr, CAIRO_LINE_CAP_ROUND);
   cairo_set_line_join(board->cr, CAIRO_LINE_JOIN_ROUND);
 }
 
-void board_draw_strokes(Board *board) {
-  board_setup_draw(board);
-  pdll_iter(board->strokes, node) {
-    cairo_new_path(board->cr);
+static void board_draw_path(Board *board, cairo_t *cr, Path *path) {
+  Uint8 r, g, b, a;
+  SDL_GetRGBA(path->color, board->sdl_surface->format, &r, &g, &b, &a);
+  cairo_set_source_rgba(cr, r / 255.0, g / 255.0, b / 255.0, a / 255.0);
+  // blit small strokes from their sprite, otherwise fill the cached
+  // outline, inside the pending transform if there is one.
+  if (!sprite_cache_draw(board->sprites, path, cr)) {
+    path_fill(path, board->outlines, cr);
+  }
+}
+
+// draw the strokes of layer with cr, which is the layer's own context
+// or one rendering ahead of a pan.
+void board_draw_strokes(Board *board, Layer *layer, cairo_t *cr) {
+  // strokes outside the clip can't change a pixel, a redraw of a small
+  // area only pays for the strokes inside it.
+  Point clip_top_left, clip_bottom_right;
+  cairo_clip_extents(cr, &clip_top_left.x, &clip_top_left.y, &clip_bottom_right.x, &clip_bottom_right.y);
+
+  pdll_iter(layer->strokes, node) {
     Path *path = node->data;
-    Uint8 r, g, b, a;
-    SDL_GetRGBA(path->color, board->sdl_surface->format, &r, &g, &b, &a);
-    cairo_set_source_rgba(board->cr, r / 255.0, g / 255.0, b / 255.0, a / 255.0);
-    cairo_set_line_width(board->cr, path->width);
-    cairo_append_path(board->cr, path->path);
-    cairo_stroke(board->cr);
+    if (path->matrix == NULL && !path_intersects_rect(path, clip_top_left, clip_bottom_right)) {
+      continue;
+    }
+    board_draw_path(board, cr, path);
+  }
+}
+
+static void board_scroll_surface(cairo_surface_t *surface, int dx, int dy) {
+  // shift the surface pixels in place by (dx, dy) device pixels.
+  // rows are walked away from the direction of the shift so
+  // no source row is overwritten before it is copied.
+  cairo_surface_flush(surface);
+  unsigned char *data = cairo_image_surface_get_data(surface);
+  int stride = cairo_image_surface_get_stride(surface);
+  int width = cairo_image_surface_get_width(surface);
+  int height = cairo_image_surface_get_height(surface);
+  int row_bytes = (width - abs(dx)) * 4;
+
+  for (int i = 0; i < height - abs(dy); ++i) {
+    int y = dy > 0 ? height - 1 - i : i;
+    unsigned char *dst = data + y * stride + (dx > 0 ? dx : 0) * 4;
+    unsigned char *src = data + (y - dy) * stride + (dx < 0 ? -dx : 0) * 4;
+    memmove(dst, src, row_bytes);
+  }
+
+  cairo_surface_mark_dirty(surface);
+}
+
+// like board_scroll_surface(), but the pixels uncovered are cleared and
+// the shift may be larger than the surface.
+static void board_shift_surface(cairo_surface_t *surface, int dx, int dy) {
+  int width = cairo_image_surface_get_width(surface);
+  int height = cairo_image_surface_get_height(surface);
+  if (abs(dx) >= width || abs(dy) >= height) {
+    surface_fill(surface, 0);
+    return;
+  }
+
+  board_scroll_surface(surface, dx, dy);
+  unsigned char *data = cairo_image_surface_get_data(surface);
+  int stride = cairo_image_surface_get_stride(surface);
+  simd.fill_rect(data + (dx > 0 ? 0 : width + dx) * 4, stride, 0, abs(dx), height);
+  simd.fill_rect(data + (size_t)(dy > 0 ? 0 : height + dy) * stride, stride, 0, width, abs(dy));
+  cairo_surface_mark_dirty(surface);
+}
+
+// draw into the back buffer, within area (window coordinates), the strokes
+// the refresh has already drawn there. a pan uncovers strips it never drew.
+static void board_refresh_catch_up(Board *board, SDL_Rect *area) {
+  Refresh *refresh = &board->refresh;
+  Layer *layer = &board->layers[refresh->layer];
+  cairo_t *cr = refresh->back.cr;
+  cairo_save(cr);
+  cairo_rectangle(cr, area->x - board->dx, area->y - board->dy, area->w, area->h);
+  cairo_clip(cr);
+  cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
+  cairo_paint(cr);
+  cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+
+  // an edited layer is started over by the next step anyway.
+  bool started = refresh->drawn || refresh->node != NULL;
+  if (layer->visible && started && layer->strokes->changes == refresh->changes) {
+    Point clip_top_left, clip_bottom_right;
+    cairo_clip_extents(cr, &clip_top_left.x, &clip_top_left.y, &clip_bottom_right.x, &clip_bottom_right.y);
+    pdll_version *version = &layer->strokes->versions[layer->strokes->latest_version];
+    for (pdll_node *node = version->head; node != NULL && node != refresh->node;
+         node = node == version->tail ? NULL : node->next) {
+      Path *path = node->data;
+      if (path->matrix == NULL && !path_intersects_rect(path, clip_top_left, clip_bottom_right)) {
+        continue;
+      }
+      board_draw_path(board, cr, path);
+    }
   }
+  cairo_restore(cr);
 }
 
 void board_translate(Board *board, double dx, double dy) {
@@ -247,23 +1081,132 @@ void board_translate(Board *board, double dx, double dy) {
   board->dx += dx;
   board->dy += dy;
   cairo_translate(board->cr, dx, dy);
-  board_refresh(board);
+  for (int i = 0; i < board->layers_count; ++i) {
+    cairo_translate(board->layers[i].cr, dx, dy);
+  }
+  cairo_translate(board->refresh.back.cr, dx, dy);
+
+  // pending damage moves along with the content.
+  if (board->dirty) {
+    board->dirty_area.x += dx;
+    board->dirty_area.y += dy;
+  }
+
+  // reuse what is already drawn if the shift is a whole amount of pixels,
+  // and redraw only the strips that were exposed.
+  // the strips are not reported as damage: they were off screen before,
+  // so no tile holds them yet and they are uploaded anyway.
+  double scale_x, scale_y;
+  cairo_surface_get_device_scale(board->cr_surface, &scale_x, &scale_y);
+  int pixel_dx = dx * scale_x;
+  int pixel_dy = dy * scale_y;
+  if (pixel_dx != dx * scale_x || pixel_dy != dy * scale_y || fabs(dx) >= board->width ||
+      fabs(dy) >= board->height) {
+    // a jump, not a pan. nothing to predict. the layers show what they
+    // held, moved by the nearest whole amount of pixels, until redrawn.
+    for (int i = 0; i < board->layers_count; ++i) {
+      if (board->layers[i].visible) {
+        board_shift_surface(board->layers[i].surface, lround(dx * scale_x), lround(dy * scale_y));
+      }
+    }
+    board_refresh(board);
+    return;
+  }
+  board->pan_dx = (board->pan_dx + dx) / 2;
+  board->pan_dy = (board->pan_dy + dy) / 2;
+
+  // hidden layers are left alone, they are redrawn once shown again.
+  // strips the pan was predicted to expose are copied from the prefetched band.
+  SDL_Rect strips[2] = {
+      {.x = dx > 0 ? 0 : board->width + dx, .y = 0, .w = fabs(dx), .h = board->height},
+      {.x = 0, .y = dy > 0 ? 0 : board->height + dy, .w = board->width, .h = fabs(dy)},
+  };
+  bool prefetched[2] = {board_prefetch_covers(board, &strips[0]), board_prefetch_covers(board, &strips[1])};
+  board_scroll_surface(board->cr_surface, pixel_dx, pixel_dy);
+  for (int i = 0; i < board->layers_count; ++i) {
+    Layer *layer = &board->layers[i];
+    if (!layer->visible) {
+      layer->stale = true;
+      continue;
+    }
+    board_scroll_surface(layer->surface, pixel_dx, pixel_dy);
+    for (int j = 0; j < 2; ++j) {
+      if (SDL_RectEmpty(&strips[j])) {
+        continue;
+      }
+      if (prefetched[j]) {
+        board_prefetch_copy(board, i, &strips[j]);
+      } else {
+        layer_redraw_clipped(board, layer, &strips[j]);
+      }
+    }
+  }
+  // a refresh in progress goes on where it was, its back buffer moves along.
+  if (board->refresh.active) {
+    board_scroll_surface(board->refresh.back.surface, pixel_dx, pixel_dy);
+    for (int j = 0; j < 2; ++j) {
+      if (!SDL_RectEmpty(&strips[j])) {
+        board_refresh_catch_up(board, &strips[j]);
+      }
+    }
+  }
+  for (int j = 0; j < 2; ++j) {
+    if (!SDL_RectEmpty(&strips[j])) {
+      board_composite_clipped(board, &strips[j]);
+    }
+  }
 }
 
 void board_reset_translation(Board *board) {
   board_translate(board, -board->dx, -board->dy);
 }
 
+// start drawing the layer the refresh is at, from its first stroke.
+static void board_refresh_start_layer(Board *board) {
+  Refresh *refresh = &board->refresh;
+  refresh->node = NULL;
+  refresh->drawn = false;
+  if (refresh->layer >= 0) {
+    refresh->changes = board->layers[refresh->layer].strokes->changes;
+    surface_fill(refresh->back.surface, 0);
+  }
+}
+
+// the back buffer holds the whole layer, it becomes the layer's surface
+// and the old one is the back buffer of the next layer.
+static void board_refresh_swap(Board *board) {
+  Refresh *refresh = &board->refresh;
+  Layer *layer = &board->layers[refresh->layer];
+  Layer front = *layer;
+  layer->surface = refresh->back.surface;
+  layer->cr = refresh->back.cr;
+  layer->pixels = refresh->back.pixels;
+  layer->capacity = refresh->back.capacity;
+  layer->stale = false;
+  refresh->back.surface = front.surface;
+  refresh->back.cr = front.cr;
+  refresh->back.pixels = front.pixels;
+  refresh->back.capacity = front.capacity;
+}
+
+// redraw every visible layer from scratch. the strokes are drawn a slice at
+// a time by board_refresh_step() so a dense board doesn't hold up input, and
+// the layers keep showing what they held until they are redrawn in full.
 void board_refresh(Board *board) {
-  board_clear(board);
-  board_draw_strokes(board);
-  board_render(board, NULL);
+  board_prefetch_invalidate(board);
+  for (int i = 0; i < board->layers_count; ++i) {
+    board->layers[i].stale = true;
+  }
+  board->refresh.active = true;
+  board->refresh.layer = board->layers_count - 1;
+  board_refresh_start_layer(board);
+  board_composite_clipped(board, NULL);
+  board_invalidate(board, NULL);
 }
 
-void board_update_mouse_state(Board *board) {
-  SDL_GetMouseState(&board->mouse_x_raw, &board->mouse_y_raw);
-  board->mouse_x = board->mouse_x_raw - board->dx;
-  board->mouse_y = board->mouse_y_raw - board->dy;
+void board_update_mouse_state(Board *board, int x, int y) {
+  board->mouse_x = x - board->dx;
+  board->mouse_y = y - board->dy;
 }
 
 void board_update_cursor(Board *board) {
@@ -310,8 +1253,8 @@ void board_update_cursor(Board *board) {
 
   // render to sdl surface
   unsigned char *data = cairo_image_surface_get_data(cr_surface);
-  Uint32 *cursor_surface_pixels = cursor_surface->pixels;
-  memcpy(cursor_surface_pixels, data, w * h * 4);
+  simd.copy_rect(cursor_surface->pixels, cursor_surface->pitch, data, cairo_image_surface_get_stride(cr_surface), w * 4,
+                 h);
 
   SDL_Cursor *new_cursor = SDL_CreateColorCursor(cursor_surface, w / 2, h / 2);
   if (new_cursor != NULL) {
@@ -334,34 +1277,33 @@ void board_reset_current_stroke(Board *board) {
 void board_set_stroke_width(Board *board, double width) {
   board->stroke_width = width;
   board_update_cursor(board);
-  board_refresh(board);
 }
 
 void board_set_stroke_color(Board *board, unsigned int color) {
   board->stroke_color = color;
   board_update_cursor(board);
-  board_refresh(board);
 }
 
-ScratchPad *scratchpad_new(cairo_path_t *query) {
+ScratchPad *scratchpad_new(cairo_path_t *query, bool fill) {
   // synopsis:
-  // use cairo's builtin algorithms to check if two paths are intersecting.
+  // use cairo's builtin algorithms to find the paths intersecting a query path.
   // this is done in two steps
-  // 1. create a scratch pad with the eraser path.
-  // 2. using that scratch pad to check if a path intersects with the eraser.
+  // 1. create a scratch pad with the query (eraser) path.
+  // 2. using that scratch pad to pick every path that intersects the query at once.
   //
   // motivation:
   // create 2 surfaces (and cairo contexts):
-  // one will be the "query" - stores the eraser path
-  // the other one will be the "scratch" - we copy the query surface with
-  // a mask - if both paths intersect we actually draw the eraser pixel on that surface
-  // meaning that if as a result we get a non-zero pixel - both paths intersect.
+  // one will be the "query" - a mask of the eraser path
+  // the other one will be the "ids" - every candidate path is drawn into it
+  // with its own index as the color, so every pixel tells which path covers it.
+  // a single scan of the pixels under the mask then yields all the hits,
+  // instead of painting and scanning the whole pad once per candidate.
   //
   // since those surfaces are WAY smaller than the infinite board,
   // we scale everything down by the bounding box of the eraser path
   // and translate it to be in the center of the screen.
   // this function - "scratchpad_new()" just sets both surfaces and related
-  // information that is needed later for the intersection check
+  // information that is needed later for picking.
 
   // create a temp surface just to compute the needed transformation and translation.
   cairo_surface_t *tmp_surface = cairo_image_surface_create(CAIRO_FORMAT_A8, 1, 1);
@@ -393,8 +1335,8 @@ ScratchPad *scratchpad_new(cairo_path_t *query) {
   if (query_surface == NULL)
     return NULL;
 
-  cairo_surface_t *scratch_surface = cairo_image_surface_create(CAIRO_FORMAT_A8, SCRATCH_PAD_WIDTH, SCRATCH_PAD_HEIGHT);
-  if (scratch_surface == NULL) {
+  cairo_surface_t *ids_surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, SCRATCH_PAD_WIDTH, SCRATCH_PAD_HEIGHT);
+  if (ids_surface == NULL) {
     cairo_surface_destroy(query_surface);
     return NULL;
   }
@@ -402,39 +1344,53 @@ ScratchPad *scratchpad_new(cairo_path_t *query) {
   cairo_t *query_cr = cairo_create(query_surface);
   if (query_cr == NULL) {
     cairo_surface_destroy(query_surface);
-    cairo_surface_destroy(scratch_surface);
+    cairo_surface_destroy(ids_surface);
     return NULL;
   }
 
-  cairo_t *scratch_cr = cairo_create(scratch_surface);
-  if (scratch_cr == NULL) {
+  cairo_t *ids_cr = cairo_create(ids_surface);
+  if (ids_cr == NULL) {
     cairo_surface_destroy(query_surface);
-    cairo_surface_destroy(scratch_surface);
+    cairo_surface_destroy(ids_surface);
     cairo_destroy(query_cr);
     return NULL;
   }
 
-  // render eraser path into query_surface and populate the scratchpad
+  // render eraser path (or the area enclosed by a selection)
+  // into query_surface and populate the scratchpad
   cairo_set_line_width(query_cr, STROKE_WIDTH_THICKEST);
   cairo_set_line_cap(query_cr, CAIRO_LINE_CAP_ROUND);
   cairo_set_line_join(query_cr, CAIRO_LINE_JOIN_ROUND);
   cairo_scale(query_cr, scale_x, scale_y);
   cairo_translate(query_cr, -origin_x, -origin_y);
   cairo_append_path(query_cr, query);
-  cairo_stroke(query_cr);
+  if (fill) {
+    cairo_fill(query_cr);
+  } else {
+    cairo_stroke(query_cr);
+  }
+  cairo_surface_flush(query_surface);
+
+  // ids must be written as is, antialiasing would blend them into other ids.
+  cairo_set_antialias(ids_cr, CAIRO_ANTIALIAS_NONE);
+  cairo_set_operator(ids_cr, CAIRO_OPERATOR_SOURCE);
+  cairo_set_line_cap(ids_cr, CAIRO_LINE_CAP_ROUND);
+  cairo_set_line_join(ids_cr, CAIRO_LINE_JOIN_ROUND);
+  cairo_scale(ids_cr, scale_x, scale_y);
+  cairo_translate(ids_cr, -origin_x, -origin_y);
 
   ScratchPad *pad = malloc(sizeof(ScratchPad));
   if (pad == NULL) {
     cairo_surface_destroy(query_surface);
-    cairo_surface_destroy(scratch_surface);
+    cairo_surface_destroy(ids_surface);
     cairo_destroy(query_cr);
-    cairo_destroy(scratch_cr);
+    cairo_destroy(ids_cr);
     return NULL;
   }
 
-  pad->scratch_cr = scratch_cr;
+  pad->ids_cr = ids_cr;
   pad->query_cr = query_cr;
-  pad->scratch_surface = scratch_surface;
+  pad->ids_surface = ids_surface;
   pad->query_surface = query_surface;
   pad->scale_x = scale_x;
   pad->scale_y = scale_y;
@@ -445,78 +1401,1427 @@ ScratchPad *scratchpad_new(cairo_path_t *query) {
 
 void scratchpad_destroy(ScratchPad *pad) {
   cairo_surface_destroy(pad->query_surface);
-  cairo_surface_destroy(pad->scratch_surface);
-  cairo_destroy(pad->scratch_cr);
+  cairo_surface_destroy(pad->ids_surface);
+  cairo_destroy(pad->ids_cr);
   cairo_destroy(pad->query_cr);
   free(pad);
 }
 
-bool scratchpad_test_intersection(ScratchPad *pad, cairo_path_t *path, double stroke_width) {
-  // this is the second part of the intersection checking.
-  // copy the rendered eraser path from the query_surface.
-  cairo_set_operator(pad->scratch_cr, CAIRO_OPERATOR_SOURCE);
-  cairo_set_source_surface(pad->scratch_cr, pad->query_surface, 0, 0);
-  cairo_paint(pad->scratch_cr);
-
-  // draw the path on top using OPERATOR_IN:
-  // only pixels where both the eraser and the path are painted survive.
-  cairo_save(pad->scratch_cr);
-  cairo_set_line_width(pad->scratch_cr, stroke_width);
-  cairo_set_line_cap(pad->scratch_cr, CAIRO_LINE_CAP_ROUND);
-  cairo_set_line_join(pad->scratch_cr, CAIRO_LINE_JOIN_ROUND);
-  cairo_scale(pad->scratch_cr, pad->scale_x, pad->scale_y);
-  cairo_translate(pad->scratch_cr, -pad->origin_x, -pad->origin_y);
-  cairo_append_path(pad->scratch_cr, path);
-  cairo_set_operator(pad->scratch_cr, CAIRO_OPERATOR_IN);
-  cairo_stroke(pad->scratch_cr);
-  cairo_restore(pad->scratch_cr);
-
-  cairo_surface_flush(pad->scratch_surface);
-  const uint8_t *data = cairo_image_surface_get_data(pad->scratch_surface);
-
-  // check if any pixel is non-zero
-  // it is written that way since this will most likely
-  // get auto vectorized, depending on the WIDTH and HEIGHT.
-  uint8_t acc = 0;
-  for (int i = 0; i < SCRATCH_PAD_HEIGHT * SCRATCH_PAD_WIDTH; ++i) {
-    acc |= data[i];
-  }
-
-  return acc != 0;
+// draw a candidate into the ids surface in the color of its index.
+static void scratchpad_draw(ScratchPad *pad, Path *candidate, int index, double min_width) {
+  unsigned int id = index + 1;
+  cairo_set_source_rgb(pad->ids_cr, ((id >> 16) & 0xFF) / 255.0, ((id >> 8) & 0xFF) / 255.0, (id & 0xFF) / 255.0);
+  cairo_set_line_width(pad->ids_cr, fmax(candidate->width, min_width));
+  path_append(candidate, pad->ids_cr);
+  cairo_stroke(pad->ids_cr);
 }
 
-int board_delete_intersecting_paths(Board *board, cairo_path_t *path) {
-  int did_paths_got_deleted = 0;
-  ScratchPad *pad = scratchpad_new(path);
-  if (pad == NULL) {
-    return false;
+// mark the candidates whose ids show under the query mask, returns how
+// many weren't marked before.
+static int scratchpad_collect(ScratchPad *pad, bool *hits) {
+  cairo_surface_flush(pad->ids_surface);
+  const uint8_t *mask = cairo_image_surface_get_data(pad->query_surface);
+  int mask_stride = cairo_image_surface_get_stride(pad->query_surface);
+  const uint8_t *ids = cairo_image_surface_get_data(pad->ids_surface);
+  int ids_stride = cairo_image_surface_get_stride(pad->ids_surface);
+
+  int found = 0;
+  for (int y = 0; y < SCRATCH_PAD_HEIGHT; ++y) {
+    const uint8_t *mask_row = mask + y * mask_stride;
+    const uint32_t *ids_row = (const uint32_t *)(ids + y * ids_stride);
+    // most of the mask is empty, skip it a block at a time
+    for (int block = 0; block < SCRATCH_PAD_WIDTH; block += SCRATCH_PAD_BLOCK) {
+      int end = block + SCRATCH_PAD_BLOCK < SCRATCH_PAD_WIDTH ? block + SCRATCH_PAD_BLOCK : SCRATCH_PAD_WIDTH;
+      if (!simd.any_nonzero(mask_row + block, end - block)) {
+        continue;
+      }
+      for (int x = block; x < end; ++x) {
+        uint32_t id = ids_row[x] & 0xFFFFFF;
+        if (mask_row[x] != 0 && id != 0 && !hits[id - 1]) {
+          hits[id - 1] = true;
+          ++found;
+        }
+      }
+    }
   }
+  return found;
+}
 
-  pdll_iter(board->strokes, node) {
-    Path *path = node->data;
-    if (scratchpad_test_intersection(pad, path->path, path->width)) {
-      did_paths_got_deleted = 1;
-      pdll_node_mark_for_deletion(node);
+// the pixels of the pad within the bounds of a candidate, with room for
+// the minimum width it is drawn at. empty if it is off the pad.
+static SDL_Rect scratchpad_bounds(ScratchPad *pad, Path *candidate) {
+  int x1 = fmax(floor((candidate->top_left.x - pad->origin_x) * pad->scale_x) - 2, 0);
+  int y1 = fmax(floor((candidate->top_left.y - pad->origin_y) * pad->scale_y) - 2, 0);
+  int x2 = fmin(ceil((candidate->bottom_right.x - pad->origin_x) * pad->scale_x) + 2, SCRATCH_PAD_WIDTH);
+  int y2 = fmin(ceil((candidate->bottom_right.y - pad->origin_y) * pad->scale_y) + 2, SCRATCH_PAD_HEIGHT);
+  return (SDL_Rect){x1, y1, x2 > x1 ? x2 - x1 : 0, y2 > y1 ? y2 - y1 : 0};
+}
+
+// whether the query mask has pixels set within the bounds of a candidate.
+static bool scratchpad_mask_under(ScratchPad *pad, Path *candidate) {
+  SDL_Rect bounds = scratchpad_bounds(pad, candidate);
+  const uint8_t *mask = cairo_image_surface_get_data(pad->query_surface);
+  int mask_stride = cairo_image_surface_get_stride(pad->query_surface);
+  for (int y = bounds.y; y < bounds.y + bounds.h && bounds.w > 0; ++y) {
+    if (simd.any_nonzero(mask + y * mask_stride + bounds.x, bounds.w)) {
+      return true;
     }
   }
+  return false;
+}
 
-  if (did_paths_got_deleted) {
-    pdll_delete_marked_nodes(board->strokes);
+// draw a candidate alone within its bounds and check it against the mask.
+static bool scratchpad_hit_alone(ScratchPad *pad, Path *candidate, double min_width) {
+  SDL_Rect bounds = scratchpad_bounds(pad, candidate);
+  if (bounds.w == 0 || bounds.h == 0) {
+    return false;
   }
-
-  scratchpad_destroy(pad);
-  board_refresh(board);
-  return did_paths_got_deleted;
+  uint8_t *ids = cairo_image_surface_get_data(pad->ids_surface);
+  int ids_stride = cairo_image_surface_get_stride(pad->ids_surface);
+  cairo_surface_flush(pad->ids_surface);
+  simd.fill_rect(ids + bounds.y * ids_stride + bounds.x * 4, ids_stride, 0, bounds.w, bounds.h);
+  cairo_surface_mark_dirty(pad->ids_surface);
+  scratchpad_draw(pad, candidate, 0, min_width);
+  cairo_surface_flush(pad->ids_surface);
+
+  const uint8_t *mask = cairo_image_surface_get_data(pad->query_surface);
+  int mask_stride = cairo_image_surface_get_stride(pad->query_surface);
+  for (int y = bounds.y; y < bounds.y + bounds.h; ++y) {
+    const uint8_t *mask_row = mask + y * mask_stride;
+    const uint32_t *ids_row = (const uint32_t *)(ids + y * ids_stride);
+    for (int x = bounds.x; x < bounds.x + bounds.w; ++x) {
+      if (mask_row[x] != 0 && (ids_row[x] & 0xFFFFFF) != 0) {
+        return true;
+      }
+    }
+  }
+  return false;
 }
 
-int board_save_image(Board *board, char *path) {
-  // calculate bounding area of image
-  Point top_left, bottom_right;
-  cairo_path_t *prev_path = cairo_copy_path(board->cr);
-
-  pdll_iter(board->strokes, node) {
-    cairo_path_t *path = ((Path *)node->data)->path;
-    cairo_append_path(board->cr, path);
+int scratchpad_pick(ScratchPad *pad, Path **candidates, int count, bool *hits) {
+  // this is the second part of the intersection checking.
+  // draw every candidate into the ids surface, then collect the ids found
+  // under the query mask.
+  //
+  // a candidate may be completely covered by candidates drawn after it,
+  // which are hits then. a second pass draws the ones left that have mask
+  // pixels within their bounds, in reverse order. the few still covered
+  // from both sides are drawn alone, one at a time.
+  //
+  // without antialiasing a path thinner than a pixel can fall between pixel
+  // centers and disappear. draw candidates at least a couple of pixels wide.
+  double min_width = 2 / fmin(pad->scale_x, pad->scale_y);
+
+  surface_fill(pad->ids_surface, 0);
+  for (int i = 0; i < count; ++i) {
+    if (!hits[i]) {
+      scratchpad_draw(pad, candidates[i], i, min_width);
+    }
+  }
+  int found = scratchpad_collect(pad, hits);
+  if (found == 0 || found == count) {
+    return found;
+  }
+
+  bool drawn = false;
+  surface_fill(pad->ids_surface, 0);
+  for (int i = count - 1; i >= 0; --i) {
+    if (!hits[i] && scratchpad_mask_under(pad, candidates[i])) {
+      scratchpad_draw(pad, candidates[i], i, min_width);
+      drawn = true;
+    }
+  }
+  if (!drawn) {
+    return found;
+  }
+  found += scratchpad_collect(pad, hits);
+
+  for (int i = 0; i < count; ++i) {
+    if (!hits[i] && scratchpad_mask_under(pad, candidates[i]) && scratchpad_hit_alone(pad, candidates[i], min_width)) {
+      hits[i] = true;
+      ++found;
+    }
+  }
+  return found;
+}
+
+// window area covered by a box in board coordinates,
+// rounded outwards and padded for antialiasing.
+static SDL_Rect board_window_area(Board *board, Point top_left, Point bottom_right) {
+  int x1 = floor(top_left.x + board->dx) - 1;
+  int y1 = floor(top_left.y + board->dy) - 1;
+  int x2 = ceil(bottom_right.x + board->dx) + 1;
+  int y2 = ceil(bottom_right.y + board->dy) + 1;
+  SDL_Rect area = {.x = x1, .y = y1, .w = x2 - x1, .h = y2 - y1};
+  return area;
+}
+
+// continue the refresh for about budget_ms and composite the layers it
+// finished. returns true while there is more to draw.
+bool board_refresh_step(Board *board, double budget_ms) {
+  Refresh *refresh = &board->refresh;
+  if (!refresh->active) {
+    return false;
+  }
+
+  Uint64 start = SDL_GetPerformanceCounter();
+  double ticks_per_ms = SDL_GetPerformanceFrequency() / 1000.0;
+  bool out_of_time = false;
+  bool swapped = false;
+  int drawn = 0;
+  while (refresh->layer >= 0 && !out_of_time) {
+    Layer *layer = &board->layers[refresh->layer];
+    // the strokes it was walking may be gone, and the edit is already
+    // drawn over the layer's surface, not in back.
+    if (layer->strokes->changes != refresh->changes) {
+      board_refresh_start_layer(board);
+    }
+    pdll_version *version = &layer->strokes->versions[layer->strokes->latest_version];
+    pdll_node *node = refresh->node != NULL ? refresh->node : version->head;
+    if (!layer->visible || refresh->drawn) {
+      node = NULL;
+    }
+
+    // only what is on screen, the rest of the board is drawn as it scrolls in.
+    cairo_t *cr = refresh->back.cr;
+    Point clip_top_left, clip_bottom_right;
+    cairo_clip_extents(cr, &clip_top_left.x, &clip_top_left.y, &clip_bottom_right.x, &clip_bottom_right.y);
+    while (node != NULL) {
+      Path *path = node->data;
+      node = node == version->tail ? NULL : node->next;
+      if (path->matrix == NULL && !path_intersects_rect(path, clip_top_left, clip_bottom_right)) {
+        continue;
+      }
+
+      board_draw_path(board, cr, path);
+      if (++drawn % REFRESH_CHECK_INTERVAL == 0 && (SDL_GetPerformanceCounter() - start) / ticks_per_ms >= budget_ms) {
+        out_of_time = true;
+        break;
+      }
+    }
+
+    refresh->node = node;
+    if (node != NULL) {
+      break;
+    }
+    if (!layer->visible) {
+      layer->stale = true;
+    } else if (board->gesture == GESTURE_DRAW) {
+      // the preview of the stroke lives on the canvas, compositing now would wipe it.
+      refresh->drawn = true;
+      break;
+    } else {
+      board_refresh_swap(board);
+      swapped = true;
+    }
+    refresh->layer--;
+    board_refresh_start_layer(board);
+  }
+  refresh->active = refresh->layer >= 0;
+
+  if (swapped) {
+    board_composite_clipped(board, NULL);
+    board_invalidate(board, NULL);
+  }
+  return refresh->active && !refresh->drawn;
+}
+
+// find the strokes touched by query, stroked with the eraser width or filled.
+// returns the amount of candidates stored in nodes, hits tells which of them
+// were touched. returns -1 on failure. the caller frees nodes and hits.
+static int board_pick_paths(Board *board, cairo_path_t *query, bool fill, pdll_node ***nodes_out, bool **hits_out) {
+  // only strokes whose bounding box touches the query can intersect it,
+  // everything else is never drawn into the scratch pad.
+  Point top_left, bottom_right;
+  path_extents(query, &top_left, &bottom_right);
+  if (!fill) {
+    top_left.x -= STROKE_WIDTH_THICKEST / 2;
+    top_left.y -= STROKE_WIDTH_THICKEST / 2;
+    bottom_right.x += STROKE_WIDTH_THICKEST / 2;
+    bottom_right.y += STROKE_WIDTH_THICKEST / 2;
+  }
+
+  int count = 0;
+  int capacity = 0;
+  pdll_node **nodes = NULL;
+  Path **candidates = NULL;
+  bool *hits = NULL;
+  ScratchPad *pad = NULL;
+
+  pdll_iter(board->strokes, node) {
+    Path *stroke = node->data;
+    if (!path_intersects_rect(stroke, top_left, bottom_right)) {
+      continue;
+    }
+
+    if (count == capacity) {
+      capacity = capacity == 0 ? 64 : capacity * 2;
+      pdll_node **new_nodes = realloc(nodes, sizeof(*nodes) * capacity);
+      if (new_nodes == NULL) {
+        goto defer;
+      }
+      nodes = new_nodes;
+      Path **new_candidates = realloc(candidates, sizeof(*candidates) * capacity);
+      if (new_candidates == NULL) {
+        goto defer;
+      }
+      candidates = new_candidates;
+    }
+
+    nodes[count] = node;
+    candidates[count] = stroke;
+    ++count;
+  }
+
+  hits = calloc(count + 1, sizeof(*hits));
+  if (hits == NULL) {
+    goto defer;
+  }
+
+  if (count > 0) {
+    pad = scratchpad_new(query, fill);
+    if (pad == NULL) {
+      goto defer;
+    }
+
+    for (int start = 0; start < count; start += SCRATCH_PAD_MAX_IDS) {
+      int chunk = count - start < SCRATCH_PAD_MAX_IDS ? count - start : SCRATCH_PAD_MAX_IDS;
+      scratchpad_pick(pad, candidates + start, chunk, hits + start);
+    }
+    scratchpad_destroy(pad);
+  }
+
+  free(candidates);
+  *nodes_out = nodes;
+  *hits_out = hits;
+  return count;
+
+defer:
+  free(nodes);
+  free(candidates);
+  free(hits);
+  return -1;
+}
+
+int board_delete_intersecting_paths(Board *board, cairo_path_t *path) {
+  pdll_node **nodes;
+  bool *hits;
+  int count = board_pick_paths(board, path, false, &nodes, &hits);
+  if (count < 0) {
+    return false;
+  }
+
+  int did_paths_got_deleted = 0;
+  SDL_Rect damage = {0};
+  for (int i = 0; i < count; ++i) {
+    if (hits[i]) {
+      Path *stroke = nodes[i]->data;
+      did_paths_got_deleted = 1;
+      pdll_node_mark_for_deletion(nodes[i]);
+      SDL_Rect area = board_window_area(board, stroke->top_left, stroke->bottom_right);
+      SDL_UnionRect(&damage, &area, &damage);
+    }
+  }
+  free(nodes);
+  free(hits);
+
+  if (did_paths_got_deleted) {
+    // everything erased by one gesture goes into a single version,
+    // so a single undo brings all of it back.
+    if (board->erase_version != board->strokes->latest_version || !pdll_amend_marked_nodes(board->strokes)) {
+      pdll_delete_marked_nodes(board->strokes);
+      board->erase_version = board->strokes->latest_version;
+    }
+
+    board_redraw_area(board, &damage);
+  }
+
+  return did_paths_got_deleted;
+}
+
+// window area covered by a set of strokes
+typedef struct PathDamage {
+  Board *board;
+  SDL_Rect area;
+} PathDamage;
+
+static void path_damage_add(void *data, void *context) {
+  Path *path = data;
+  PathDamage *damage = context;
+  SDL_Rect area = board_window_area(damage->board, path->top_left, path->bottom_right);
+  SDL_UnionRect(&damage->area, &area, &damage->area);
+}
+
+// undo the latest version and redraw only where strokes appeared or
+// disappeared.
+bool board_undo(Board *board) {
+  if (!sync_can_undo(board->sync, board->active_layer, board->strokes->latest_version)) {
+    return false;
+  }
+  PathDamage damage = {.board = board, .area = {0}};
+  pdll_diff_latest(board->strokes, path_damage_add, &damage);
+  if (!pdll_undo(board->strokes)) {
+    return false;
+  }
+
+  SDL_Rect window = {.x = 0, .y = 0, .w = board->width, .h = board->height};
+  SDL_Rect area;
+  if (SDL_IntersectRect(&damage.area, &window, &area)) {
+    board_redraw_area(board, &area);
+  }
+  return true;
+}
+
+// commit a new stroke to the active layer. it is paged in and out along
+// with the other strokes of its chunk.
+void board_add_path(Board *board, Path *path) {
+  if (!pdll_append(board->strokes, path)) {
+    path_free(path);
+    return;
+  }
+  chunk_store_add(board->chunks, path);
+  board_redraw_path(board, path);
+}
+
+// keep the strokes around the screen in memory and the rest on disk.
+void board_page_chunks(Board *board) {
+  chunk_store_poll(board->chunks);
+  Point top_left = {-board->dx, -board->dy};
+  Point bottom_right = {board->width - board->dx, board->height - board->dy};
+  chunk_store_update(board->chunks, top_left, bottom_right);
+}
+
+// draw a finished stroke on top of the active layer, then bring the
+// layers above it back over the area it covers.
+void board_redraw_path(Board *board, Path *path) {
+  Layer *layer = &board->layers[board->active_layer];
+  board_prefetch_invalidate(board);
+  board_draw_path(board, layer->cr, path);
+
+  SDL_Rect window = {.x = 0, .y = 0, .w = board->width, .h = board->height};
+  SDL_Rect damage = board_window_area(board, path->top_left, path->bottom_right);
+  SDL_Rect area;
+  if (SDL_IntersectRect(&damage, &window, &area)) {
+    board_composite_clipped(board, &area);
+    board_invalidate(board, &area);
+  }
+}
+
+// every change to the strokes of a layer is sent to the instances sharing
+// the board, see sync.h.
+static void board_observe_strokes(pdll *list, pdll_event event, void *data, void *context) {
+  static const SyncOp ops[] = {
+      [PDLL_APPEND] = SYNC_APPEND, [PDLL_DELETE] = SYNC_DELETE, [PDLL_AMEND] = SYNC_AMEND,
+      [PDLL_REPLACE] = SYNC_REPLACE, [PDLL_UNDO] = SYNC_UNDO,   [PDLL_BEGIN] = SYNC_BEGIN,
+      [PDLL_COMMIT] = SYNC_COMMIT, [PDLL_ROLLBACK] = SYNC_ROLLBACK,
+  };
+  Board *board = context;
+  if (!sync_recording(board->sync)) {
+    return;
+  }
+  for (int i = 0; i < board->layers_count; ++i) {
+    if (board->layers[i].strokes == list) {
+      sync_record(board->sync, ops[event], i, list, data);
+      return;
+    }
+  }
+}
+
+// add an empty layer on top and make it the active one.
+bool board_add_layer(Board *board) {
+  pdll *strokes = pdll_init((pdll_free_node_data_func)path_free);
+  if (strokes == NULL) {
+    return false;
+  }
+  Layer *layers = realloc(board->layers, sizeof(Layer) * (board->layers_count + 1));
+  if (layers == NULL) {
+    pdll_free(strokes);
+    return false;
+  }
+  board->layers = layers;
+
+  Layer *layer = &layers[board->layers_count];
+  *layer = (Layer){.strokes = strokes, .surface = NULL, .cr = NULL, .visible = true, .stale = true};
+  if (!layer_resize(layer, board->cr_surface, board->dx, board->dy)) {
+    pdll_free(strokes);
+    return false;
+  }
+  // nothing to draw yet, a cleared surface is up to date.
+  layer->stale = false;
+  board->layers_count++;
+  if (board->sync != NULL) {
+    pdll_observe(strokes, board_observe_strokes, board);
+    sync_record(board->sync, SYNC_LAYER, board->layers_count - 1, NULL, NULL);
+  }
+  board_prefetch_invalidate(board);
+  board_select_layer(board, board->layers_count - 1);
+  return true;
+}
+
+// editing happens on the active layer only, a pending selection
+// belongs to the previous one and is committed first.
+void board_select_layer(Board *board, int index) {
+  if (index < 0 || index >= board->layers_count || index == board->active_layer) {
+    return;
+  }
+  board_commit_selection(board);
+  board->active_layer = index;
+  board->strokes = board->layers[index].strokes;
+  board->erase_version = 0;
+}
+
+// hidden layers are neither drawn nor composited. they get stale while
+// hidden and are redrawn in full when shown again.
+void board_toggle_layer(Board *board, int index) {
+  if (index < 0 || index >= board->layers_count) {
+    return;
+  }
+  Layer *layer = &board->layers[index];
+  layer->visible = !layer->visible;
+  board_prefetch_invalidate(board);
+  // a layer the refresh hasn't reached yet is drawn by it.
+  bool pending = board->refresh.active && index <= board->refresh.layer;
+  if (layer->visible && layer->stale && !pending) {
+    layer_redraw_clipped(board, layer, NULL);
+  }
+  board_composite_clipped(board, NULL);
+  board_invalidate(board, NULL);
+}
+
+// bounds of the selection with its pending transform applied,
+// false when nothing is selected.
+bool board_selection_extents(Board *board, Point *top_left, Point *bottom_right) {
+  Selection *selection = &board->selection;
+  if (selection->count == 0) {
+    return false;
+  }
+
+  Point corners[4] = {
+      {selection->top_left.x, selection->top_left.y},
+      {selection->bottom_right.x, selection->top_left.y},
+      {selection->top_left.x, selection->bottom_right.y},
+      {selection->bottom_right.x, selection->bottom_right.y},
+  };
+
+  top_left->x = INFINITY;
+  top_left->y = INFINITY;
+  bottom_right->x = -INFINITY;
+  bottom_right->y = -INFINITY;
+  for (int i = 0; i < 4; ++i) {
+    cairo_matrix_transform_point(&selection->matrix, &corners[i].x, &corners[i].y);
+    top_left->x = fmin(top_left->x, corners[i].x);
+    top_left->y = fmin(top_left->y, corners[i].y);
+    bottom_right->x = fmax(bottom_right->x, corners[i].x);
+    bottom_right->y = fmax(bottom_right->y, corners[i].y);
+  }
+
+  // leave some room between the strokes and the outline.
+  top_left->x -= SELECTION_PADDING;
+  top_left->y -= SELECTION_PADDING;
+  bottom_right->x += SELECTION_PADDING;
+  bottom_right->y += SELECTION_PADDING;
+  return true;
+}
+
+// window area covered by the selected strokes and their outline.
+static SDL_Rect board_selection_area(Board *board) {
+  Point top_left, bottom_right;
+  board_selection_extents(board, &top_left, &bottom_right);
+  return board_window_area(board, top_left, bottom_right);
+}
+
+void board_draw_selection(Board *board) {
+  Selection *selection = &board->selection;
+  bool selecting = board->gesture == GESTURE_SELECT_RECT || board->gesture == GESTURE_SELECT_LASSO;
+  if (selection->count == 0 && !selecting) {
+    return;
+  }
+
+  cairo_save(board->cr);
+  cairo_new_path(board->cr);
+  cairo_set_source_rgba(board->cr, BOARD_BG_INVERTED_CAIRO);
+  cairo_set_line_width(board->cr, 1);
+  double dash = 4;
+  cairo_set_dash(board->cr, &dash, 1, 0);
+
+  if (selection->count > 0) {
+    Point top_left, bottom_right;
+    board_selection_extents(board, &top_left, &bottom_right);
+    cairo_rectangle(board->cr, top_left.x, top_left.y, bottom_right.x - top_left.x, bottom_right.y - top_left.y);
+  }
+
+  // the rubber band of a selection being dragged.
+  List *points = board->current_stroke_points;
+  if (selecting && points->length > 0) {
+    Point *first = points->head->data;
+    Point *last = points->tail->data;
+    if (board->gesture == GESTURE_SELECT_RECT) {
+      cairo_rectangle(board->cr, first->x, first->y, last->x - first->x, last->y - first->y);
+    } else {
+      ListNode *node, *next_node;
+      list_foreach(points, node, next_node) {
+        Point *point = node->data;
+        cairo_line_to(board->cr, point->x, point->y);
+      }
+      cairo_close_path(board->cr);
+    }
+  }
+
+  cairo_stroke(board->cr);
+  cairo_restore(board->cr);
+}
+
+void board_update_selection_band(Board *board) {
+  // redraw where the band was and where it is now.
+  Point top_left = {INFINITY, INFINITY};
+  Point bottom_right = {-INFINITY, -INFINITY};
+  ListNode *node, *next_node;
+  list_foreach(board->current_stroke_points, node, next_node) {
+    Point *point = node->data;
+    top_left.x = fmin(top_left.x, point->x);
+    top_left.y = fmin(top_left.y, point->y);
+    bottom_right.x = fmax(bottom_right.x, point->x);
+    bottom_right.y = fmax(bottom_right.y, point->y);
+  }
+
+  SDL_Rect damage = board->selection.band_area;
+  SDL_Rect band_area = {0};
+  if (board->current_stroke_points->length > 0) {
+    band_area = board_window_area(board, top_left, bottom_right);
+  }
+  SDL_UnionRect(&damage, &band_area, &damage);
+  board->selection.band_area = band_area;
+  if (!SDL_RectEmpty(&damage)) {
+    board_redraw_area(board, &damage);
+  }
+}
+
+// grow an array of paths by one, false if out of memory.
+static bool paths_push(Path ***paths, int *count, int *capacity, Path *path) {
+  if (*count == *capacity) {
+    int new_capacity = *capacity == 0 ? 64 : *capacity * 2;
+    Path **tmp = realloc(*paths, sizeof(*tmp) * new_capacity);
+    if (tmp == NULL) {
+      return false;
+    }
+    *paths = tmp;
+    *capacity = new_capacity;
+  }
+  (*paths)[(*count)++] = path;
+  return true;
+}
+
+static bool selection_add(Selection *selection, Path *path) {
+  if (!paths_push(&selection->paths, &selection->count, &selection->capacity, path)) {
+    return false;
+  }
+  path->matrix = &selection->matrix;
+  selection->top_left.x = fmin(selection->top_left.x, path->top_left.x);
+  selection->top_left.y = fmin(selection->top_left.y, path->top_left.y);
+  selection->bottom_right.x = fmax(selection->bottom_right.x, path->bottom_right.x);
+  selection->bottom_right.y = fmax(selection->bottom_right.y, path->bottom_right.y);
+  return true;
+}
+
+void board_select(Board *board, cairo_path_t *area) {
+  board_commit_selection(board);
+
+  pdll_node **nodes;
+  bool *hits;
+  int count = board_pick_paths(board, area, true, &nodes, &hits);
+  if (count < 0) {
+    return;
+  }
+
+  Selection *selection = &board->selection;
+  cairo_matrix_init_identity(&selection->matrix);
+  selection->top_left = (Point){INFINITY, INFINITY};
+  selection->bottom_right = (Point){-INFINITY, -INFINITY};
+  for (int i = 0; i < count; ++i) {
+    if (hits[i] && !selection_add(selection, nodes[i]->data)) {
+      break;
+    }
+  }
+  free(nodes);
+  free(hits);
+
+  if (selection->count > 0) {
+    SDL_Rect damage = board_selection_area(board);
+    board_redraw_area(board, &damage);
+  }
+}
+
+bool board_selection_contains(Board *board, double x, double y) {
+  Point top_left, bottom_right;
+  if (!board_selection_extents(board, &top_left, &bottom_right)) {
+    return false;
+  }
+  return x >= top_left.x && x <= bottom_right.x && y >= top_left.y && y <= bottom_right.y;
+}
+
+void board_transform_selection(Board *board, cairo_matrix_t *transform) {
+  Selection *selection = &board->selection;
+  if (selection->count == 0) {
+    return;
+  }
+
+  // every selected stroke shares this matrix, nothing else has to change.
+  SDL_Rect damage = board_selection_area(board);
+  cairo_matrix_multiply(&selection->matrix, &selection->matrix, transform);
+  SDL_Rect area = board_selection_area(board);
+  SDL_UnionRect(&damage, &area, &damage);
+  board_redraw_area(board, &damage);
+}
+
+static bool is_identity(cairo_matrix_t *matrix) {
+  return matrix->xx == 1 && matrix->yx == 0 && matrix->xy == 0 && matrix->yy == 1 && matrix->x0 == 0 &&
+         matrix->y0 == 0;
+}
+
+// page the strokes a replace put on the board along with their
+// neighbours. the ones it took out are paged already.
+static void board_page_baked(void *data, void *context) {
+  Path *path = data;
+  if (path->chunk == NULL) {
+    chunk_store_add(context, path);
+  }
+}
+
+void board_commit_selection(Board *board) {
+  Selection *selection = &board->selection;
+  if (selection->count == 0) {
+    return;
+  }
+
+  // bake the transform into new geometry for every selected stroke,
+  // all of them in a single version so one undo reverts the whole move.
+  SDL_Rect damage = board_selection_area(board);
+  if (!is_identity(&selection->matrix)) {
+    pdll_iter(board->strokes, node) {
+      Path *path = node->data;
+      if (path->matrix == &selection->matrix) {
+        pdll_node_mark_for_deletion(node);
+      }
+    }
+    if (pdll_replace_marked_nodes(board->strokes, (pdll_replace_node_data_func)path_bake)) {
+      pdll_diff_latest(board->strokes, board_page_baked, board->chunks);
+    }
+  }
+
+  for (int i = 0; i < selection->count; ++i) {
+    selection->paths[i]->matrix = NULL;
+  }
+  selection->count = 0;
+  board_redraw_area(board, &damage);
+}
+
+void board_cancel_selection(Board *board) {
+  Selection *selection = &board->selection;
+  if (selection->count == 0) {
+    return;
+  }
+
+  // drop the pending transform, the strokes go back where they were.
+  SDL_Rect damage = board_selection_area(board);
+  cairo_matrix_init_identity(&selection->matrix);
+  SDL_Rect area = board_selection_area(board);
+  SDL_UnionRect(&damage, &area, &damage);
+
+  for (int i = 0; i < selection->count; ++i) {
+    selection->paths[i]->matrix = NULL;
+  }
+  selection->count = 0;
+  board_redraw_area(board, &damage);
+}
+
+// a copy of a selected stroke where it is shown, the pending transform
+// applied. a move only shifts the copy, anything else needs new geometry.
+static Path *board_copy_selected(Board *board, Path *path) {
+  cairo_matrix_t *matrix = &board->selection.matrix;
+  if (matrix->xx == 1 && matrix->yx == 0 && matrix->xy == 0 && matrix->yy == 1) {
+    return path_copy(path, matrix->x0, matrix->y0, path->color, path->width);
+  }
+
+  return path_bake(path);
+}
+
+// copy the selected strokes into clipboard, which is cleared first.
+static void board_copy_selection_into(Board *board, Clipboard *clipboard) {
+  clipboard_clear(clipboard);
+  clipboard->top_left = (Point){INFINITY, INFINITY};
+  clipboard->bottom_right = (Point){-INFINITY, -INFINITY};
+  Selection *selection = &board->selection;
+  for (int i = 0; i < selection->count; ++i) {
+    Path *copy = board_copy_selected(board, selection->paths[i]);
+    if (copy == NULL) {
+      continue;
+    }
+    if (!paths_push(&clipboard->paths, &clipboard->count, &clipboard->capacity, copy)) {
+      path_free(copy);
+      break;
+    }
+    clipboard->top_left.x = fmin(clipboard->top_left.x, copy->top_left.x);
+    clipboard->top_left.y = fmin(clipboard->top_left.y, copy->top_left.y);
+    clipboard->bottom_right.x = fmax(clipboard->bottom_right.x, copy->bottom_right.x);
+    clipboard->bottom_right.y = fmax(clipboard->bottom_right.y, copy->bottom_right.y);
+  }
+}
+
+// add copies of paths moved by (dx, dy) to the active layer, all of them
+// in a single version so one undo removes them, and select them so they
+// can be dragged into place right away.
+static void board_place_copies(Board *board, Clipboard *clipboard, double dx, double dy) {
+  board_commit_selection(board);
+  if (clipboard->count == 0) {
+    return;
+  }
+
+  Selection *selection = &board->selection;
+  cairo_matrix_init_identity(&selection->matrix);
+  selection->top_left = (Point){INFINITY, INFINITY};
+  selection->bottom_right = (Point){-INFINITY, -INFINITY};
+  pdll_begin(board->strokes);
+  for (int i = 0; i < clipboard->count; ++i) {
+    Path *path = clipboard->paths[i];
+    Path *copy = path_copy(path, dx, dy, path->color, path->width);
+    if (copy == NULL) {
+      continue;
+    }
+    if (!pdll_append(board->strokes, copy)) {
+      path_free(copy);
+      continue;
+    }
+    chunk_store_add(board->chunks, copy);
+    selection_add(selection, copy);
+  }
+  // a failed commit frees the copies.
+  if (!pdll_commit(board->strokes)) {
+    selection->count = 0;
+    return;
+  }
+
+  if (selection->count > 0) {
+    SDL_Rect damage = board_selection_area(board);
+    board_redraw_area(board, &damage);
+  }
+}
+
+// the copies share the geometry of the selected strokes, only the
+// transform pending on the selection is baked into new geometry.
+void board_copy_selection(Board *board) {
+  if (board->selection.count == 0) {
+    return;
+  }
+  board_copy_selection_into(board, &board->clipboard);
+}
+
+// paste the clipboard centered on (x, y), in board coordinates. the copies
+// land a whole number of pixels away, so they can share sprites.
+void board_paste(Board *board, double x, double y) {
+  Clipboard *clipboard = &board->clipboard;
+  double dx = round(x - (clipboard->top_left.x + clipboard->bottom_right.x) / 2);
+  double dy = round(y - (clipboard->top_left.y + clipboard->bottom_right.y) / 2);
+  board_place_copies(board, clipboard, dx, dy);
+}
+
+// copy the selection next to itself, leaving the clipboard alone.
+void board_duplicate_selection(Board *board) {
+  if (board->selection.count == 0) {
+    return;
+  }
+
+  Clipboard copies = {0};
+  board_copy_selection_into(board, &copies);
+  board_place_copies(board, &copies, DUPLICATE_OFFSET, DUPLICATE_OFFSET);
+  clipboard_clear(&copies);
+  free(copies.paths);
+}
+
+// read the strokes of a feed in the background, see import.h. they are
+// added by board_finish_imports() once they're built.
+void board_import(Board *board, const char *filename) {
+  Import *import = import_start(filename, board->commands_available);
+  if (import == NULL) {
+    return;
+  }
+
+  Import **last = &board->imports;
+  while (*last != NULL) {
+    last = &(*last)->next;
+  }
+  *last = import;
+}
+
+// add the strokes of the finished imports to the active layer, in the order
+// they were started. every feed is a single undo step.
+void board_finish_imports(Board *board) {
+  while (board->imports != NULL && import_done(board->imports)) {
+    Import *import = board->imports;
+    board->imports = import->next;
+
+    pdll_begin(board->strokes);
+    int added = 0;
+    for (int i = 0; i < import->count; ++i) {
+      Path *path = import->paths[i];
+      if (!pdll_append(board->strokes, path)) {
+        path_free(path);
+        continue;
+      }
+      chunk_store_add(board->chunks, path);
+      ++added;
+    }
+    // the paths belong to the layer now, a failed commit frees them.
+    import->count = 0;
+    if (!pdll_commit(board->strokes)) {
+      fprintf(stderr, "import: out of memory adding the strokes of %s\n", import->filename);
+      added = 0;
+    }
+    if (import->skipped > 0) {
+      fprintf(stderr, "import: skipped %d strokes of %s that couldn't be read\n", import->skipped, import->filename);
+    }
+
+    import_free(import);
+    if (added > 0) {
+      board_refresh(board);
+    }
+  }
+}
+
+// delete the strokes of the active layer touching the box, in a version of
+// their own. returns how many there were, -1 on failure.
+static int board_erase_box(Board *board, Point top_left, Point bottom_right, PathDamage *damage) {
+  cairo_new_path(board->cr);
+  cairo_rectangle(board->cr, top_left.x, top_left.y, bottom_right.x - top_left.x, bottom_right.y - top_left.y);
+  cairo_path_t *box = cairo_copy_path(board->cr);
+  cairo_new_path(board->cr);
+
+  pdll_node **nodes;
+  bool *hits;
+  int count = board_pick_paths(board, box, true, &nodes, &hits);
+  cairo_path_destroy(box);
+  if (count < 0) {
+    return -1;
+  }
+
+  int erased = 0;
+  for (int i = 0; i < count; ++i) {
+    if (hits[i]) {
+      pdll_node_mark_for_deletion(nodes[i]);
+      path_damage_add(nodes[i]->data, damage);
+      ++erased;
+    }
+  }
+  free(nodes);
+  free(hits);
+  if (erased > 0 && !pdll_delete_marked_nodes(board->strokes)) {
+    return -1;
+  }
+  return erased;
+}
+
+static void board_control_stats(Board *board, ControlBatch *batch, double pan_x, double pan_y) {
+  size_t strokes = 0;
+  for (int i = 0; i < board->layers_count; ++i) {
+    pdll_iter(board->layers[i].strokes, node) {
+      ++strokes;
+    }
+  }
+  int imports = 0;
+  for (Import *import = board->imports; import != NULL; import = import->next) {
+    ++imports;
+  }
+  control_reply(batch,
+                "ok {\"strokes\": %zu, \"layers\": %d, \"active_layer\": %d, \"version\": %zu, \"selected\": %d, "
+                "\"imports\": %d, \"dx\": %g, \"dy\": %g, \"width\": %d, \"height\": %d}",
+                strokes, board->layers_count, board->active_layer, board->strokes->latest_version,
+                board->selection.count, imports, board->dx + pan_x, board->dy + pan_y, board->width, board->height);
+}
+
+// apply the commands of a script in order and redraw once, after all of them.
+static void board_control(Board *board, ControlBatch *batch) {
+  // the commands edit the strokes as they are, settle a moved selection.
+  for (int i = 0; i < batch->count && board->selection.count > 0; ++i) {
+    ControlOpType type = batch->ops[i].type;
+    if (type == CONTROL_STROKE || type == CONTROL_ERASE || type == CONTROL_UNDO) {
+      board_commit_selection(board);
+    }
+  }
+
+  PathDamage damage = {.board = board, .area = {0}};
+  double pan_x = 0;
+  double pan_y = 0;
+  for (int i = 0; i < batch->count; ++i) {
+    ControlOp *op = &batch->ops[i];
+    switch (op->type) {
+    case CONTROL_STROKE:
+      if (!pdll_append(board->strokes, op->path)) {
+        control_reply(batch, "error out of memory");
+        break;
+      }
+      chunk_store_add(board->chunks, op->path);
+      path_damage_add(op->path, &damage);
+      op->path = NULL;
+      control_reply(batch, "ok");
+      break;
+    case CONTROL_ERASE:
+      if (board_erase_box(board, op->erase.top_left, op->erase.bottom_right, &damage) < 0) {
+        control_reply(batch, "error out of memory");
+      } else {
+        control_reply(batch, "ok");
+      }
+      break;
+    case CONTROL_UNDO:
+      if (!sync_can_undo(board->sync, board->active_layer, board->strokes->latest_version)) {
+        control_reply(batch, "error nothing to undo");
+        break;
+      }
+      pdll_diff_latest(board->strokes, path_damage_add, &damage);
+      if (pdll_undo(board->strokes)) {
+        control_reply(batch, "ok");
+      } else {
+        control_reply(batch, "error nothing to undo");
+      }
+      break;
+    case CONTROL_PAN:
+      pan_x += op->pan.dx;
+      pan_y += op->pan.dy;
+      control_reply(batch, "ok");
+      break;
+    case CONTROL_SAVE: {
+      cairo_status_t status = board_save_image(board, op->filename);
+      if (status != CAIRO_STATUS_SUCCESS) {
+        control_reply(batch, "error %s", cairo_status_to_string(status));
+      } else {
+        control_reply(batch, "ok");
+      }
+      break;
+    }
+    case CONTROL_STATS:
+      board_control_stats(board, batch, pan_x, pan_y);
+      break;
+    case CONTROL_ERROR:
+      control_reply(batch, "error %s", op->error);
+      break;
+    }
+  }
+  control_done(batch);
+
+  // the damage was taken before the pan, it moves along with the strokes.
+  board_translate(board, pan_x, pan_y);
+  if (SDL_RectEmpty(&damage.area)) {
+    return;
+  }
+  damage.area.x += floor(pan_x) - 1;
+  damage.area.y += floor(pan_y) - 1;
+  damage.area.w += 2;
+  damage.area.h += 2;
+  SDL_Rect window = {.x = 0, .y = 0, .w = board->width, .h = board->height};
+  SDL_Rect area;
+  if (SDL_IntersectRect(&damage.area, &window, &area)) {
+    board_redraw_area(board, &area);
+  }
+}
+
+// apply the batches scripts sent over the control socket, see control.h.
+void board_run_controls(Board *board) {
+  if (board->control == NULL) {
+    return;
+  }
+
+  ControlBatch *batch;
+  while ((batch = control_take(board->control)) != NULL) {
+    board_control(board, batch);
+  }
+}
+
+// share the board with the other instances on socket_path, see sync.h.
+void board_share(Board *board, const char *socket_path) {
+  board->sync = sync_start(socket_path, board->commands_available);
+  if (board->sync == NULL) {
+    return;
+  }
+  for (int i = 0; i < board->layers_count; ++i) {
+    pdll_observe(board->layers[i].strokes, board_observe_strokes, board);
+  }
+}
+
+// what the frames applied in one go changed, per layer.
+typedef struct SyncDamage {
+  PathDamage *layers;
+  int count;
+  bool changed;
+  bool refresh; // everything did, the board is drawn over
+} SyncDamage;
+
+static PathDamage *sync_damage_layer(Board *board, SyncDamage *damage, int layer) {
+  if (layer >= damage->count) {
+    PathDamage *layers = realloc(damage->layers, sizeof(PathDamage) * (layer + 1));
+    if (layers == NULL) {
+      return NULL;
+    }
+    for (int i = damage->count; i <= layer; ++i) {
+      layers[i] = (PathDamage){.board = board, .area = {0}};
+    }
+    damage->layers = layers;
+    damage->count = layer + 1;
+  }
+  damage->changed = true;
+  return &damage->layers[layer];
+}
+
+// mark the strokes with the ids in data. strokes another instance got rid
+// of at the same time are simply not there. with a matrix, the strokes get
+// it as their pending transform instead of adding to the damage.
+static bool board_sync_mark(pdll *list, const unsigned char *data, size_t length, cairo_matrix_t *matrix,
+                            PathDamage *damage) {
+  if (length % sizeof(uint64_t) != 0) {
+    return false;
+  }
+  size_t count;
+  uint64_t *ids = sync_read_ids(data, length, &count);
+  if (count > 0 && ids == NULL) {
+    return false;
+  }
+  pdll_iter(list, node) {
+    Path *path = node->data;
+    if (!sync_has_id(ids, count, path->id)) {
+      continue;
+    }
+    pdll_node_mark_for_deletion(node);
+    if (matrix != NULL) {
+      path->matrix = matrix;
+    } else {
+      path_damage_add(path, damage);
+    }
+  }
+  free(ids);
+  return true;
+}
+
+// the strokes a replace took out and put in, see board_sync_replace().
+static void sync_baked_damage_add(void *data, void *context) {
+  Path *path = data;
+  path->matrix = NULL;
+  path_damage_add(path, context);
+}
+
+static bool board_sync_replace(Board *board, pdll *list, SyncMessage *message, PathDamage *damage) {
+  double values[6];
+  if (message->length < sizeof(values)) {
+    return false;
+  }
+  memcpy(values, message->data, sizeof(values));
+  cairo_matrix_t *matrix = &board->sync->matrix;
+  cairo_matrix_init(matrix, values[0], values[1], values[2], values[3], values[4], values[5]);
+  if (!board_sync_mark(list, message->data + sizeof(values), message->length - sizeof(values), matrix, damage)) {
+    return false;
+  }
+  if (pdll_replace_marked_nodes(list, (pdll_replace_node_data_func)path_bake)) {
+    pdll_diff_latest(list, board_page_baked, board->chunks);
+    pdll_diff_latest(list, sync_baked_damage_add, damage);
+    return true;
+  }
+  pdll_iter(list, node) {
+    Path *path = node->data;
+    if (path->matrix == matrix) {
+      path->matrix = NULL;
+    }
+  }
+  return false;
+}
+
+// replay one change another instance made. false if it doesn't apply to
+// the board as it is here.
+static bool board_sync_message(Board *board, SyncMessage *message, SyncDamage *damage) {
+  if (message->op == SYNC_LAYER) {
+    int active = board->active_layer;
+    while (board->layers_count <= message->layer) {
+      if (!board_add_layer(board)) {
+        return false;
+      }
+    }
+    board_select_layer(board, active);
+    return true;
+  }
+  if (message->layer >= board->layers_count) {
+    return false;
+  }
+  pdll *list = board->layers[message->layer].strokes;
+  PathDamage *area = sync_damage_layer(board, damage, message->layer);
+  if (area == NULL) {
+    return false;
+  }
+
+  switch (message->op) {
+  case SYNC_APPEND: {
+    Path *path = path_unpack(message->data, message->length);
+    if (path == NULL) {
+      return false;
+    }
+    if (!pdll_append(list, path)) {
+      path_free(path);
+      return false;
+    }
+    chunk_store_add(board->chunks, path);
+    path_damage_add(path, area);
+    return true;
+  }
+  case SYNC_DELETE:
+    return board_sync_mark(list, message->data, message->length, NULL, area) && pdll_delete_marked_nodes(list);
+  case SYNC_AMEND:
+    // the version amended here may be shared, like it is after a snapshot.
+    return board_sync_mark(list, message->data, message->length, NULL, area) &&
+           (pdll_amend_marked_nodes(list) || pdll_delete_marked_nodes(list));
+  case SYNC_REPLACE:
+    return board_sync_replace(board, list, message, area);
+  case SYNC_UNDO:
+    if (!sync_can_undo(board->sync, message->layer, list->latest_version) ||
+        !sync_undo_matches(list, message->data, message->length)) {
+      return false;
+    }
+    pdll_diff_latest(list, path_damage_add, area);
+    return pdll_undo(list);
+  case SYNC_BEGIN:
+    return pdll_begin(list);
+  case SYNC_COMMIT:
+    return board_sync_mark(list, message->data, message->length, NULL, area) && pdll_commit(list);
+  case SYNC_ROLLBACK:
+    pdll_rollback(list);
+    return true;
+  case SYNC_LAYER:
+    break;
+  }
+  return false;
+}
+
+static bool board_sync_apply(Board *board, SyncFrame *frame, SyncDamage *damage) {
+  Sync *sync = board->sync;
+  const unsigned char *cursor = frame->data + SYNC_FRAME_HEADER;
+  const unsigned char *end = frame->data + frame->size;
+  SyncMessage message;
+  bool applied = true;
+  sync->applying = true;
+  while (applied && sync_next_message(&cursor, end, &message)) {
+    applied = board_sync_message(board, &message, damage);
+  }
+  applied = applied && cursor == end;
+  // a transaction left open would swallow the changes made here next.
+  for (int i = 0; i < board->layers_count; ++i) {
+    while (board->layers[i].strokes->transaction_depth > 0) {
+      pdll_rollback(board->layers[i].strokes);
+      applied = false;
+    }
+  }
+  sync->applying = false;
+  return applied;
+}
+
+// send a peer, or SYNC_EVERYONE, every stroke, each layer in a single
+// version. it can't undo what came before.
+static void board_sync_snapshot(Board *board, uint32_t peer) {
+  Sync *sync = board->sync;
+  sync_flush(sync);
+  for (int i = 0; i < board->layers_count; ++i) {
+    pdll *list = board->layers[i].strokes;
+    sync_record(sync, SYNC_LAYER, i, NULL, NULL);
+    sync_record(sync, SYNC_BEGIN, i, NULL, NULL);
+    pdll_iter(list, node) {
+      sync_record(sync, SYNC_APPEND, i, NULL, node->data);
+    }
+    sync_record(sync, SYNC_COMMIT, i, list, NULL);
+  }
+  sync_flush_frame(sync, SYNC_FRAME_SNAPSHOT, peer);
+}
+
+// whether a frame changes selected strokes: a snapshot replaces them, the
+// ops naming strokes may name them.
+static bool board_sync_touches_selection(Board *board, SyncFrame *frame) {
+  Selection *selection = &board->selection;
+  if (selection->count == 0) {
+    return false;
+  }
+  if (frame->kind != SYNC_FRAME_OPS) {
+    return frame->kind == SYNC_FRAME_SNAPSHOT;
+  }
+
+  const unsigned char *cursor = frame->data + SYNC_FRAME_HEADER;
+  const unsigned char *end = frame->data + frame->size;
+  SyncMessage message;
+  while (sync_next_message(&cursor, end, &message)) {
+    if (message.layer != board->active_layer ||
+        (message.op != SYNC_DELETE && message.op != SYNC_AMEND && message.op != SYNC_REPLACE &&
+         message.op != SYNC_UNDO && message.op != SYNC_COMMIT)) {
+      continue;
+    }
+    // a replace names the strokes after its matrix.
+    size_t skip = message.op == SYNC_REPLACE ? sizeof(double) * 6 : 0;
+    if (message.length < skip) {
+      continue;
+    }
+    size_t count;
+    uint64_t *ids = sync_read_ids(message.data + skip, message.length - skip, &count);
+    if (ids == NULL && count > 0) {
+      return true;
+    }
+    bool touched = false;
+    for (int i = 0; i < selection->count && !touched; ++i) {
+      touched = sync_has_id(ids, count, selection->paths[i]->id);
+    }
+    free(ids);
+    if (touched) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// start the layers over from the hub's snapshot. changes not sent yet
+// were made to the layers thrown away, they go with them.
+static void board_sync_join(Board *board, SyncFrame *frame, SyncDamage *damage) {
+  Sync *sync = board->sync;
+  sync->pending_size = 0;
+  damage->refresh = true;
+  for (int i = 0; i < board->layers_count; ++i) {
+    pdll *strokes = pdll_init((pdll_free_node_data_func)path_free);
+    if (strokes == NULL) {
+      sync_request_snapshot(sync);
+      return;
+    }
+    pdll_observe(strokes, board_observe_strokes, board);
+    pdll_free(board->layers[i].strokes);
+    board->layers[i].strokes = strokes;
+  }
+  board->strokes = board->layers[board->active_layer].strokes;
+  board->erase_version = 0;
+
+  if (!board_sync_apply(board, frame, damage)) {
+    sync_request_snapshot(sync);
+    return;
+  }
+  size_t *base_versions = realloc(sync->base_versions, sizeof(size_t) * board->layers_count);
+  if (base_versions == NULL) {
+    sync_request_snapshot(sync);
+    return;
+  }
+  for (int i = 0; i < board->layers_count; ++i) {
+    base_versions[i] = board->layers[i].strokes->latest_version;
+  }
+  sync->base_versions = base_versions;
+  sync->base_count = board->layers_count;
+  sync->joined = true;
+}
+
+// redraw the layers where the frames changed them, composite once.
+static void board_sync_redraw(Board *board, SyncDamage *damage) {
+  if (!damage->changed && !damage->refresh) {
+    return;
+  }
+  board_prefetch_invalidate(board);
+  if (damage->refresh) {
+    board_refresh(board);
+    return;
+  }
+
+  SDL_Rect window = {.x = 0, .y = 0, .w = board->width, .h = board->height};
+  SDL_Rect all = {0};
+  for (int i = 0; i < damage->count && i < board->layers_count; ++i) {
+    Layer *layer = &board->layers[i];
+    SDL_Rect area;
+    if (!SDL_IntersectRect(&damage->layers[i].area, &window, &area)) {
+      continue;
+    }
+    if (layer->visible) {
+      layer_redraw_clipped(board, layer, &area);
+    } else {
+      layer->stale = true;
+    }
+    SDL_UnionRect(&all, &area, &all);
+  }
+  if (!SDL_RectEmpty(&all)) {
+    board_composite_clipped(board, &all);
+    board_invalidate(board, &all);
+  }
+}
+
+// apply what the other instances sharing the board sent, see sync.h. the
+// hub passes the changes of each peer on to the others once applied.
+void board_sync(Board *board) {
+  Sync *sync = board->sync;
+  if (sync == NULL) {
+    return;
+  }
+  SyncFrame *frame = sync_take(sync);
+  if (frame == NULL) {
+    return;
+  }
+
+  SyncDamage damage = {0};
+  for (; frame != NULL; frame = sync_take(sync)) {
+    // the changes are to the strokes as they are, settle a moved selection
+    // they apply to.
+    if (board_sync_touches_selection(board, frame)) {
+      board_commit_selection(board);
+    }
+    switch (frame->kind) {
+    case SYNC_FRAME_HELLO:
+      if (frame->size == SYNC_FRAME_HEADER + sizeof(uint32_t)) {
+        memcpy(&sync->tag, frame->data + SYNC_FRAME_HEADER, sizeof(uint32_t));
+      }
+      break;
+    case SYNC_FRAME_RESYNC:
+      board_sync_snapshot(board, frame->peer);
+      break;
+    case SYNC_FRAME_SNAPSHOT:
+      board_sync_join(board, frame, &damage);
+      break;
+    case SYNC_FRAME_OPS:
+      // changes made before the snapshot a peer waits for are in it.
+      if (!sync->joined) {
+        break;
+      }
+      if (board_sync_apply(board, frame, &damage)) {
+        if (sync->hub) {
+          // the hub's own changes came first.
+          sync_flush(sync);
+          sync_relay(sync, frame);
+          frame = NULL;
+        }
+      } else if (sync->hub) {
+        // part of the frame may have been applied here, the others get
+        // the board as it is now instead of the frame.
+        board_sync_snapshot(board, SYNC_EVERYONE);
+      } else {
+        sync_request_snapshot(sync);
+      }
+      break;
+    }
+    if (frame != NULL) {
+      sync_frame_free(frame);
+    }
+  }
+  board_sync_redraw(board, &damage);
+  free(damage.layers);
+}
+
+cairo_status_t board_save_image(Board *board, char *path) {
+  // calculate bounding area of image
+  Point top_left, bottom_right;
+  cairo_path_t *prev_path = cairo_copy_path(board->cr);
+
+  // the image shows what is on screen, hidden layers are left out.
+  for (int i = 0; i < board->layers_count; ++i) {
+    if (!board->layers[i].visible) {
+      continue;
+    }
+    pdll_iter(board->layers[i].strokes, node) {
+      Path *path = node->data;
+      cairo_save(board->cr);
+      if (path->matrix != NULL) {
+        cairo_transform(board->cr, path->matrix);
+      }
+      path_append(path, board->cr);
+      cairo_restore(board->cr);
+    }
   }
 
   cairo_path_extents(board->cr, &top_left.x, &top_left.y, &bottom_right.x, &bottom_right.y);
@@ -536,18 +2841,117 @@ int board_save_image(Board *board, char *path) {
   cairo_set_line_join(cr, CAIRO_LINE_JOIN_ROUND);
   cairo_translate(cr, -top_left.x + 5, -top_left.y + 5);
 
-  pdll_iter(board->strokes, node) {
-    Path *path = node->data;
-    Uint8 r, g, b, a;
-    SDL_GetRGBA(path->color, board->sdl_surface->format, &r, &g, &b, &a);
-    cairo_set_source_rgba(cr, r / 255.0, g / 255.0, b / 255.0, a / 255.0);
-    cairo_set_line_width(cr, path->width);
-    cairo_append_path(cr, path->path);
-    cairo_stroke(cr);
+  for (int i = 0; i < board->layers_count; ++i) {
+    if (!board->layers[i].visible) {
+      continue;
+    }
+    pdll_iter(board->layers[i].strokes, node) {
+      Path *path = node->data;
+      Uint8 r, g, b, a;
+      SDL_GetRGBA(path->color, board->sdl_surface->format, &r, &g, &b, &a);
+      cairo_set_source_rgba(cr, r / 255.0, g / 255.0, b / 255.0, a / 255.0);
+      cairo_set_line_width(cr, path->width);
+      cairo_save(cr);
+      if (path->matrix != NULL) {
+        cairo_transform(cr, path->matrix);
+      }
+      path_append(path, cr);
+      cairo_stroke(cr);
+      cairo_restore(cr);
+    }
   }
 
-  cairo_surface_write_to_png(surface, path);
+  // a surface too big to create or a failed draw leaves cr in error.
+  cairo_status_t status = cairo_status(cr);
+  if (status == CAIRO_STATUS_SUCCESS) {
+    status = cairo_surface_write_to_png(surface, path);
+  }
   cairo_destroy(cr);
   cairo_surface_destroy(surface);
-  return 0;
+  return status;
+}
+
+// bytes of the tile textures. only call this from the input thread.
+size_t board_tiles_memory_usage(Board *board) {
+  return sizeof(Tile) * board->tiles_capacity + (size_t)board->tiles_capacity * TILE_SIZE * TILE_SIZE * 4;
+}
+
+// everything owned by the render thread, tiles are left at 0.
+void board_memory_usage(Board *board, BoardMemory *usage) {
+  usage->strokes = (pdll_memory){0};
+  usage->layers = sizeof(Layer) * board->layers_count;
+  for (int i = 0; i < board->layers_count; ++i) {
+    Layer *layer = &board->layers[i];
+    pdll_memory strokes;
+    pdll_memory_usage(layer->strokes, (pdll_node_data_size_func)path_memory_usage, &strokes);
+    usage->strokes.versions += strokes.versions;
+    usage->strokes.nodes += strokes.nodes;
+    usage->strokes.live_data += strokes.live_data;
+    usage->strokes.history_data += strokes.history_data;
+    usage->layers += layer->capacity;
+  }
+  usage->layers += board->refresh.back.capacity;
+
+  usage->current_stroke = 2 * sizeof(List);
+  ListNode *node, *next_node;
+  list_foreach(board->current_stroke_points, node, next_node) {
+    usage->current_stroke += sizeof(ListNode) + sizeof(Point);
+  }
+  list_foreach(board->current_stroke_paths, node, next_node) {
+    cairo_path_t *path = node->data;
+    usage->current_stroke += sizeof(ListNode) + sizeof(cairo_path_t) + sizeof(cairo_path_data_t) * path->num_data;
+  }
+
+  usage->selection = sizeof(Path *) * board->selection.capacity;
+  usage->clipboard = sizeof(Path *) * board->clipboard.capacity;
+  for (int i = 0; i < board->clipboard.count; ++i) {
+    usage->clipboard += path_memory_usage(board->clipboard.paths[i]);
+  }
+  usage->sprites = sizeof(SpriteCache) + board->sprites->size;
+  usage->outlines = sizeof(OutlineCache) + board->outlines->size;
+  usage->chunks = chunk_store_memory_usage(board->chunks);
+  usage->commands = sizeof(Ring) + board->commands->item_size * board->commands->capacity;
+  usage->canvas = board->canvas_capacity;
+  usage->prefetch = (sizeof(cairo_surface_t *) + sizeof(size_t)) * board->prefetch.count;
+  for (int i = 0; i < board->prefetch.count; ++i) {
+    cairo_surface_t *surface = board->prefetch.surfaces[i];
+    if (surface != NULL) {
+      usage->prefetch += (size_t)cairo_image_surface_get_stride(surface) * cairo_image_surface_get_height(surface);
+    }
+  }
+  usage->frame = board->frame_capacity;
+  usage->tiles = 0;
+}
+
+void board_print_memory(Board *board, BoardMemory *usage) {
+  size_t strokes = usage->strokes.versions + usage->strokes.nodes + usage->strokes.live_data +
+                   usage->strokes.history_data;
+  size_t total = strokes + usage->current_stroke + usage->selection + usage->clipboard + usage->sprites +
+                 usage->outlines + usage->chunks + usage->commands + usage->canvas + usage->layers + usage->prefetch +
+                 usage->frame + usage->tiles;
+  size_t version = board->strokes->latest_version;
+
+  printf("memory.strokes.live_data %zu\n", usage->strokes.live_data);
+  printf("memory.strokes.history_data %zu\n", usage->strokes.history_data);
+  printf("memory.strokes.nodes %zu\n", usage->strokes.nodes);
+  printf("memory.strokes.versions %zu\n", usage->strokes.versions);
+  printf("memory.strokes.version %zu\n", version);
+  printf("memory.strokes.latest_version_nodes %zu\n", pdll_version_nodes(board->strokes, version) * sizeof(pdll_node));
+  printf("memory.current_stroke %zu\n", usage->current_stroke);
+  printf("memory.selection %zu\n", usage->selection);
+  printf("memory.clipboard %zu\n", usage->clipboard);
+  printf("memory.sprites %zu\n", usage->sprites);
+  printf("memory.outlines %zu\n", usage->outlines);
+  printf("memory.chunks %zu\n", usage->chunks);
+  // on disk, not part of the total
+  printf("memory.chunks.stored %ld\n", board->chunks->file_end);
+  printf("memory.chunks.resident %d/%d\n", board->chunks->resident, board->chunks->count);
+  printf("memory.commands %zu\n", usage->commands);
+  printf("memory.canvas %zu\n", usage->canvas);
+  printf("memory.layers %zu\n", usage->layers);
+  printf("memory.prefetch %zu\n", usage->prefetch);
+  printf("memory.frame %zu\n", usage->frame);
+  printf("memory.tiles %zu\n", usage->tiles);
+  printf("memory.total %zu\n", total);
+  fflush(stdout);
 }
@@ -1,9 +1,17 @@
 #ifndef SB_BOARD_H
 #define SB_BOARD_H
 
+#include "chunk.h"
+#include "command.h"
 #include "config.h"
+#include "control.h"
+#include "import.h"
 #include "list.h"
+#include "path.h"
 #include "pdll.h"
+#include "ring.h"
+#include "sprite.h"
+#include "sync.h"
 
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_events.h>
@@ -11,6 +19,29 @@
 
 #define SCRATCH_PAD_WIDTH 128
 #define SCRATCH_PAD_HEIGHT 128
+// mask bytes tested at once by the stroke picking scan
+#define SCRATCH_PAD_BLOCK 32
+// ids are stored in the 24 color bits of a pixel
+#define SCRATCH_PAD_MAX_IDS 0xFFFFFF
+// must be a power of two
+#define COMMANDS_CAPACITY 4096
+// side of a screen tile texture, in pixels
+#define TILE_SIZE 256
+// room between the selected strokes and the selection outline
+#define SELECTION_PADDING 4
+// factor applied by a single scale key press
+#define SELECTION_SCALE_STEP 1.1
+// how far a duplicate lands from the original, in board units
+#define DUPLICATE_OFFSET 16
+// depth of the band rendered ahead of a pan, in window pixels:
+// the pan speed (pixels per translation) times PREFETCH_FRAMES, within bounds
+#define PREFETCH_FRAMES 16
+#define PREFETCH_MIN_DEPTH 64
+#define PREFETCH_MAX_DEPTH 512
+// time a frame may spend on a progressive refresh, in milliseconds
+#define REFRESH_BUDGET_MS 8
+// strokes drawn between two looks at the clock
+#define REFRESH_CHECK_INTERVAL 32
 
 typedef enum BoardState {
   STATE_IDLE,
@@ -18,27 +49,149 @@ typedef enum BoardState {
   STATE_MOVING,
 } BoardState;
 
+// what the current left button drag does, as seen by the render thread.
+typedef enum Gesture {
+  GESTURE_NONE,
+  GESTURE_DRAW,
+  GESTURE_ERASE,
+  GESTURE_SELECT_RECT,
+  GESTURE_SELECT_LASSO,
+  GESTURE_MOVE_SELECTION,
+} Gesture;
+
+typedef struct Selection {
+  // selected strokes. their matrix points at the matrix below,
+  // so transforming the whole selection only updates a single matrix.
+  Path **paths;
+  int count;
+  int capacity;
+  cairo_matrix_t matrix;
+  // bounds of the selected strokes, before the transform
+  Point top_left;
+  Point bottom_right;
+  // window area of the rubber band drawn while selecting
+  SDL_Rect band_area;
+} Selection;
+
+// strokes copied by board_copy_selection(). they share the geometry of the
+// originals, belong to no layer and are never paged out.
+typedef struct Clipboard {
+  Path **paths;
+  int count;
+  int capacity;
+  // bounds of the copied strokes
+  Point top_left;
+  Point bottom_right;
+} Clipboard;
+
 typedef struct ScratchPad {
-  cairo_t *scratch_cr;
+  cairo_t *ids_cr;
   cairo_t *query_cr;
-  cairo_surface_t *scratch_surface;
-  cairo_surface_t *query_surface;
+  cairo_surface_t *ids_surface;   // every pixel holds the index + 1 of the topmost candidate
+  cairo_surface_t *query_surface; // mask of the query path
   double scale_x;
   double scale_y;
   double origin_x;
   double origin_y;
 } ScratchPad;
 
+// the band of the board a pan is heading to, rendered while the render
+// thread is idle. translations copy the strips they expose from it.
+typedef struct Prefetch {
+  cairo_surface_t **surfaces; // one per layer, NULL for hidden layers
+  size_t *changes;            // of each layer's strokes when it was rendered
+  int count;
+  SDL_Rect area; // window coordinates at the translation below
+  double dx;
+  double dy;
+  bool valid;
+} Prefetch;
+
+// a texture holding one TILE_SIZE square of the board.
+// tiles are anchored to the board (not to the window),
+// so panning only moves them around instead of re-uploading them.
+typedef struct Tile {
+  SDL_Texture *texture;
+  // board pixel coordinates of the top left corner, a multiple of TILE_SIZE
+  int x;
+  int y;
+  // part of the tile (in board pixels) that holds up to date content
+  SDL_Rect valid;
+} Tile;
+
+// bytes held by a board, see board_memory_usage()
+typedef struct BoardMemory {
+  pdll_memory strokes;   // committed strokes: Path geometry and history
+  size_t current_stroke; // points and segments of the stroke being drawn
+  size_t selection;
+  size_t clipboard;
+  size_t sprites;  // small strokes rendered ahead
+  size_t outlines; // stroked outlines of the strokes drawn last
+  size_t chunks;   // spatial index of the strokes paged to disk
+  size_t commands; // command ring
+  size_t canvas;   // cairo surface
+  size_t layers;   // layer surfaces and the refresh back buffer
+  size_t prefetch; // strokes rendered ahead of a pan
+  size_t frame;    // published SDL surface
+  size_t tiles;    // screen textures
+} BoardMemory;
+
+// strokes rasterized into their own transparent surface, the canvas is
+// the composite of the visible layers. only the active layer is edited,
+// the others are left alone until the view moves or the window resizes.
+typedef struct Layer {
+  pdll *strokes;            // contains Path
+  cairo_surface_t *surface; // same size and translation as the canvas
+  cairo_t *cr;
+  unsigned char *pixels; // backing buffer of surface
+  size_t capacity;
+  bool visible;
+  // the surface doesn't match the strokes, redraw before showing it
+  bool stale;
+} Layer;
+
+// a full redraw in progress, see board_refresh_step().
+// layers are drawn from the top one down, each in stroke order, into a
+// back buffer that takes the place of the layer's surface once it holds
+// all of it. until then the layer shows what it held before.
+typedef struct Refresh {
+  bool active;
+  int layer;
+  pdll_node *node; // next stroke of the layer, NULL to start from its first one
+  size_t changes;  // of the layer's strokes when it was started, see pdll.h
+  bool drawn;      // the whole layer is in back, waiting for the stroke being drawn
+  Layer back;      // only its surface is used
+} Refresh;
+
 typedef struct Board {
+  // owned by the input (main) thread
   SDL_Window *window;
   SDL_Renderer *renderer;
-  SDL_Surface *sdl_surface;
-  SDL_Texture *sdl_texture;
+  Tile *tiles;
+  int tile_columns;
+  int tile_rows;
+  int tiles_capacity;
+  SDL_Rect viewport; // board pixels shown by the tiles
+  bool present_pending;
+  bool resize_pending;
+  Uint32 resize_deadline;
   SDL_Cursor *cursor;
   SDL_Cursor *default_cursor;
 
+  double stroke_width;
+  double stroke_width_previous;
+  unsigned int stroke_color;
+  unsigned int stroke_color_previous;
+  BoardState state;
+  int mouse_x_raw;
+  int mouse_y_raw;
+  bool commands_pending;
+
+  // owned by the render thread
   cairo_surface_t *cr_surface;
   cairo_t *cr;
+  unsigned char *canvas_pixels; // backing buffer of cr_surface
+  size_t canvas_capacity;
   int width;
   int height;
 
@@ -46,36 +199,102 @@ typedef struct Board {
   double dx;
   double dy;
 
-  double stroke_width;
-  double stroke_width_previous;
-  unsigned int stroke_color;
-  unsigned int stroke_color_previous;
-
+  unsigned int current_stroke_color;
+  double current_stroke_width;
   List *current_stroke_points; // contains Point
   List *current_stroke_paths;  // contains cairo_path_t
-  pdll *strokes;               // contains Path
-  BoardState state;
+  Layer *layers;               // bottom to top
+  int layers_count;
+  int active_layer;
+  pdll *strokes; // strokes of the active layer
+  SpriteCache *sprites;
+  OutlineCache *outlines;
+  ChunkStore *chunks;
+  Prefetch prefetch;
+  Refresh refresh;
+  // smoothed translation per pan step, in window pixels
+  double pan_dx;
+  double pan_dy;
+  // version holding the deletions of the current eraser gesture, 0 if none
+  size_t erase_version;
+  Gesture gesture;
+  Selection selection;
+  Clipboard clipboard;
+  Import *imports; // feeds being read, oldest first
   double mouse_x;
-  int mouse_x_raw;
   double mouse_y;
-  int mouse_y_raw;
+
+  // area (in window coordinates) that changed since the last published frame
+  SDL_Rect dirty_area;
+  bool dirty;
+
+  // shared between the threads.
+  // commands flow from the input thread to the render thread,
+  // finished frames flow back through sdl_surface under frame_lock.
+  Ring *commands; // contains Command
+  SDL_sem *commands_available;
+  Control *control; // scripts driving the board, NULL unless started
+  Sync *sync;       // other instances sharing the board, NULL unless started
+  SDL_mutex *frame_lock;
+  SDL_Surface *sdl_surface;
+  unsigned char *frame_pixels; // backing buffer of sdl_surface
+  size_t frame_capacity;
+  // pixel translation of the published frame
+  int frame_x;
+  int frame_y;
+  SDL_Rect frame_dirty_area; // in board pixels
+  bool frame_dirty;
+  Uint32 frame_event;
 } Board;
 
 Board *board_create(int width, int height);
 void board_free(Board *board);
-void board_resize_surface(Board *board);
+void board_push_command(Board *board, Command *command);
+void board_flush_commands(Board *board);
+void board_resize_surface(Board *board, int width, int height, int pixel_width, int pixel_height);
 void board_clear(Board *board);
-void board_render(Board *board, SDL_Rect *update_are);
+void board_redraw_area(Board *board, SDL_Rect *area);
+void board_invalidate(Board *board, SDL_Rect *area);
+void board_publish_frame(Board *board);
+void board_render(Board *board);
 void board_setup_draw(Board *board);
-void board_draw_strokes(Board *board);
+void board_draw_strokes(Board *board, Layer *layer, cairo_t *cr);
+void board_draw_selection(Board *board);
 void board_translate(Board *board, double dx, double dy);
 void board_reset_translation(Board *board);
 void board_refresh(Board *board);
+bool board_refresh_step(Board *board, double budget_ms);
 void board_update_cursor(Board *board);
-void board_update_mouse_state(Board *board);
+void board_update_mouse_state(Board *board, int x, int y);
 void board_reset_current_stroke(Board *board);
 void board_set_stroke_width(Board *board, double width);
 void board_set_stroke_color(Board *board, unsigned int color);
 int board_delete_intersecting_paths(Board *board, cairo_path_t *path);
-int board_save_image(Board *board, char *path);
+bool board_undo(Board *board);
+void board_add_path(Board *board, Path *path);
+void board_page_chunks(Board *board);
+void board_prefetch(Board *board);
+void board_redraw_path(Board *board, Path *path);
+bool board_add_layer(Board *board);
+void board_select_layer(Board *board, int index);
+void board_toggle_layer(Board *board, int index);
+void board_select(Board *board, cairo_path_t *area);
+bool board_selection_extents(Board *board, Point *top_left, Point *bottom_right);
+bool board_selection_contains(Board *board, double x, double y);
+void board_transform_selection(Board *board, cairo_matrix_t *transform);
+void board_commit_selection(Board *board);
+void board_cancel_selection(Board *board);
+void board_update_selection_band(Board *board);
+void board_copy_selection(Board *board);
+void board_paste(Board *board, double x, double y);
+void board_duplicate_selection(Board *board);
+void board_import(Board *board, const char *filename);
+void board_finish_imports(Board *board);
+void board_run_controls(Board *board);
+void board_share(Board *board, const char *socket_path);
+void board_sync(Board *board);
+cairo_status_t board_save_image(Board *board, char *path);
+size_t board_tiles_memory_usage(Board *board);
+void board_memory_usage(Board *board, BoardMemory *usage);
+void board_print_memory(Board *board, BoardMemory *usage);
 #endif // SB_BOARD_H
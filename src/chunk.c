@@ -0,0 +1,541 @@
+#include "chunk.h"
+#include "config.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHUNK_BUCKETS 64
+// offset of a shape left in memory, see chunk_evict()
+#define CHUNK_SHAPE_KEPT UINT32_MAX
+
+static void chunk_request_free(ChunkLoad *load) {
+  while (load != NULL) {
+    ChunkLoad *next = load->next;
+    free(load->data);
+    free(load);
+    load = next;
+  }
+}
+
+static unsigned char *chunk_store_read(ChunkStore *store, long offset, size_t length) {
+  unsigned char *data = malloc(length > 0 ? length : 1);
+  if (data == NULL) {
+    return NULL;
+  }
+
+  SDL_LockMutex(store->file_lock);
+  bool read = fseek(store->file, offset, SEEK_SET) == 0 && fread(data, 1, length, store->file) == length;
+  SDL_UnlockMutex(store->file_lock);
+  if (!read) {
+    free(data);
+    return NULL;
+  }
+  return data;
+}
+
+// reads chunks queued by chunk_store_update() off the render thread.
+static int chunk_loader_run(void *data) {
+  ChunkStore *store = data;
+  while (true) {
+    SDL_SemWait(store->requests_available);
+    SDL_LockMutex(store->queue_lock);
+    ChunkLoad *load = store->requests;
+    if (load != NULL) {
+      store->requests = load->next;
+    }
+    bool quit = store->quit;
+    SDL_UnlockMutex(store->queue_lock);
+
+    if (load == NULL) {
+      if (quit) {
+        return 0;
+      }
+      continue;
+    }
+
+    load->data = chunk_store_read(store, load->offset, load->length);
+    SDL_LockMutex(store->queue_lock);
+    load->next = store->done;
+    store->done = load;
+    SDL_UnlockMutex(store->queue_lock);
+    if (store->wake != NULL) {
+      SDL_SemPost(store->wake);
+    }
+  }
+}
+
+// wake is posted whenever a chunk was read ahead and waits for chunk_store_poll().
+ChunkStore *chunk_store_create(SDL_sem *wake) {
+  ChunkStore *store = calloc(1, sizeof(ChunkStore));
+  if (store == NULL) {
+    return NULL;
+  }
+
+  store->bucket_count = CHUNK_BUCKETS;
+  store->buckets = calloc(store->bucket_count, sizeof(Chunk *));
+  store->file_lock = SDL_CreateMutex();
+  store->queue_lock = SDL_CreateMutex();
+  store->requests_available = SDL_CreateSemaphore(0);
+  store->wake = wake;
+  if (store->buckets == NULL || store->file_lock == NULL || store->queue_lock == NULL ||
+      store->requests_available == NULL) {
+    chunk_store_free(store);
+    return NULL;
+  }
+
+  // without a file to page out to, every stroke simply stays in memory.
+  if (CHUNK_RESIDENT_MARGIN >= 0) {
+    store->file = tmpfile();
+  }
+  if (store->file != NULL) {
+    store->loader = SDL_CreateThread(chunk_loader_run, "chunks", store);
+    if (store->loader == NULL) {
+      fclose(store->file);
+      store->file = NULL;
+    }
+  }
+  return store;
+}
+
+// paths still in a chunk are left alone, they belong to their lists.
+void chunk_store_free(ChunkStore *store) {
+  if (store == NULL) {
+    return;
+  }
+
+  if (store->loader != NULL) {
+    SDL_LockMutex(store->queue_lock);
+    store->quit = true;
+    SDL_UnlockMutex(store->queue_lock);
+    SDL_SemPost(store->requests_available);
+    SDL_WaitThread(store->loader, NULL);
+  }
+  chunk_request_free(store->requests);
+  chunk_request_free(store->done);
+
+  for (int i = 0; store->buckets != NULL && i < store->bucket_count; ++i) {
+    Chunk *chunk = store->buckets[i];
+    while (chunk != NULL) {
+      Chunk *next = chunk->next;
+      for (int j = 0; j < chunk->count; ++j) {
+        if (chunk->paths[j] != NULL) {
+          chunk->paths[j]->chunk = NULL;
+        }
+      }
+      free(chunk->paths);
+      free(chunk);
+      chunk = next;
+    }
+  }
+  free(store->buckets);
+  free(store->free_slots);
+
+  if (store->file != NULL)
+    fclose(store->file);
+  if (store->file_lock != NULL)
+    SDL_DestroyMutex(store->file_lock);
+  if (store->queue_lock != NULL)
+    SDL_DestroyMutex(store->queue_lock);
+  if (store->requests_available != NULL)
+    SDL_DestroySemaphore(store->requests_available);
+  free(store);
+}
+
+static unsigned int chunk_hash(int x, int y) {
+  return (unsigned int)x * 73856093u ^ (unsigned int)y * 19349663u;
+}
+
+static void chunk_store_rehash(ChunkStore *store) {
+  int bucket_count = store->bucket_count * 2;
+  Chunk **buckets = calloc(bucket_count, sizeof(Chunk *));
+  if (buckets == NULL) {
+    // longer chains, still correct.
+    return;
+  }
+
+  for (int i = 0; i < store->bucket_count; ++i) {
+    Chunk *chunk = store->buckets[i];
+    while (chunk != NULL) {
+      Chunk *next = chunk->next;
+      unsigned int bucket = chunk_hash(chunk->x, chunk->y) % bucket_count;
+      chunk->next = buckets[bucket];
+      buckets[bucket] = chunk;
+      chunk = next;
+    }
+  }
+  free(store->buckets);
+  store->buckets = buckets;
+  store->bucket_count = bucket_count;
+}
+
+static Chunk *chunk_store_get(ChunkStore *store, int x, int y) {
+  unsigned int bucket = chunk_hash(x, y) % store->bucket_count;
+  for (Chunk *chunk = store->buckets[bucket]; chunk != NULL; chunk = chunk->next) {
+    if (chunk->x == x && chunk->y == y) {
+      return chunk;
+    }
+  }
+
+  Chunk *chunk = calloc(1, sizeof(Chunk));
+  if (chunk == NULL) {
+    return NULL;
+  }
+  chunk->store = store;
+  chunk->x = x;
+  chunk->y = y;
+  chunk->resident = true;
+  chunk->next = store->buckets[bucket];
+  store->buckets[bucket] = chunk;
+  store->count++;
+  store->resident++;
+  // the new chunk may be far from the screen, look at it on the next update.
+  store->placed = false;
+  if (store->count > store->bucket_count) {
+    chunk_store_rehash(store);
+  }
+  return chunk;
+}
+
+// paths sharing a shape still share it while evicted, the first one
+// restores it for all of them. the paths freed meanwhile are skipped.
+static void chunk_install(Chunk *chunk, const unsigned char *data) {
+  int count = 0;
+  for (int i = 0; i < chunk->count; ++i) {
+    Path *path = chunk->paths[i];
+    if (i < chunk->stored && path != NULL) {
+      uint32_t offset;
+      memcpy(&offset, data + sizeof(offset) * i, sizeof(offset));
+      if (offset != CHUNK_SHAPE_KEPT && path->shape->geometry.deltas == NULL) {
+        path_restore(path, data + offset);
+      }
+    }
+    if (path != NULL) {
+      path->chunk_index = count;
+      chunk->paths[count++] = path;
+    }
+  }
+  chunk->count = count;
+  chunk->resident = true;
+  chunk->loading = false;
+  chunk->store->resident++;
+}
+
+// the first free span that fits size, or the end of the file.
+static long chunk_store_reserve(ChunkStore *store, size_t size) {
+  for (int i = 0; i < store->free_count; ++i) {
+    ChunkSlot *slot = &store->free_slots[i];
+    if (slot->size >= size) {
+      long offset = slot->offset;
+      slot->offset += size;
+      slot->size -= size;
+      if (slot->size == 0) {
+        *slot = store->free_slots[--store->free_count];
+      }
+      return offset;
+    }
+  }
+
+  long offset = store->file_end;
+  store->file_end += size;
+  return offset;
+}
+
+// give a span back, merged with the free ones next to it or with the end of
+// the file. out of memory the span is lost, the file only grows then.
+static void chunk_store_release(ChunkStore *store, long offset, size_t size) {
+  for (int i = 0; i < store->free_count; ++i) {
+    ChunkSlot *slot = &store->free_slots[i];
+    if (slot->offset + (long)slot->size == offset || offset + (long)size == slot->offset) {
+      offset = slot->offset < offset ? slot->offset : offset;
+      size += slot->size;
+      *slot = store->free_slots[--store->free_count];
+      --i;
+    }
+  }
+  if (offset + (long)size == store->file_end) {
+    store->file_end = offset;
+    return;
+  }
+
+  if (store->free_count == store->free_capacity) {
+    int capacity = store->free_capacity == 0 ? 16 : store->free_capacity * 2;
+    ChunkSlot *slots = realloc(store->free_slots, sizeof(ChunkSlot) * capacity);
+    if (slots == NULL) {
+      return;
+    }
+    store->free_slots = slots;
+    store->free_capacity = capacity;
+  }
+  store->free_slots[store->free_count++] = (ChunkSlot){.offset = offset, .size = size};
+}
+
+// a path of a chunk by its shape, see chunk_evict().
+typedef struct ChunkShape {
+  PathShape *shape;
+  int index;
+  bool stored; // no path outside the chunk uses the shape
+} ChunkShape;
+
+static int chunk_shape_compare(const void *a, const void *b) {
+  uintptr_t x = (uintptr_t)((const ChunkShape *)a)->shape;
+  uintptr_t y = (uintptr_t)((const ChunkShape *)b)->shape;
+  return (x > y) - (x < y);
+}
+
+// the chunk is stored as the offset of the shape of every path, followed by
+// the geometry of each shape once. a shape also used outside the chunk has
+// to stay in memory for those paths, it isn't stored at all.
+static void chunk_evict(Chunk *chunk) {
+  ChunkStore *store = chunk->store;
+  ChunkShape *shapes = malloc(sizeof(ChunkShape) * chunk->count);
+  if (shapes == NULL) {
+    return;
+  }
+  for (int i = 0; i < chunk->count; ++i) {
+    shapes[i] = (ChunkShape){.shape = chunk->paths[i]->shape, .index = i};
+  }
+  qsort(shapes, chunk->count, sizeof(ChunkShape), chunk_shape_compare);
+
+  // the paths sharing a shape are next to each other now.
+  size_t length = sizeof(uint32_t) * chunk->count;
+  for (int i = 0; i < chunk->count;) {
+    int end = i + 1;
+    while (end < chunk->count && shapes[end].shape == shapes[i].shape) {
+      ++end;
+    }
+    bool stored = shapes[i].shape->refs == end - i;
+    for (int j = i; j < end; ++j) {
+      shapes[j].stored = stored;
+    }
+    if (stored) {
+      length += path_stored_size(chunk->paths[shapes[i].index]);
+    }
+    i = end;
+  }
+
+  unsigned char *data = malloc(length);
+  if (data == NULL) {
+    free(shapes);
+    return;
+  }
+  uint32_t offset = CHUNK_SHAPE_KEPT;
+  unsigned char *cursor = data + sizeof(uint32_t) * chunk->count;
+  for (int i = 0; i < chunk->count; ++i) {
+    bool first = i == 0 || shapes[i].shape != shapes[i - 1].shape;
+    if (first) {
+      offset = shapes[i].stored ? (uint32_t)(cursor - data) : CHUNK_SHAPE_KEPT;
+    }
+    if (first && shapes[i].stored) {
+      cursor = path_store(chunk->paths[shapes[i].index], cursor);
+    }
+    memcpy(data + sizeof(uint32_t) * shapes[i].index, &offset, sizeof(offset));
+  }
+
+  // a chunk rewrites its own slot while it fits. one that outgrew it moves
+  // to a new slot and gives the old one back. a read of the old one still
+  // in flight is for an older generation and dropped.
+  SDL_LockMutex(store->file_lock);
+  bool moved = length > chunk->slot;
+  long file_offset = moved ? chunk_store_reserve(store, length) : chunk->offset;
+  bool written = fseek(store->file, file_offset, SEEK_SET) == 0 && fwrite(data, 1, length, store->file) == length;
+  if (moved && written) {
+    if (chunk->slot > 0) {
+      chunk_store_release(store, chunk->offset, chunk->slot);
+    }
+    chunk->slot = length;
+  } else if (moved) {
+    chunk_store_release(store, file_offset, length);
+  }
+  SDL_UnlockMutex(store->file_lock);
+  free(data);
+  if (!written) {
+    free(shapes);
+    return;
+  }
+
+  // every path sharing a stored shape is paged out along with it.
+  for (int i = 0; i < chunk->count; ++i) {
+    if (shapes[i].stored && (i == 0 || shapes[i].shape != shapes[i - 1].shape)) {
+      path_evict(chunk->paths[shapes[i].index]);
+    }
+  }
+  free(shapes);
+  chunk->offset = file_offset;
+  chunk->length = length;
+  chunk->stored = chunk->count;
+  chunk->resident = false;
+  chunk->generation++;
+  store->resident--;
+}
+
+static void chunk_request(Chunk *chunk) {
+  ChunkStore *store = chunk->store;
+  ChunkLoad *load = malloc(sizeof(ChunkLoad));
+  if (load == NULL) {
+    return;
+  }
+
+  load->chunk = chunk;
+  load->generation = chunk->generation;
+  load->offset = chunk->offset;
+  load->length = chunk->length;
+  load->data = NULL;
+  chunk->loading = true;
+
+  SDL_LockMutex(store->queue_lock);
+  load->next = store->requests;
+  store->requests = load;
+  SDL_UnlockMutex(store->queue_lock);
+  SDL_SemPost(store->requests_available);
+}
+
+// page in a chunk right away, for when its geometry is needed now.
+void chunk_load(Chunk *chunk) {
+  if (chunk->resident) {
+    return;
+  }
+
+  // a read ahead still in flight is overtaken, its copy is dropped.
+  chunk->loading = false;
+  unsigned char *data = chunk_store_read(chunk->store, chunk->offset, chunk->length);
+  if (data == NULL) {
+    return;
+  }
+  chunk_install(chunk, data);
+  free(data);
+  // it may have been far from the screen.
+  chunk->store->placed = false;
+}
+
+// install the chunks the loader thread read ahead.
+void chunk_store_poll(ChunkStore *store) {
+  SDL_LockMutex(store->queue_lock);
+  ChunkLoad *load = store->done;
+  store->done = NULL;
+  SDL_UnlockMutex(store->queue_lock);
+
+  for (ChunkLoad *done = load; done != NULL; done = done->next) {
+    Chunk *chunk = done->chunk;
+    if (!chunk->loading || done->generation != chunk->generation) {
+      continue;
+    }
+    chunk->loading = false;
+    if (done->data != NULL) {
+      chunk_install(chunk, done->data);
+    }
+  }
+  chunk_request_free(load);
+}
+
+// how many chunks away from the screen chunk is, 0 if it is on screen.
+static int chunk_distance(ChunkStore *store, Chunk *chunk) {
+  int dx = 0;
+  int dy = 0;
+  if (chunk->x < store->first_x) {
+    dx = store->first_x - chunk->x;
+  } else if (chunk->x > store->last_x) {
+    dx = chunk->x - store->last_x;
+  }
+  if (chunk->y < store->first_y) {
+    dy = store->first_y - chunk->y;
+  } else if (chunk->y > store->last_y) {
+    dy = chunk->y - store->last_y;
+  }
+  return dx > dy ? dx : dy;
+}
+
+// the screen shows the board between top_left and bottom_right. chunks that
+// got far from it are paged out, the ones it is getting close to are read ahead.
+void chunk_store_update(ChunkStore *store, Point top_left, Point bottom_right) {
+  if (store->file == NULL) {
+    return;
+  }
+
+  int first_x = floor(top_left.x / CHUNK_SIZE);
+  int first_y = floor(top_left.y / CHUNK_SIZE);
+  int last_x = floor(bottom_right.x / CHUNK_SIZE);
+  int last_y = floor(bottom_right.y / CHUNK_SIZE);
+  if (store->placed && first_x == store->first_x && first_y == store->first_y && last_x == store->last_x &&
+      last_y == store->last_y) {
+    return;
+  }
+  store->first_x = first_x;
+  store->first_y = first_y;
+  store->last_x = last_x;
+  store->last_y = last_y;
+  store->placed = true;
+
+  for (int i = 0; i < store->bucket_count; ++i) {
+    for (Chunk *chunk = store->buckets[i]; chunk != NULL; chunk = chunk->next) {
+      int distance = chunk_distance(store, chunk);
+      if (chunk->resident && chunk->count > 0 && distance > CHUNK_RESIDENT_MARGIN) {
+        chunk_evict(chunk);
+      } else if (!chunk->resident && !chunk->loading && distance <= CHUNK_PREFETCH_MARGIN &&
+                 distance <= CHUNK_RESIDENT_MARGIN) {
+        chunk_request(chunk);
+      }
+    }
+  }
+}
+
+// track path in the chunk its bounding box is centered in.
+// returns false if it can't be paged out and stays resident.
+bool chunk_store_add(ChunkStore *store, Path *path) {
+  double center_x = (path->top_left.x + path->bottom_right.x) / 2;
+  double center_y = (path->top_left.y + path->bottom_right.y) / 2;
+  if (store->file == NULL || !isfinite(center_x) || !isfinite(center_y)) {
+    return false;
+  }
+
+  Chunk *chunk = chunk_store_get(store, floor(center_x / CHUNK_SIZE), floor(center_y / CHUNK_SIZE));
+  if (chunk == NULL) {
+    return false;
+  }
+
+  if (chunk->count == chunk->capacity) {
+    int capacity = chunk->capacity == 0 ? 64 : chunk->capacity * 2;
+    Path **paths = realloc(chunk->paths, sizeof(Path *) * capacity);
+    if (paths == NULL) {
+      return false;
+    }
+    chunk->paths = paths;
+    chunk->capacity = capacity;
+  }
+
+  // an evicted chunk isn't paged in for it, the path stays in memory after
+  // the stored ones until the chunk is written out again.
+  path->chunk = chunk;
+  path->chunk_index = chunk->count;
+  chunk->paths[chunk->count++] = path;
+  return true;
+}
+
+// also called by path_free(), a freed stroke leaves its chunk.
+void chunk_remove(Path *path) {
+  Chunk *chunk = path->chunk;
+  if (chunk == NULL) {
+    return;
+  }
+
+  if (chunk->resident) {
+    Path *last = chunk->paths[--chunk->count];
+    chunk->paths[path->chunk_index] = last;
+    last->chunk_index = path->chunk_index;
+  } else {
+    chunk->paths[path->chunk_index] = NULL;
+  }
+  path->chunk = NULL;
+}
+
+// bytes held in memory to track the chunks, the paths are not included.
+size_t chunk_store_memory_usage(ChunkStore *store) {
+  size_t size = sizeof(ChunkStore) + sizeof(Chunk *) * store->bucket_count;
+  for (int i = 0; i < store->bucket_count; ++i) {
+    for (Chunk *chunk = store->buckets[i]; chunk != NULL; chunk = chunk->next) {
+      size += sizeof(Chunk) + sizeof(Path *) * chunk->capacity;
+    }
+  }
+  size += sizeof(ChunkSlot) * store->free_capacity;
+  return size;
+}
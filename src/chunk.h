@@ -0,0 +1,99 @@
+#ifndef SB_CHUNK_H
+#define SB_CHUNK_H
+
+#include "path.h"
+#include "point.h"
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// board units a side of a chunk
+#define CHUNK_SIZE 2048
+// chunks this close to the screen are paged in ahead of time, in chunks
+#define CHUNK_PREFETCH_MARGIN 1
+
+typedef struct ChunkStore ChunkStore;
+
+// the strokes whose bounding box is centered in one square of the board.
+// their geometry is written to the store and freed when the chunk is far
+// from the screen, and read back when it gets close again.
+typedef struct Chunk {
+  ChunkStore *store;
+  int x; // in chunks
+  int y;
+  // while evicted, freed paths leave a NULL behind so the stored
+  // geometry still lines up with the paths. compacted when paged in.
+  Path **paths;
+  int count;
+  int capacity;
+  // paths the stored geometry is for, the ones added after them while
+  // evicted are still in memory.
+  int stored;
+  bool resident;
+  bool loading;
+  // bumped by every eviction, a load of an older copy is dropped
+  unsigned int generation;
+  // where the geometry sits in the store file
+  long offset;
+  size_t length;
+  size_t slot; // bytes reserved at offset, reused by the next eviction
+  struct Chunk *next;
+} Chunk;
+
+// a span of the store file no chunk uses anymore
+typedef struct ChunkSlot {
+  long offset;
+  size_t size;
+} ChunkSlot;
+
+// a chunk read from the store by the loader thread
+typedef struct ChunkLoad {
+  Chunk *chunk;
+  unsigned int generation;
+  long offset;
+  size_t length;
+  unsigned char *data; // NULL if the read failed
+  struct ChunkLoad *next;
+} ChunkLoad;
+
+struct ChunkStore {
+  Chunk **buckets;
+  int bucket_count;
+  int count;
+  int resident;
+  // an unlinked temporary file, NULL if none could be created,
+  // in which case nothing is ever evicted.
+  FILE *file;
+  long file_end;
+  SDL_mutex *file_lock;
+  // spans given back by chunks that outgrew their slot, never adjacent
+  ChunkSlot *free_slots;
+  int free_count;
+  int free_capacity;
+  // loads queued for the loader thread, and the ones it is done with
+  ChunkLoad *requests;
+  ChunkLoad *done;
+  SDL_mutex *queue_lock;
+  SDL_sem *requests_available;
+  SDL_sem *wake; // posted after every load, so the owner installs it
+  SDL_Thread *loader;
+  bool quit;
+  // chunks around the screen at the last update, in chunks
+  int first_x;
+  int first_y;
+  int last_x;
+  int last_y;
+  bool placed;
+};
+
+ChunkStore *chunk_store_create(SDL_sem *wake);
+void chunk_store_free(ChunkStore *store);
+bool chunk_store_add(ChunkStore *store, Path *path);
+void chunk_store_update(ChunkStore *store, Point top_left, Point bottom_right);
+void chunk_store_poll(ChunkStore *store);
+size_t chunk_store_memory_usage(ChunkStore *store);
+void chunk_load(Chunk *chunk);
+void chunk_remove(Path *path);
+
+#endif // SB_CHUNK_H
@@ -0,0 +1,76 @@
+#ifndef SB_COMMAND_H
+#define SB_COMMAND_H
+
+#include <stddef.h>
+
+// commands sent from the input (main) thread to the render thread.
+// coordinates are raw window coordinates, the render thread
+// converts them to board coordinates.
+typedef enum CommandType {
+  COMMAND_STROKE_BEGIN,
+  COMMAND_STROKE_POINT,
+  COMMAND_STROKE_END,
+  COMMAND_TRANSLATE,
+  COMMAND_RESET_TRANSLATION,
+  COMMAND_UNDO,
+  COMMAND_REFRESH,
+  COMMAND_RESIZE,
+  COMMAND_SAVE,
+  COMMAND_SCALE_SELECTION,
+  COMMAND_COMMIT_SELECTION,
+  COMMAND_DUMP_MEMORY,
+  COMMAND_ADD_LAYER,
+  COMMAND_NEXT_LAYER,
+  COMMAND_TOGGLE_LAYER,
+  COMMAND_COPY,
+  COMMAND_PASTE,
+  COMMAND_DUPLICATE,
+  COMMAND_IMPORT,
+  COMMAND_QUIT,
+} CommandType;
+
+// what a left button drag does.
+// the pen erases when its color is the background color.
+typedef enum StrokeTool {
+  TOOL_PEN,
+  TOOL_SELECT_RECT,
+  TOOL_SELECT_LASSO,
+} StrokeTool;
+
+typedef struct Command {
+  CommandType type;
+  union {
+    struct {
+      int x;
+      int y;
+      unsigned int color;
+      double width;
+      StrokeTool tool;
+    } stroke;
+    struct {
+      double dx;
+      double dy;
+    } translate;
+    struct {
+      double factor;
+    } scale;
+    struct {
+      int width;
+      int height;
+      int pixel_width;
+      int pixel_height;
+    } resize;
+    struct {
+      size_t tiles; // bytes of the tile textures, owned by the input thread
+    } memory;
+    struct {
+      int x; // where the pasted strokes are centered
+      int y;
+    } paste;
+    struct {
+      char *filename; // freed by the render thread
+    } import;
+  };
+} Command;
+
+#endif // SB_COMMAND_H
@@ -20,6 +20,16 @@
 #define STROKE_WIDTH_THICKER 12.0
 #define STROKE_WIDTH_THICKEST 24.0
 #define STROKES_AMOUNT 5
+
+// memory for pre-rendered small strokes, 0 disables the sprite cache
+#define SPRITE_CACHE_SIZE (32 * 1024 * 1024)
+
+// memory for the stroked outlines of the strokes drawn last, 0 always strokes
+#define OUTLINE_CACHE_SIZE (16 * 1024 * 1024)
+
+// strokes further than this many chunks from the screen are paged out to a
+// temporary file, -1 keeps every stroke in memory
+#define CHUNK_RESIDENT_MARGIN 2
 #define COLORS_AMOUNT 2
 
 #ifdef USER
@@ -0,0 +1,540 @@
+#include "control.h"
+#include "import.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// bytes asked for by every read of a client
+#define CONTROL_READ_SIZE (64 * 1024)
+
+// the points of the stroke being read, reused for every stroke of a client
+typedef struct ControlPoints {
+  Point *data;
+  int count;
+  int capacity;
+} ControlPoints;
+
+static bool points_push(ControlPoints *points, double x, double y) {
+  if (points->count == points->capacity) {
+    int capacity = points->capacity == 0 ? 256 : points->capacity * 2;
+    Point *data = realloc(points->data, sizeof(Point) * capacity);
+    if (data == NULL) {
+      return false;
+    }
+    points->data = data;
+    points->capacity = capacity;
+  }
+  points->data[points->count++] = (Point){x, y};
+  return true;
+}
+
+static bool parse_number(char **save, double *value) {
+  char *token = strtok_r(NULL, " \t\r", save);
+  if (token == NULL) {
+    return false;
+  }
+  char *end;
+  *value = strtod(token, &end);
+  return *end == '\0' && isfinite(*value);
+}
+
+// 0xAARRGGBB or any other integer strtoul reads, #RRGGBB is opaque.
+static bool parse_color(char **save, unsigned int *color) {
+  char *token = strtok_r(NULL, " \t\r", save);
+  if (token == NULL) {
+    return false;
+  }
+  char *end;
+  bool hash = token[0] == '#';
+  unsigned long value = strtoul(token + hash, &end, hash ? 16 : 0);
+  if (*end != '\0' || end == token + hash) {
+    return false;
+  }
+  *color = hash && end - token == 7 ? 0xFF000000 | value : value;
+  return true;
+}
+
+static const char *parse_stroke(char **save, ControlPoints *points, ControlOp *op) {
+  unsigned int color;
+  double width;
+  if (!parse_color(save, &color) || !parse_number(save, &width) || !(width > 0)) {
+    return "stroke wants a color, a width and points";
+  }
+
+  points->count = 0;
+  double x, y;
+  while (parse_number(save, &x)) {
+    if (!parse_number(save, &y)) {
+      return "stroke points come in pairs";
+    }
+    if (!path_coord_valid(x) || !path_coord_valid(y)) {
+      return "stroke points out of range";
+    }
+    // the pen never samples the same point twice in a row, neither does this.
+    Point *last = points->count > 0 ? &points->data[points->count - 1] : NULL;
+    if ((last == NULL || last->x != x || last->y != y) && !points_push(points, x, y)) {
+      return "out of memory";
+    }
+  }
+  if (strtok_r(NULL, " \t\r", save) != NULL) {
+    return "stroke points must be numbers";
+  }
+  if (points->count == 0) {
+    return "stroke wants a color, a width and points";
+  }
+
+  cairo_path_t *smooth = import_smooth(points->data, points->count);
+  op->path = smooth != NULL ? path_create(smooth, color, width) : NULL;
+  return op->path != NULL ? NULL : "out of memory";
+}
+
+// read one command. lines that can't be read become CONTROL_ERROR, so
+// the replies still line up with the commands. false for a blank line.
+static bool parse_line(char *line, ControlPoints *points, ControlOp *op) {
+  char *save;
+  char *name = strtok_r(line, " \t\r", &save);
+  if (name == NULL) {
+    return false;
+  }
+
+  const char *error = NULL;
+  if (strcmp(name, "stroke") == 0) {
+    op->type = CONTROL_STROKE;
+    error = parse_stroke(&save, points, op);
+  } else if (strcmp(name, "erase") == 0) {
+    op->type = CONTROL_ERASE;
+    double x1, y1, x2, y2;
+    if (!parse_number(&save, &x1) || !parse_number(&save, &y1) || !parse_number(&save, &x2) ||
+        !parse_number(&save, &y2)) {
+      error = "erase wants a box";
+    } else {
+      op->erase.top_left = (Point){fmin(x1, x2), fmin(y1, y2)};
+      op->erase.bottom_right = (Point){fmax(x1, x2), fmax(y1, y2)};
+    }
+  } else if (strcmp(name, "undo") == 0) {
+    op->type = CONTROL_UNDO;
+  } else if (strcmp(name, "pan") == 0) {
+    op->type = CONTROL_PAN;
+    if (!parse_number(&save, &op->pan.dx) || !parse_number(&save, &op->pan.dy)) {
+      error = "pan wants dx and dy";
+    }
+  } else if (strcmp(name, "save") == 0) {
+    op->type = CONTROL_SAVE;
+    char *filename = strtok_r(NULL, "\r", &save);
+    op->filename = filename != NULL ? strdup(filename) : NULL;
+    if (op->filename == NULL) {
+      error = filename != NULL ? "out of memory" : "save wants a file";
+    }
+  } else if (strcmp(name, "stats") == 0) {
+    op->type = CONTROL_STATS;
+  } else {
+    error = "unknown command";
+  }
+
+  if (error != NULL) {
+    op->type = CONTROL_ERROR;
+    op->error = error;
+  }
+  return true;
+}
+
+static void batch_free(ControlBatch *batch) {
+  for (int i = 0; i < batch->count; ++i) {
+    ControlOp *op = &batch->ops[i];
+    if (op->type == CONTROL_STROKE && op->path != NULL) {
+      path_free(op->path);
+    } else if (op->type == CONTROL_SAVE) {
+      free(op->filename);
+    }
+  }
+  free(batch->ops);
+  free(batch->reply);
+  if (batch->done != NULL) {
+    SDL_DestroySemaphore(batch->done);
+  }
+  free(batch);
+}
+
+// the complete lines in [begin, end), at most CONTROL_MAX_BATCH of them.
+// next is where the lines that didn't make it start.
+static ControlBatch *batch_parse(char *begin, char *end, ControlPoints *points, char **next) {
+  ControlBatch *batch = calloc(1, sizeof(ControlBatch));
+  if (batch == NULL) {
+    return NULL;
+  }
+  batch->ops = malloc(sizeof(ControlOp) * CONTROL_MAX_BATCH);
+  batch->done = SDL_CreateSemaphore(0);
+  if (batch->ops == NULL || batch->done == NULL) {
+    batch_free(batch);
+    return NULL;
+  }
+
+  char *line = begin;
+  char *newline;
+  while (batch->count < CONTROL_MAX_BATCH && (newline = memchr(line, '\n', end - line)) != NULL) {
+    *newline = '\0';
+    ControlOp *op = &batch->ops[batch->count];
+    if (parse_line(line, points, op)) {
+      batch->count++;
+    }
+    line = newline + 1;
+  }
+  *next = line;
+  return batch;
+}
+
+static bool write_all(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t written = send(fd, data, size, MSG_NOSIGNAL);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return false;
+    }
+    data += written;
+    size -= written;
+  }
+  return true;
+}
+
+static void control_wake_listener(Control *control) {
+  // a full pipe already has the listener awake.
+  while (write(control->wake_pipe[1], "", 1) < 0 && errno == EINTR) {
+  }
+}
+
+static bool control_quitting(Control *control) {
+  SDL_LockMutex(control->queue_lock);
+  bool quit = control->quit;
+  SDL_UnlockMutex(control->queue_lock);
+  return quit;
+}
+
+// hand a batch to the render thread, false once the board is going away.
+static bool control_submit(Control *control, ControlBatch *batch) {
+  SDL_LockMutex(control->queue_lock);
+  bool queued = !control->quit;
+  if (queued) {
+    ControlBatch **last = &control->requests;
+    while (*last != NULL) {
+      last = &(*last)->next;
+    }
+    *last = batch;
+  }
+  SDL_UnlockMutex(control->queue_lock);
+  if (queued) {
+    SDL_SemPost(control->wake);
+  }
+  return queued;
+}
+
+// read a client's commands until it hangs up. whatever arrived while the
+// last batch was applied makes the next batch.
+static int client_run(void *data) {
+  ControlClient *client = data;
+  Control *control = client->control;
+  char *buffer = NULL;
+  size_t size = 0;
+  size_t capacity = 0;
+  ControlPoints points = {0};
+
+  for (;;) {
+    if (capacity - size < CONTROL_READ_SIZE) {
+      char *grown = realloc(buffer, size + CONTROL_READ_SIZE);
+      if (grown == NULL) {
+        break;
+      }
+      buffer = grown;
+      capacity = size + CONTROL_READ_SIZE;
+    }
+    ssize_t got = read(client->fd, buffer + size, capacity - size);
+    if (got < 0 && errno == EINTR) {
+      continue;
+    }
+    // a last command without a newline still counts.
+    bool hung_up = got == 0;
+    if (got < 0 || (hung_up && size == 0)) {
+      break;
+    }
+    if (hung_up) {
+      buffer[size++] = '\n';
+    }
+    size += got;
+
+    char *line = buffer;
+    char *end = buffer + size;
+    bool failed = false;
+    while (!failed && memchr(line, '\n', end - line) != NULL) {
+      ControlBatch *batch = batch_parse(line, end, &points, &line);
+      if (batch == NULL || !control_submit(control, batch)) {
+        failed = true;
+      } else {
+        SDL_SemWait(batch->done);
+        failed = !write_all(client->fd, batch->reply, batch->reply_size);
+      }
+      if (batch != NULL) {
+        batch_free(batch);
+      }
+    }
+    if (failed || hung_up) {
+      break;
+    }
+
+    size = end - line;
+    memmove(buffer, line, size);
+    if (size > CONTROL_MAX_LINE) {
+      const char *error = "error line too long\n";
+      write_all(client->fd, error, strlen(error));
+      break;
+    }
+  }
+
+  free(points.data);
+  free(buffer);
+  SDL_AtomicSet(&client->finished, 1);
+  control_wake_listener(control);
+  return 0;
+}
+
+static void client_free(ControlClient *client) {
+  shutdown(client->fd, SHUT_RDWR);
+  SDL_WaitThread(client->thread, NULL);
+  close(client->fd);
+  free(client);
+}
+
+// join the clients that hung up.
+static void listener_reap(Control *control) {
+  ControlClient **link = &control->clients;
+  while (*link != NULL) {
+    ControlClient *client = *link;
+    if (SDL_AtomicGet(&client->finished)) {
+      *link = client->next;
+      client_free(client);
+    } else {
+      link = &client->next;
+    }
+  }
+}
+
+// waits for connections, and for clients that are done to join them.
+static int listener_run(void *data) {
+  Control *control = data;
+  for (;;) {
+    struct pollfd fds[2] = {
+        {.fd = control->wake_pipe[0], .events = POLLIN},
+        {.fd = control->fd, .events = POLLIN},
+    };
+    int ready = poll(fds, 2, -1);
+    int error = errno;
+    if (control_quitting(control)) {
+      break;
+    }
+    if (ready < 0) {
+      SDL_Delay(error == EINTR ? 0 : 10);
+      continue;
+    }
+    if (fds[0].revents & POLLIN) {
+      char drain[64];
+      while (read(control->wake_pipe[0], drain, sizeof(drain)) > 0) {
+      }
+      listener_reap(control);
+    }
+    if (!(fds[1].revents & POLLIN)) {
+      continue;
+    }
+
+    int fd = accept(control->fd, NULL, NULL);
+    if (fd < 0) {
+      // out of descriptors or an aborted connection, try again in a bit.
+      SDL_Delay(errno == EINTR || errno == ECONNABORTED ? 0 : 10);
+      continue;
+    }
+
+    ControlClient *client = calloc(1, sizeof(ControlClient));
+    if (client == NULL) {
+      close(fd);
+      continue;
+    }
+    client->fd = fd;
+    client->control = control;
+    client->thread = SDL_CreateThread(client_run, "control", client);
+    if (client->thread == NULL) {
+      close(fd);
+      free(client);
+      continue;
+    }
+    client->next = control->clients;
+    control->clients = client;
+  }
+  return 0;
+}
+
+// a socket left behind by an instance that is gone is replaced,
+// one that still answers is left alone.
+static bool socket_in_use(struct sockaddr_un *address) {
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return false;
+  }
+  bool in_use = connect(fd, (struct sockaddr *)address, sizeof(*address)) == 0;
+  close(fd);
+  return in_use;
+}
+
+// listen on socket_path, wake is posted for every batch of commands.
+// returns NULL if the socket can't be set up.
+Control *control_start(const char *socket_path, SDL_sem *wake) {
+  Control *control = calloc(1, sizeof(Control));
+  if (control == NULL) {
+    return NULL;
+  }
+  control->fd = -1;
+  control->wake_pipe[0] = control->wake_pipe[1] = -1;
+  control->wake = wake;
+
+  struct sockaddr_un address = {.sun_family = AF_UNIX};
+  if (strlen(socket_path) >= sizeof(address.sun_path)) {
+    fprintf(stderr, "control: socket path too long: %s\n", socket_path);
+    goto defer;
+  }
+  strcpy(address.sun_path, socket_path);
+  if (socket_in_use(&address)) {
+    fprintf(stderr, "control: %s is taken by another instance\n", socket_path);
+    goto defer;
+  }
+  unlink(socket_path);
+
+  control->socket_path = strdup(socket_path);
+  control->queue_lock = SDL_CreateMutex();
+  control->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (control->socket_path == NULL || control->queue_lock == NULL || control->fd < 0 ||
+      pipe(control->wake_pipe) != 0) {
+    goto defer;
+  }
+  for (int i = 0; i < 2; ++i) {
+    fcntl(control->wake_pipe[i], F_SETFD, FD_CLOEXEC);
+    fcntl(control->wake_pipe[i], F_SETFL, O_NONBLOCK);
+  }
+  // only the user running the board gets to drive it.
+  mode_t mask = umask(0077);
+  int bound = bind(control->fd, (struct sockaddr *)&address, sizeof(address));
+  umask(mask);
+  if (bound != 0 || listen(control->fd, SOMAXCONN) != 0) {
+    fprintf(stderr, "control: can't listen on %s: %s\n", socket_path, strerror(errno));
+    goto defer;
+  }
+
+  control->listener = SDL_CreateThread(listener_run, "control", control);
+  if (control->listener == NULL) {
+    unlink(socket_path);
+    goto defer;
+  }
+  return control;
+
+defer:
+  if (control->fd >= 0)
+    close(control->fd);
+  if (control->wake_pipe[0] >= 0) {
+    close(control->wake_pipe[0]);
+    close(control->wake_pipe[1]);
+  }
+  if (control->queue_lock != NULL)
+    SDL_DestroyMutex(control->queue_lock);
+  free(control->socket_path);
+  free(control);
+  return NULL;
+}
+
+// stops listening and hangs up on every client. the batches the render
+// thread didn't get to are answered with an error.
+void control_free(Control *control) {
+  if (control == NULL) {
+    return;
+  }
+
+  SDL_LockMutex(control->queue_lock);
+  control->quit = true;
+  SDL_UnlockMutex(control->queue_lock);
+  control_wake_listener(control);
+  SDL_WaitThread(control->listener, NULL);
+
+  ControlBatch *batch;
+  while ((batch = control_take(control)) != NULL) {
+    for (int i = 0; i < batch->count; ++i) {
+      control_reply(batch, "error shutting down");
+    }
+    control_done(batch);
+  }
+  while (control->clients != NULL) {
+    ControlClient *client = control->clients;
+    control->clients = client->next;
+    client_free(client);
+  }
+
+  close(control->fd);
+  close(control->wake_pipe[0]);
+  close(control->wake_pipe[1]);
+  unlink(control->socket_path);
+  SDL_DestroyMutex(control->queue_lock);
+  free(control->socket_path);
+  free(control);
+}
+
+// the oldest batch waiting to be applied, NULL if there is none.
+ControlBatch *control_take(Control *control) {
+  SDL_LockMutex(control->queue_lock);
+  ControlBatch *batch = control->requests;
+  if (batch != NULL) {
+    control->requests = batch->next;
+    batch->next = NULL;
+  }
+  SDL_UnlockMutex(control->queue_lock);
+  return batch;
+}
+
+// append a reply line, one per command and in the same order.
+void control_reply(ControlBatch *batch, const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(NULL, 0, format, args);
+  va_end(args);
+  if (length < 0) {
+    return;
+  }
+
+  size_t needed = batch->reply_size + length + 2;
+  if (needed > batch->reply_capacity) {
+    size_t capacity = batch->reply_capacity == 0 ? 256 : batch->reply_capacity;
+    while (capacity < needed) {
+      capacity *= 2;
+    }
+    char *reply = realloc(batch->reply, capacity);
+    if (reply == NULL) {
+      return;
+    }
+    batch->reply = reply;
+    batch->reply_capacity = capacity;
+  }
+
+  va_start(args, format);
+  vsnprintf(batch->reply + batch->reply_size, length + 1, format, args);
+  va_end(args);
+  batch->reply_size += length;
+  batch->reply[batch->reply_size++] = '\n';
+}
+
+// every command is replied to, the client takes the batch back.
+void control_done(ControlBatch *batch) {
+  SDL_SemPost(batch->done);
+}
@@ -0,0 +1,95 @@
+#ifndef SB_CONTROL_H
+#define SB_CONTROL_H
+
+#include "path.h"
+#include "point.h"
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// commands applied in one go, at most. the rest of what a client sent
+// waits for the next batch.
+#define CONTROL_MAX_BATCH 4096
+// longest command line, a client sending more is disconnected
+#define CONTROL_MAX_LINE (1024 * 1024)
+
+// a UNIX domain socket scripts drive the board through. every line a
+// client writes is a command, and every command gets a line back, in
+// order: "ok", "ok {...}" for stats, or "error <reason>".
+//
+//   stroke <color> <width> <x> <y> [<x> <y> ...]   add a stroke
+//   erase <x1> <y1> <x2> <y2>                       delete what touches the box
+//   undo
+//   pan <dx> <dy>                                   in window pixels
+//   save <file>                                     png of the visible layers
+//   stats
+//
+// coordinates are board coordinates, colors 0xAARRGGBB like the pen.
+// clients may write any amount of commands without waiting for replies,
+// whatever has arrived is applied as a batch with a single redraw.
+typedef enum ControlOpType {
+  CONTROL_STROKE,
+  CONTROL_ERASE,
+  CONTROL_UNDO,
+  CONTROL_PAN,
+  CONTROL_SAVE,
+  CONTROL_STATS,
+  CONTROL_ERROR, // a line that couldn't be read, only replied to
+} ControlOpType;
+
+typedef struct ControlOp {
+  ControlOpType type;
+  union {
+    Path *path; // taken by the board, NULL once it is
+    struct {
+      Point top_left;
+      Point bottom_right;
+    } erase;
+    struct {
+      double dx;
+      double dy;
+    } pan;
+    char *filename;
+    const char *error;
+  };
+} ControlOp;
+
+// the commands read from one client at once, and their replies.
+typedef struct ControlBatch {
+  ControlOp *ops;
+  int count;
+  char *reply;
+  size_t reply_size;
+  size_t reply_capacity;
+  SDL_sem *done; // posted once every command is replied to
+  struct ControlBatch *next;
+} ControlBatch;
+
+typedef struct ControlClient {
+  int fd;
+  SDL_Thread *thread;
+  struct Control *control;
+  SDL_atomic_t finished;
+  struct ControlClient *next;
+} ControlClient;
+
+typedef struct Control {
+  char *socket_path;
+  int fd;
+  int wake_pipe[2]; // written by clients that are done, and to quit
+  SDL_Thread *listener;
+  ControlClient *clients; // joined by the listener once they hang up
+  // batches waiting for the render thread, oldest first
+  ControlBatch *requests;
+  SDL_mutex *queue_lock;
+  SDL_sem *wake; // posted for every batch queued
+  bool quit;
+} Control;
+
+Control *control_start(const char *socket_path, SDL_sem *wake);
+void control_free(Control *control);
+ControlBatch *control_take(Control *control);
+void control_reply(ControlBatch *batch, const char *format, ...) __attribute__((format(printf, 2, 3)));
+void control_done(ControlBatch *batch);
+
+#endif // SB_CONTROL_H
@@ -0,0 +1,446 @@
+#include "import.h"
+#include "config.h"
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// a slice of the feed, parsed and smoothed by one thread
+typedef struct ImportWorker {
+  char *begin;
+  char *end;
+  bool binary;
+  Path **paths;
+  int count;
+  int capacity;
+  int skipped;
+  // points of the stroke being read, reused for every stroke
+  Point *points;
+  int points_count;
+  int points_capacity;
+  SDL_Thread *thread;
+} ImportWorker;
+
+static bool worker_push_point(ImportWorker *worker, double x, double y) {
+  if (!path_coord_valid(x) || !path_coord_valid(y)) {
+    return true;
+  }
+  // the pen never samples the same point twice in a row, neither does this.
+  if (worker->points_count > 0) {
+    Point *last = &worker->points[worker->points_count - 1];
+    if (last->x == x && last->y == y) {
+      return true;
+    }
+  }
+
+  if (worker->points_count == worker->points_capacity) {
+    int capacity = worker->points_capacity == 0 ? 256 : worker->points_capacity * 2;
+    Point *points = realloc(worker->points, sizeof(Point) * capacity);
+    if (points == NULL) {
+      return false;
+    }
+    worker->points = points;
+    worker->points_capacity = capacity;
+  }
+  worker->points[worker->points_count++] = (Point){x, y};
+  return true;
+}
+
+static void path_data_point(cairo_path_data_t **data, cairo_path_data_type_t type, Point *point) {
+  (*data)[0].header.type = type;
+  (*data)[0].header.length = 2;
+  (*data)[1].point.x = point->x;
+  (*data)[1].point.y = point->y;
+  *data += 2;
+}
+
+static void path_data_curve_to(cairo_path_data_t **data, Point h1, Point h2, Point *point) {
+  (*data)[0].header.type = CAIRO_PATH_CURVE_TO;
+  (*data)[0].header.length = 4;
+  (*data)[1].point.x = h1.x;
+  (*data)[1].point.y = h1.y;
+  (*data)[2].point.x = h2.x;
+  (*data)[2].point.y = h2.y;
+  (*data)[3].point.x = point->x;
+  (*data)[3].point.y = point->y;
+  *data += 4;
+}
+
+// the same curves the render thread draws through the samples of the pen:
+// every segment gets its handles from the points around it. unlike a live
+// stroke, which stops short of the last sample, the last segment is drawn
+// too, with its handles from the points before it.
+cairo_path_t *import_smooth(Point *points, int count) {
+  cairo_path_t *path = malloc(sizeof(cairo_path_t));
+  if (path == NULL) {
+    return NULL;
+  }
+  path->status = CAIRO_STATUS_SUCCESS;
+  path->data = malloc(sizeof(cairo_path_data_t) * (4 + 4 * count));
+  if (path->data == NULL) {
+    free(path);
+    return NULL;
+  }
+
+  cairo_path_data_t *data = path->data;
+  path_data_point(&data, CAIRO_PATH_MOVE_TO, &points[0]);
+  if (count == 1) {
+    // a dot, round caps make it a disc.
+    path_data_point(&data, CAIRO_PATH_LINE_TO, &points[0]);
+  } else if (count == 2) {
+    path_data_point(&data, CAIRO_PATH_LINE_TO, &points[1]);
+  } else {
+    for (int i = 1; i < count; ++i) {
+      Point h1, h2;
+      if (i == 1) {
+        create_handle_triple(&points[0], &points[1], &points[2], &h1, &h2);
+      } else if (i < count - 1) {
+        create_handle_quad(&points[i - 2], &points[i - 1], &points[i], &points[i + 1], &h1, &h2);
+      } else {
+        // the first segment's handles, walking the stroke backwards.
+        create_handle_triple(&points[i], &points[i - 1], &points[i - 2], &h2, &h1);
+      }
+      path_data_curve_to(&data, h1, h2, &points[i]);
+    }
+  }
+  path->num_data = data - path->data;
+  return path;
+}
+
+// build the stroke read into worker->points, false if out of memory.
+static bool worker_add_stroke(ImportWorker *worker, unsigned int color, double width) {
+  if (worker->points_count == 0 || !(width > 0)) {
+    worker->skipped++;
+    return true;
+  }
+
+  if (worker->count == worker->capacity) {
+    int capacity = worker->capacity == 0 ? 1024 : worker->capacity * 2;
+    Path **paths = realloc(worker->paths, sizeof(Path *) * capacity);
+    if (paths == NULL) {
+      return false;
+    }
+    worker->paths = paths;
+    worker->capacity = capacity;
+  }
+
+  cairo_path_t *smooth = import_smooth(worker->points, worker->points_count);
+  Path *path = smooth != NULL ? path_create(smooth, color, width) : NULL;
+  if (path == NULL) {
+    return false;
+  }
+  worker->paths[worker->count++] = path;
+  return true;
+}
+
+// where the value of "key" starts in a json object, NULL if it's missing.
+static const char *json_value(const char *line, const char *key) {
+  char quoted[32];
+  snprintf(quoted, sizeof(quoted), "\"%s\"", key);
+  const char *value = strstr(line, quoted);
+  if (value == NULL) {
+    return NULL;
+  }
+
+  value += strlen(quoted);
+  while (*value == ' ' || *value == '\t' || *value == ':') {
+    ++value;
+  }
+  return value;
+}
+
+// a number or a string holding one: "0xAARRGGBB", "#RRGGBB" or "#AARRGGBB".
+static unsigned int json_color(const char *value) {
+  bool quoted = *value == '"';
+  value += quoted;
+  if (*value == '#') {
+    char *end;
+    unsigned long color = strtoul(value + 1, &end, 16);
+    return end - value - 1 <= 6 ? (unsigned int)color | A_MASK : (unsigned int)color;
+  }
+  return (unsigned int)strtoul(value, NULL, 0);
+}
+
+static bool worker_parse_json(ImportWorker *worker, char *line) {
+  const char *points = json_value(line, "points");
+  if (points == NULL || *points != '[') {
+    // blank lines are fine, anything else is a stroke that went missing.
+    worker->skipped += strspn(line, " \t\r") != strlen(line);
+    return true;
+  }
+
+  const char *value = json_value(line, "color");
+  unsigned int color = value != NULL ? json_color(value) : COLOR_PRIMARY;
+  value = json_value(line, "width");
+  double width = value != NULL ? strtod(value, NULL) : STROKE_WIDTH_MEDIUM;
+
+  // every number inside the brackets, nested pairs or flat, x then y.
+  worker->points_count = 0;
+  double pending = 0;
+  bool has_pending = false;
+  int depth = 0;
+  const char *c = points;
+  do {
+    if (*c == '[') {
+      ++depth;
+    } else if (*c == ']') {
+      --depth;
+    } else if (*c == '-' || *c == '.' || (*c >= '0' && *c <= '9')) {
+      char *end;
+      double number = strtod(c, &end);
+      if (end == c) {
+        // a sign or dot that starts no number, the stroke is malformed.
+        worker->skipped++;
+        return true;
+      }
+      if (has_pending && !worker_push_point(worker, pending, number)) {
+        return false;
+      }
+      pending = number;
+      has_pending = !has_pending;
+      c = end;
+      continue;
+    }
+    ++c;
+  } while (depth > 0 && *c != '\0');
+  return worker_add_stroke(worker, color, width);
+}
+
+#define RECORD_HEADER_SIZE (3 * sizeof(uint32_t))
+
+// bytes of the binary record at data, 0 if it runs past end.
+static size_t record_size(const char *data, const char *end) {
+  if ((size_t)(end - data) < RECORD_HEADER_SIZE) {
+    return 0;
+  }
+  uint32_t count;
+  memcpy(&count, data + 2 * sizeof(uint32_t), sizeof(count));
+  size_t size = RECORD_HEADER_SIZE + (size_t)count * 2 * sizeof(float);
+  return size <= (size_t)(end - data) ? size : 0;
+}
+
+static bool worker_parse_record(ImportWorker *worker, const char *data) {
+  uint32_t color;
+  float width;
+  uint32_t count;
+  memcpy(&color, data, sizeof(color));
+  memcpy(&width, data + sizeof(uint32_t), sizeof(width));
+  memcpy(&count, data + 2 * sizeof(uint32_t), sizeof(count));
+
+  worker->points_count = 0;
+  const char *point = data + RECORD_HEADER_SIZE;
+  for (uint32_t i = 0; i < count; ++i) {
+    float xy[2];
+    memcpy(xy, point, sizeof(xy));
+    point += sizeof(xy);
+    if (!worker_push_point(worker, xy[0], xy[1])) {
+      return false;
+    }
+  }
+  return worker_add_stroke(worker, color, width);
+}
+
+static int worker_run(void *data) {
+  ImportWorker *worker = data;
+  char *cursor = worker->begin;
+  while (cursor < worker->end) {
+    bool added;
+    if (worker->binary) {
+      size_t size = record_size(cursor, worker->end);
+      if (size == 0) {
+        // a truncated feed, the rest is lost.
+        worker->skipped++;
+        break;
+      }
+      added = worker_parse_record(worker, cursor);
+      cursor += size;
+    } else {
+      char *newline = memchr(cursor, '\n', worker->end - cursor);
+      char *line_end = newline != NULL ? newline : worker->end;
+      *line_end = '\0';
+      added = worker_parse_json(worker, cursor);
+      cursor = line_end + 1;
+    }
+
+    if (!added) {
+      fprintf(stderr, "import: out of memory after %d strokes\n", worker->count);
+      break;
+    }
+  }
+
+  free(worker->points);
+  worker->points = NULL;
+  return 0;
+}
+
+// the whole file, NUL terminated so a json line at the very end can be
+// parsed in place.
+static char *read_feed(const char *filename, size_t *size) {
+  bool standard_input = strcmp(filename, "-") == 0;
+  FILE *file = standard_input ? stdin : fopen(filename, "rb");
+  if (file == NULL) {
+    return NULL;
+  }
+
+  size_t capacity = 1 << 20;
+  char *data = malloc(capacity);
+  *size = 0;
+  while (data != NULL) {
+    *size += fread(data + *size, 1, capacity - *size - 1, file);
+    if (*size < capacity - 1) {
+      break;
+    }
+    capacity *= 2;
+    char *tmp = realloc(data, capacity);
+    if (tmp == NULL) {
+      free(data);
+    }
+    data = tmp;
+  }
+
+  if (!standard_input) {
+    fclose(file);
+  }
+  if (data != NULL) {
+    data[*size] = '\0';
+  }
+  return data;
+}
+
+// cut the feed into slices of about the same size, on record boundaries.
+// returns the amount of slices.
+static int import_split(char *data, size_t size, bool binary, ImportWorker *workers) {
+  int threads = SDL_GetCPUCount();
+  threads = threads < 1 ? 1 : threads > IMPORT_MAX_THREADS ? IMPORT_MAX_THREADS : threads;
+  if (size / IMPORT_MIN_SPLIT + 1 < (size_t)threads) {
+    threads = size / IMPORT_MIN_SPLIT + 1;
+  }
+
+  char *end = data + size;
+  char *cursor = data;
+  int count = 0;
+  for (int i = 0; i < threads && cursor < end; ++i) {
+    char *target = i == threads - 1 ? end : data + size * (i + 1) / threads;
+    if (target < cursor) {
+      target = cursor;
+    }
+    char *slice_end = cursor;
+    if (binary) {
+      size_t record;
+      while (slice_end < target && (record = record_size(slice_end, end)) != 0) {
+        slice_end += record;
+      }
+      // keep a truncated tail with the last slice, which reports it.
+      if (slice_end < target) {
+        slice_end = end;
+      }
+    } else {
+      char *newline = target < end ? memchr(target, '\n', end - target) : NULL;
+      slice_end = newline != NULL ? newline + 1 : end;
+    }
+
+    workers[count++] = (ImportWorker){.begin = cursor, .end = slice_end, .binary = binary};
+    cursor = slice_end;
+  }
+  return count;
+}
+
+static int import_run(void *data) {
+  Import *import = data;
+
+  size_t size;
+  char *feed = read_feed(import->filename, &size);
+  if (feed == NULL) {
+    fprintf(stderr, "import: can't read %s\n", import->filename);
+    goto defer;
+  }
+
+  bool binary = size >= strlen(IMPORT_MAGIC) && memcmp(feed, IMPORT_MAGIC, strlen(IMPORT_MAGIC)) == 0;
+  size_t header = binary ? strlen(IMPORT_MAGIC) : 0;
+  ImportWorker workers[IMPORT_MAX_THREADS];
+  int count = import_split(feed + header, size - header, binary, workers);
+
+  // this thread takes the first slice, the rest get their own.
+  for (int i = 1; i < count; ++i) {
+    workers[i].thread = SDL_CreateThread(worker_run, "import", &workers[i]);
+    if (workers[i].thread == NULL) {
+      worker_run(&workers[i]);
+    }
+  }
+  if (count > 0) {
+    worker_run(&workers[0]);
+  }
+
+  int total = 0;
+  for (int i = 0; i < count; ++i) {
+    if (workers[i].thread != NULL) {
+      SDL_WaitThread(workers[i].thread, NULL);
+    }
+    total += workers[i].count;
+    import->skipped += workers[i].skipped;
+  }
+
+  // join the slices in feed order.
+  import->paths = malloc(sizeof(Path *) * (total > 0 ? total : 1));
+  for (int i = 0; i < count; ++i) {
+    for (int j = 0; j < workers[i].count; ++j) {
+      if (import->paths != NULL) {
+        import->paths[import->count++] = workers[i].paths[j];
+      } else {
+        path_free(workers[i].paths[j]);
+      }
+    }
+    free(workers[i].paths);
+  }
+  free(feed);
+
+defer:
+  SDL_AtomicSet(&import->done, 1);
+  if (import->wake != NULL) {
+    SDL_SemPost(import->wake);
+  }
+  return 0;
+}
+
+// read filename in the background, wake is posted once it's done.
+Import *import_start(const char *filename, SDL_sem *wake) {
+  Import *import = calloc(1, sizeof(Import));
+  if (import == NULL) {
+    return NULL;
+  }
+
+  import->filename = strdup(filename);
+  import->wake = wake;
+  if (import->filename == NULL) {
+    free(import);
+    return NULL;
+  }
+
+  import->thread = SDL_CreateThread(import_run, "import", import);
+  if (import->thread == NULL) {
+    import_run(import);
+  }
+  return import;
+}
+
+bool import_done(Import *import) {
+  return SDL_AtomicGet(&import->done) != 0;
+}
+
+// waits for the import to finish, the paths that weren't taken are freed.
+void import_free(Import *import) {
+  if (import == NULL) {
+    return;
+  }
+
+  if (import->thread != NULL) {
+    SDL_WaitThread(import->thread, NULL);
+  }
+  for (int i = 0; i < import->count; ++i) {
+    path_free(import->paths[i]);
+  }
+  free(import->paths);
+  free(import->filename);
+  free(import);
+}
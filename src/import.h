@@ -0,0 +1,44 @@
+#ifndef SB_IMPORT_H
+#define SB_IMPORT_H
+
+#include "path.h"
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+
+// threads parsing and smoothing a single feed, at most
+#define IMPORT_MAX_THREADS 16
+// a thread gets at least this many bytes of the feed
+#define IMPORT_MIN_SPLIT (64 * 1024)
+// first bytes of a binary feed
+#define IMPORT_MAGIC "SBS1"
+
+// strokes read from a file ("-" reads stdin) and built into paths off the
+// render thread. two feed formats are understood:
+//
+// json lines, a stroke per line, color and width are optional:
+//   {"color": "0xFFFF0000", "width": 3, "points": [[10, 20], [15.5, 22]]}
+// the points may also be a flat [x, y, x, y, ...] array.
+//
+// binary, IMPORT_MAGIC followed by little endian records:
+//   uint32 color, float32 width, uint32 point count, float32 x and y pairs
+//
+// points are board coordinates, colors 0xAARRGGBB like the pen.
+typedef struct Import {
+  char *filename;
+  SDL_Thread *thread;
+  SDL_sem *wake; // posted once the paths are built
+  SDL_atomic_t done;
+  // in feed order, handed over to the board by board_finish_imports()
+  Path **paths;
+  int count;
+  int skipped; // strokes that couldn't be read
+  struct Import *next;
+} Import;
+
+Import *import_start(const char *filename, SDL_sem *wake);
+bool import_done(Import *import);
+void import_free(Import *import);
+// the curves a pen drawing through points would leave, count > 0.
+cairo_path_t *import_smooth(Point *points, int count);
+
+#endif // SB_IMPORT_H
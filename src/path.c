@@ -1,20 +1,884 @@
 #include "path.h"
+#include "chunk.h"
+#include "sprite.h"
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 
+// encoded points per op, indexed by cairo_path_data_type_t
+static const int op_points[] = {1, 1, 3, 0};
+
+static bool fits_int16(int64_t value) {
+  return value >= INT16_MIN && value <= INT16_MAX;
+}
+
+static int32_t to_fixed(double value) {
+  return (int32_t)lround(value * PATH_FIXED_SCALE);
+}
+
+// whether a coordinate is in the range path_create() takes.
+bool path_coord_valid(double value) {
+  return isfinite(value) && fabs(value) <= PATH_COORD_MAX;
+}
+
+static bool path_in_range(cairo_path_t *path) {
+  for (int i = 0; i < path->num_data; i += path->data[i].header.length) {
+    for (int j = 1; j < path->data[i].header.length; ++j) {
+      if (!path_coord_valid(path->data[i + j].point.x) || !path_coord_valid(path->data[i + j].point.y)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// encode path as deltas, or only count ops and deltas when ops is NULL.
+// stroke segments are merged with a move_to before every segment,
+// a move_to to where the pen already is doesn't change anything and is dropped.
+static void geometry_encode_into(PathGeometry *g, cairo_path_t *path, uint8_t *ops, int16_t *deltas) {
+  int num_ops = 0;
+  int num_deltas = 0;
+  int32_t x = g->origin_x;
+  int32_t y = g->origin_y;
+  int32_t subpath_x = x;
+  int32_t subpath_y = y;
+  for (int i = 0; i < path->num_data; i += path->data[i].header.length) {
+    cairo_path_data_type_t type = path->data[i].header.type;
+    int points = op_points[type];
+
+    int32_t fixed[6];
+    bool wide = false;
+    int32_t previous_x = x;
+    int32_t previous_y = y;
+    for (int j = 0; j < points; ++j) {
+      fixed[2 * j] = to_fixed(path->data[i + j + 1].point.x);
+      fixed[2 * j + 1] = to_fixed(path->data[i + j + 1].point.y);
+      wide |= !fits_int16((int64_t)fixed[2 * j] - previous_x) || !fits_int16((int64_t)fixed[2 * j + 1] - previous_y);
+      previous_x = fixed[2 * j];
+      previous_y = fixed[2 * j + 1];
+    }
+
+    if (type == CAIRO_PATH_MOVE_TO && num_ops > 0 && fixed[0] == x && fixed[1] == y) {
+      continue;
+    }
+
+    if (ops != NULL) {
+      ops[num_ops] = type | (wide ? PATH_OP_WIDE : 0);
+    }
+    ++num_ops;
+
+    for (int j = 0; j < 2 * points; ++j) {
+      int64_t delta = (int64_t)fixed[j] - (j % 2 == 0 ? x : y);
+      if (j % 2 == 0) {
+        x = fixed[j];
+      } else {
+        y = fixed[j];
+      }
+
+      if (wide) {
+        if (deltas != NULL) {
+          uint32_t bits = (uint32_t)delta;
+          deltas[num_deltas] = (int16_t)(bits >> 16);
+          deltas[num_deltas + 1] = (int16_t)(bits & 0xFFFF);
+        }
+        num_deltas += 2;
+      } else {
+        if (deltas != NULL) {
+          deltas[num_deltas] = (int16_t)delta;
+        }
+        num_deltas += 1;
+      }
+    }
+
+    if (type == CAIRO_PATH_MOVE_TO) {
+      subpath_x = x;
+      subpath_y = y;
+    } else if (type == CAIRO_PATH_CLOSE_PATH) {
+      x = subpath_x;
+      y = subpath_y;
+    }
+  }
+
+  g->num_ops = num_ops;
+  g->num_deltas = num_deltas;
+}
+
+// takes ownership of path, which is destroyed once encoded.
+static bool geometry_encode(PathGeometry *g, cairo_path_t *path) {
+  g->origin_x = 0;
+  g->origin_y = 0;
+  if (path->num_data > 0 && path->data[0].header.length > 1) {
+    g->origin_x = to_fixed(path->data[1].point.x);
+    g->origin_y = to_fixed(path->data[1].point.y);
+  }
+
+  // ops and deltas share one block, deltas first to keep them aligned.
+  geometry_encode_into(g, path, NULL, NULL);
+  g->deltas = malloc(sizeof(int16_t) * g->num_deltas + g->num_ops + 1);
+  if (g->deltas == NULL) {
+    *g = (PathGeometry){0};
+    cairo_path_destroy(path);
+    return false;
+  }
+  g->ops = (uint8_t *)(g->deltas + g->num_deltas);
+  geometry_encode_into(g, path, g->ops, g->deltas);
+  cairo_path_destroy(path);
+  return true;
+}
+
+// walks the encoded ops of a path
+typedef struct {
+  int op;
+  int delta;
+  int64_t x;
+  int64_t y;
+  int64_t subpath_x;
+  int64_t subpath_y;
+} PathCursor;
+
+static int32_t read_delta(PathGeometry *geometry, PathCursor *cursor, bool wide) {
+  if (!wide) {
+    return geometry->deltas[cursor->delta++];
+  }
+
+  uint32_t high = (uint16_t)geometry->deltas[cursor->delta];
+  uint32_t low = (uint16_t)geometry->deltas[cursor->delta + 1];
+  cursor->delta += 2;
+  return (int32_t)(high << 16 | low);
+}
+
+// decode the next op into coords (x, y pairs in board coordinates).
+// returns its cairo_path_data_type_t, or -1 past the last op.
+static int path_next(PathGeometry *geometry, PathCursor *cursor, double coords[6]) {
+  if (cursor->op == geometry->num_ops) {
+    return -1;
+  }
+
+  uint8_t op = geometry->ops[cursor->op++];
+  int type = op & PATH_OP_TYPE;
+  bool wide = op & PATH_OP_WIDE;
+  for (int j = 0; j < op_points[type]; ++j) {
+    cursor->x += read_delta(geometry, cursor, wide);
+    cursor->y += read_delta(geometry, cursor, wide);
+    coords[2 * j] = (double)cursor->x / PATH_FIXED_SCALE;
+    coords[2 * j + 1] = (double)cursor->y / PATH_FIXED_SCALE;
+  }
+
+  if (type == CAIRO_PATH_MOVE_TO) {
+    cursor->subpath_x = cursor->x;
+    cursor->subpath_y = cursor->y;
+  } else if (type == CAIRO_PATH_CLOSE_PATH) {
+    cursor->x = cursor->subpath_x;
+    cursor->y = cursor->subpath_y;
+  }
+  return type;
+}
+
+// start at the origin of geometry, moved by a fixed point offset.
+static PathCursor path_cursor(PathGeometry *geometry, int32_t offset_x, int32_t offset_y) {
+  int64_t x = (int64_t)geometry->origin_x + offset_x;
+  int64_t y = (int64_t)geometry->origin_y + offset_y;
+  return (PathCursor){0, 0, x, y, x, y};
+}
+
+static PathShape *shape_create(double width) {
+  PathShape *shape = malloc(sizeof(PathShape));
+  if (shape == NULL) {
+    return NULL;
+  }
+
+  *shape = (PathShape){.refs = 1, .width = width};
+  return shape;
+}
+
+// drop the geometry and everything rendered from it.
+static void shape_clear(PathShape *shape) {
+  sprite_free(shape->sprite);
+  outline_free(shape->outline);
+  free(shape->geometry.deltas);
+  shape->geometry = (PathGeometry){0};
+}
+
+static void shape_release(PathShape *shape) {
+  if (--shape->refs > 0) {
+    return;
+  }
+
+  shape_clear(shape);
+  free(shape);
+}
+
+// takes ownership of path, which is destroyed once encoded. NULL if a
+// point is out of range, see PATH_COORD_MAX, or out of memory.
 Path *path_create(cairo_path_t *path, unsigned int color, double width) {
+  if (!path_in_range(path)) {
+    cairo_path_destroy(path);
+    return NULL;
+  }
   Path *p = malloc(sizeof(Path));
-  if (p == NULL) {
+  PathShape *shape = shape_create(width);
+  if (p == NULL || shape == NULL) {
+    free(p);
+    free(shape);
+    cairo_path_destroy(path);
     return NULL;
   }
 
-  p->path = path;
+  p->shape = shape;
+  p->offset_x = 0;
+  p->offset_y = 0;
   p->color = color;
   p->width = width;
+  p->matrix = NULL;
+  p->chunk = NULL;
+  p->chunk_index = 0;
+  p->id = 0;
+
+  // the stroke reaches half its width past the path in every direction,
+  // plus the rounding of the fixed point coordinates.
+  path_extents(path, &p->top_left, &p->bottom_right);
+  double pad = width / 2 + 1.0 / PATH_FIXED_SCALE;
+  p->top_left.x -= pad;
+  p->top_left.y -= pad;
+  p->bottom_right.x += pad;
+  p->bottom_right.y += pad;
+
+  if (!geometry_encode(&shape->geometry, path)) {
+    free(shape);
+    free(p);
+    return NULL;
+  }
   return p;
 }
 
 void path_free(Path *path) {
-  cairo_path_destroy(path->path);
+  chunk_remove(path);
+  shape_release(path->shape);
   free(path);
 }
+
+// bytes held by path, including its geometry. a shape shared by several
+// copies is split between them, so every shape is counted once in total.
+size_t path_memory_usage(Path *path) {
+  PathShape *shape = path->shape;
+  size_t shape_size = sizeof(PathShape) + sizeof(int16_t) * shape->geometry.num_deltas + shape->geometry.num_ops;
+  return sizeof(Path) + shape_size / shape->refs;
+}
+
+static void geometry_append(PathGeometry *geometry, cairo_t *cr, int32_t offset_x, int32_t offset_y) {
+  PathCursor cursor = path_cursor(geometry, offset_x, offset_y);
+  double c[6];
+  int type;
+  while ((type = path_next(geometry, &cursor, c)) != -1) {
+    switch (type) {
+    case CAIRO_PATH_MOVE_TO:
+      cairo_move_to(cr, c[0], c[1]);
+      break;
+    case CAIRO_PATH_LINE_TO:
+      cairo_line_to(cr, c[0], c[1]);
+      break;
+    case CAIRO_PATH_CURVE_TO:
+      cairo_curve_to(cr, c[0], c[1], c[2], c[3], c[4], c[5]);
+      break;
+    case CAIRO_PATH_CLOSE_PATH:
+      cairo_close_path(cr);
+      break;
+    }
+  }
+}
+
+// page the geometry back in if its chunk was evicted. a path added to the
+// chunk since then, or sharing its shape with paths elsewhere, is still in memory.
+static void path_load(Path *path) {
+  Chunk *chunk = path->chunk;
+  if (chunk != NULL && !chunk->resident && path->chunk_index < chunk->stored &&
+      path->shape->geometry.deltas == NULL) {
+    chunk_load(chunk);
+  }
+}
+
+// a copy of path moved by (dx, dy), with its own color and width. the
+// geometry isn't copied, both share it, along with its outline and sprite
+// as long as the width is the same. the move is rounded to the precision
+// of the geometry. NULL if the copy would leave the range of coordinates.
+Path *path_copy(Path *path, double dx, double dy, unsigned int color, double width) {
+  if (!path_coord_valid(path->top_left.x + dx) || !path_coord_valid(path->top_left.y + dy) ||
+      !path_coord_valid(path->bottom_right.x + dx) || !path_coord_valid(path->bottom_right.y + dy)) {
+    return NULL;
+  }
+  path_load(path);
+  Path *copy = malloc(sizeof(Path));
+  if (copy == NULL) {
+    return NULL;
+  }
+
+  int32_t offset_x = to_fixed(dx);
+  int32_t offset_y = to_fixed(dy);
+  double shift_x = (double)offset_x / PATH_FIXED_SCALE;
+  double shift_y = (double)offset_y / PATH_FIXED_SCALE;
+  // the bounds are padded by half the width, see path_create().
+  double grow = (width - path->width) / 2;
+
+  *copy = *path;
+  copy->offset_x += offset_x;
+  copy->offset_y += offset_y;
+  copy->color = color;
+  copy->width = width;
+  copy->top_left.x += shift_x - grow;
+  copy->top_left.y += shift_y - grow;
+  copy->bottom_right.x += shift_x + grow;
+  copy->bottom_right.y += shift_y + grow;
+  copy->matrix = NULL;
+  copy->chunk = NULL;
+  copy->chunk_index = 0;
+  copy->id = 0;
+  copy->shape->refs++;
+  return copy;
+}
+
+// replay the geometry into the current path of cr.
+void path_append(Path *path, cairo_t *cr) {
+  path_load(path);
+  geometry_append(&path->shape->geometry, cr, path->offset_x, path->offset_y);
+}
+
+// a disc at every vertex where the outline of two segments leaves a gap
+// deeper than this, in pixels. cairo flattens curves with the same tolerance.
+#define OUTLINE_TOLERANCE 0.1
+
+static void outline_disc(cairo_t *cr, double x, double y, double radius) {
+  cairo_new_sub_path(cr);
+  cairo_arc(cr, x, y, radius, 0, 2 * M_PI);
+  cairo_close_path(cr);
+}
+
+// a round capped, round joined stroke covers the union of a rectangle per
+// segment and a disc per vertex. every shape winds the same way, so filling
+// them with the winding rule gives back the stroked area.
+static cairo_path_t *outline_build(PathShape *shape, cairo_t *cr) {
+  cairo_new_path(cr);
+  geometry_append(&shape->geometry, cr, 0, 0);
+  cairo_path_t *flat = cairo_copy_path_flat(cr);
+  cairo_new_path(cr);
+  if (flat->status != CAIRO_STATUS_SUCCESS) {
+    cairo_path_destroy(flat);
+    return NULL;
+  }
+
+  double radius = shape->width / 2;
+  Point start = {0, 0};
+  Point previous = {0, 0};
+  // direction of the last segment, zero at the start of a subpath
+  Point direction = {0, 0};
+  for (int i = 0; i < flat->num_data; i += flat->data[i].header.length) {
+    cairo_path_data_t *data = &flat->data[i];
+    Point point = start;
+    switch (data->header.type) {
+    case CAIRO_PATH_MOVE_TO:
+      // the cap of the subpath that ends here.
+      if (direction.x != 0 || direction.y != 0) {
+        outline_disc(cr, previous.x, previous.y, radius);
+      }
+      start = (Point){data[1].point.x, data[1].point.y};
+      previous = start;
+      direction = (Point){0, 0};
+      // the cap at the start, which is all of a single dot.
+      outline_disc(cr, start.x, start.y, radius);
+      continue;
+    case CAIRO_PATH_LINE_TO:
+      point = (Point){data[1].point.x, data[1].point.y};
+      break;
+    case CAIRO_PATH_CLOSE_PATH:
+      break;
+    case CAIRO_PATH_CURVE_TO:
+      // a flat path has no curves.
+      continue;
+    }
+
+    Point segment = point_subtruct(point, previous);
+    double length = point_length(segment);
+    if (length == 0) {
+      continue;
+    }
+    Point unit = point_multiply(segment, 1 / length);
+
+    // a join only needs its disc where the turn opens a visible gap.
+    if (direction.x != 0 || direction.y != 0) {
+      double cos_turn = fmax(-1, fmin(1, unit.x * direction.x + unit.y * direction.y));
+      if (radius * (1 - sqrt((1 + cos_turn) / 2)) > OUTLINE_TOLERANCE) {
+        outline_disc(cr, previous.x, previous.y, radius);
+      }
+    }
+
+    // wound like cairo_arc().
+    Point normal = {-unit.y * radius, unit.x * radius};
+    cairo_move_to(cr, previous.x - normal.x, previous.y - normal.y);
+    cairo_line_to(cr, point.x - normal.x, point.y - normal.y);
+    cairo_line_to(cr, point.x + normal.x, point.y + normal.y);
+    cairo_line_to(cr, previous.x + normal.x, previous.y + normal.y);
+    cairo_close_path(cr);
+
+    previous = point;
+    direction = unit;
+  }
+  if (direction.x != 0 || direction.y != 0) {
+    outline_disc(cr, previous.x, previous.y, radius);
+  }
+  cairo_path_destroy(flat);
+
+  cairo_path_t *outline = cairo_copy_path(cr);
+  cairo_new_path(cr);
+  return outline;
+}
+
+OutlineCache *outline_cache_create(size_t capacity) {
+  OutlineCache *cache = malloc(sizeof(OutlineCache));
+  if (cache == NULL) {
+    return NULL;
+  }
+
+  cache->head = NULL;
+  cache->tail = NULL;
+  cache->size = 0;
+  cache->capacity = capacity;
+  return cache;
+}
+
+static void outline_unlink(Outline *outline) {
+  OutlineCache *cache = outline->cache;
+  if (outline->prev != NULL) {
+    outline->prev->next = outline->next;
+  } else {
+    cache->head = outline->next;
+  }
+
+  if (outline->next != NULL) {
+    outline->next->prev = outline->prev;
+  } else {
+    cache->tail = outline->prev;
+  }
+  outline->prev = NULL;
+  outline->next = NULL;
+}
+
+static void outline_push_front(Outline *outline) {
+  OutlineCache *cache = outline->cache;
+  outline->prev = NULL;
+  outline->next = cache->head;
+  if (cache->head != NULL) {
+    cache->head->prev = outline;
+  } else {
+    cache->tail = outline;
+  }
+  cache->head = outline;
+}
+
+// also called when a shape is freed or paged out, it takes its outline along.
+void outline_free(Outline *outline) {
+  if (outline == NULL) {
+    return;
+  }
+
+  outline_unlink(outline);
+  outline->cache->size -= outline->size;
+  outline->shape->outline = NULL;
+  free(outline->geometry.deltas);
+  free(outline);
+}
+
+void outline_cache_free(OutlineCache *cache) {
+  if (cache == NULL) {
+    return;
+  }
+
+  while (cache->head != NULL) {
+    outline_free(cache->head);
+  }
+  free(cache);
+}
+
+// the outline of shape, built and cached if it isn't yet. NULL if it
+// doesn't fit the cache or out of memory.
+static Outline *outline_get(OutlineCache *cache, PathShape *shape, cairo_t *cr) {
+  Outline *outline = shape->outline;
+  if (outline != NULL) {
+    if (outline != cache->head) {
+      outline_unlink(outline);
+      outline_push_front(outline);
+    }
+    return outline;
+  }
+
+  outline = malloc(sizeof(Outline));
+  cairo_path_t *built = outline != NULL ? outline_build(shape, cr) : NULL;
+  if (built == NULL || !geometry_encode(&outline->geometry, built)) {
+    free(outline);
+    return NULL;
+  }
+  outline->cache = cache;
+  outline->shape = shape;
+  outline->size = sizeof(Outline) + sizeof(int16_t) * outline->geometry.num_deltas + outline->geometry.num_ops;
+  outline->prev = NULL;
+  outline->next = NULL;
+  if (outline->size > cache->capacity) {
+    free(outline->geometry.deltas);
+    free(outline);
+    return NULL;
+  }
+
+  // make room by evicting the least recently drawn outlines.
+  while (cache->tail != NULL && cache->size + outline->size > cache->capacity) {
+    outline_free(cache->tail);
+  }
+  shape->outline = outline;
+  cache->size += outline->size;
+  outline_push_front(outline);
+  return outline;
+}
+
+// fill the stroked outline of path with the current source, from cache so
+// redraws skip the stroker altogether. without a cache, or for a copy at
+// another width, the geometry is stroked as usual. the outline is built in
+// the user space of cr, call this before applying path->matrix.
+void path_fill(Path *path, OutlineCache *cache, cairo_t *cr) {
+  path_load(path);
+  PathShape *shape = path->shape;
+  Outline *outline = NULL;
+  if (cache != NULL && cache->capacity > 0 && path->width == shape->width) {
+    outline = outline_get(cache, shape, cr);
+  }
+
+  cairo_new_path(cr);
+  if (path->matrix != NULL) {
+    cairo_save(cr);
+    cairo_transform(cr, path->matrix);
+  }
+
+  if (outline != NULL) {
+    geometry_append(&outline->geometry, cr, path->offset_x, path->offset_y);
+    cairo_fill(cr);
+  } else {
+    geometry_append(&shape->geometry, cr, path->offset_x, path->offset_y);
+    cairo_set_line_width(cr, path->width);
+    cairo_stroke(cr);
+  }
+
+  if (path->matrix != NULL) {
+    cairo_restore(cr);
+  }
+}
+
+// decode the geometry into a newly allocated cairo path.
+cairo_path_t *path_decode(Path *path) {
+  path_load(path);
+  PathGeometry *geometry = &path->shape->geometry;
+  int num_data = 0;
+  for (int i = 0; i < geometry->num_ops; ++i) {
+    num_data += 1 + op_points[geometry->ops[i] & PATH_OP_TYPE];
+  }
+
+  cairo_path_t *decoded = malloc(sizeof(cairo_path_t));
+  if (decoded == NULL) {
+    return NULL;
+  }
+  decoded->status = CAIRO_STATUS_SUCCESS;
+  decoded->num_data = num_data;
+  decoded->data = malloc(sizeof(cairo_path_data_t) * (num_data > 0 ? num_data : 1));
+  if (decoded->data == NULL) {
+    free(decoded);
+    return NULL;
+  }
+
+  PathCursor cursor = path_cursor(geometry, path->offset_x, path->offset_y);
+  double c[6];
+  int type;
+  cairo_path_data_t *data = decoded->data;
+  while ((type = path_next(geometry, &cursor, c)) != -1) {
+    int points = op_points[type];
+    data->header.type = type;
+    data->header.length = 1 + points;
+    for (int j = 0; j < points; ++j) {
+      data[1 + j].point.x = c[2 * j];
+      data[1 + j].point.y = c[2 * j + 1];
+    }
+    data += 1 + points;
+  }
+  return decoded;
+}
+
+Path *path_bake(Path *path) {
+  // decode the geometry and apply the pending transform to every point.
+  // affine transforms map bezier control points to the control points
+  // of the transformed curve, so transforming the points is exact.
+  cairo_path_t *baked = path_decode(path);
+  if (baked == NULL) {
+    return NULL;
+  }
+
+  double width = path->width;
+  if (path->matrix != NULL) {
+    for (int i = 0; i < baked->num_data; i += baked->data[i].header.length) {
+      for (int j = 1; j < baked->data[i].header.length; ++j) {
+        cairo_path_data_t *point = &baked->data[i + j];
+        cairo_matrix_transform_point(path->matrix, &point->point.x, &point->point.y);
+      }
+    }
+
+    // the stroke is drawn inside the transform, so its width scales too.
+    cairo_matrix_t *m = path->matrix;
+    width *= sqrt(fabs(m->xx * m->yy - m->xy * m->yx));
+  }
+
+  // not paged yet, whoever puts the result on the board adds it to a chunk.
+  Path *result = path_create(baked, path->color, width);
+  if (result != NULL) {
+    result->id = path->id;
+  }
+  return result;
+}
+
+void path_extents(cairo_path_t *path, Point *top_left, Point *bottom_right) {
+  // walk the raw points instead of asking cairo, no context is needed.
+  // a bezier curve is contained in the hull of its control points,
+  // so this may overestimate the extents but never miss any part.
+  // an empty path gets inverted extents that intersect nothing.
+  top_left->x = INFINITY;
+  top_left->y = INFINITY;
+  bottom_right->x = -INFINITY;
+  bottom_right->y = -INFINITY;
+  for (int i = 0; i < path->num_data; i += path->data[i].header.length) {
+    for (int j = 1; j < path->data[i].header.length; ++j) {
+      cairo_path_data_t *point = &path->data[i + j];
+      top_left->x = fmin(top_left->x, point->point.x);
+      top_left->y = fmin(top_left->y, point->point.y);
+      bottom_right->x = fmax(bottom_right->x, point->point.x);
+      bottom_right->y = fmax(bottom_right->y, point->point.y);
+    }
+  }
+}
+
+bool path_intersects_rect(Path *path, Point top_left, Point bottom_right) {
+  return path->top_left.x <= bottom_right.x && path->bottom_right.x >= top_left.x &&
+         path->top_left.y <= bottom_right.y && path->bottom_right.y >= top_left.y;
+}
+
+// geometries are stored as origin, op and delta counts and the ops and deltas
+// block. an absent geometry (one that didn't fit in memory) has -1 ops.
+#define GEOMETRY_HEADER_SIZE (4 * sizeof(int32_t))
+
+static size_t geometry_block_size(PathGeometry *g) {
+  return sizeof(int16_t) * g->num_deltas + g->num_ops;
+}
+
+static unsigned char *geometry_store(PathGeometry *g, unsigned char *buffer) {
+  int32_t header[4] = {g->origin_x, g->origin_y, g->deltas != NULL ? g->num_ops : -1, g->num_deltas};
+  memcpy(buffer, header, GEOMETRY_HEADER_SIZE);
+  buffer += GEOMETRY_HEADER_SIZE;
+  if (g->deltas != NULL) {
+    memcpy(buffer, g->deltas, geometry_block_size(g));
+    buffer += geometry_block_size(g);
+  }
+  return buffer;
+}
+
+static const unsigned char *geometry_restore(PathGeometry *g, const unsigned char *buffer) {
+  int32_t header[4];
+  memcpy(header, buffer, GEOMETRY_HEADER_SIZE);
+  buffer += GEOMETRY_HEADER_SIZE;
+  *g = (PathGeometry){.origin_x = header[0], .origin_y = header[1]};
+  if (header[2] < 0) {
+    return buffer;
+  }
+
+  PathGeometry stored = {.num_ops = header[2], .num_deltas = header[3]};
+  size_t size = geometry_block_size(&stored);
+  // out of memory leaves the geometry empty, the stroke is just not drawn.
+  g->deltas = malloc(size + 1);
+  if (g->deltas != NULL) {
+    memcpy(g->deltas, buffer, size);
+    g->num_ops = stored.num_ops;
+    g->num_deltas = stored.num_deltas;
+    g->ops = (uint8_t *)(g->deltas + g->num_deltas);
+  }
+  return buffer + size;
+}
+
+// bytes path_store() writes for path.
+size_t path_stored_size(Path *path) {
+  return GEOMETRY_HEADER_SIZE + geometry_block_size(&path->shape->geometry);
+}
+
+// write the geometry of path to buffer, returns the end of what was written.
+// the outline isn't, it is rebuilt if the stroke is drawn again. the offset
+// of a copy stays with the path.
+unsigned char *path_store(Path *path, unsigned char *buffer) {
+  return geometry_store(&path->shape->geometry, buffer);
+}
+
+// read back what path_store() wrote, returns the end of what was read.
+const unsigned char *path_restore(Path *path, const unsigned char *buffer) {
+  PathGeometry geometry;
+  buffer = geometry_restore(&geometry, buffer);
+
+  // a shape that couldn't be left behind by path_evict() is still whole.
+  PathShape *shape = path->shape;
+  if (shape->geometry.deltas != NULL) {
+    free(geometry.deltas);
+    return buffer;
+  }
+  shape->geometry = geometry;
+  return buffer;
+}
+
+// drop the geometry and everything rendered from it. the bounds, color and
+// width stay, so an evicted path is still culled without paging it in.
+// the copies sharing the shape are left without it too, they are paged out
+// along with path, see chunk_evict(). the first one read back restores it.
+void path_evict(Path *path) {
+  shape_clear(path->shape);
+}
+
+// a path is packed as its id, color, width, bounds and geometry, the copy
+// offset folded into the origin. the outline is left out, it is rebuilt on
+// demand. every field is in host byte order.
+typedef struct PathHeader {
+  uint64_t id;
+  uint32_t color;
+  int32_t num_ops;
+  double width;
+  double bounds[4];
+  int32_t origin_x;
+  int32_t origin_y;
+  int32_t num_deltas;
+} PathHeader;
+
+// bytes path_pack() writes for path.
+size_t path_packed_size(Path *path) {
+  path_load(path);
+  return sizeof(PathHeader) + geometry_block_size(&path->shape->geometry);
+}
+
+// write path to buffer, which holds path_packed_size() bytes. returns the
+// end of what was written.
+unsigned char *path_pack(Path *path, unsigned char *buffer) {
+  path_load(path);
+  PathGeometry *geometry = &path->shape->geometry;
+  // the padding is sent along, don't leak what the stack held.
+  PathHeader header;
+  memset(&header, 0, sizeof(header));
+  header.id = path->id;
+  header.color = path->color;
+  header.num_ops = geometry->num_ops;
+  header.width = path->width;
+  header.bounds[0] = path->top_left.x;
+  header.bounds[1] = path->top_left.y;
+  header.bounds[2] = path->bottom_right.x;
+  header.bounds[3] = path->bottom_right.y;
+  header.origin_x = geometry->origin_x + path->offset_x;
+  header.origin_y = geometry->origin_y + path->offset_y;
+  header.num_deltas = geometry->num_deltas;
+  memcpy(buffer, &header, sizeof(header));
+  buffer += sizeof(header);
+  memcpy(buffer, geometry->deltas, sizeof(int16_t) * geometry->num_deltas);
+  buffer += sizeof(int16_t) * geometry->num_deltas;
+  memcpy(buffer, geometry->ops, geometry->num_ops);
+  return buffer + geometry->num_ops;
+}
+
+// whether every point of the geometry is within PATH_COORD_MAX.
+static bool geometry_in_range(PathGeometry *geometry) {
+  int64_t limit = (int64_t)PATH_COORD_MAX * PATH_FIXED_SCALE;
+  PathCursor cursor = path_cursor(geometry, 0, 0);
+  if (llabs(cursor.x) > limit || llabs(cursor.y) > limit) {
+    return false;
+  }
+  while (cursor.op < geometry->num_ops) {
+    uint8_t op = geometry->ops[cursor.op++];
+    bool wide = op & PATH_OP_WIDE;
+    for (int j = 0; j < op_points[op & PATH_OP_TYPE]; ++j) {
+      cursor.x += read_delta(geometry, &cursor, wide);
+      cursor.y += read_delta(geometry, &cursor, wide);
+      if (llabs(cursor.x) > limit || llabs(cursor.y) > limit) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+// a new path from what path_pack() wrote, NULL if it doesn't add up or
+// out of memory. the path is checked, as it comes from another process.
+Path *path_unpack(const unsigned char *buffer, size_t size) {
+  PathHeader header;
+  if (size < sizeof(header)) {
+    return NULL;
+  }
+  memcpy(&header, buffer, sizeof(header));
+  buffer += sizeof(header);
+  if (header.num_ops < 0 || header.num_deltas < 0 ||
+      size - sizeof(header) != sizeof(int16_t) * (size_t)header.num_deltas + (size_t)header.num_ops ||
+      !(header.width > 0) || !isfinite(header.width)) {
+    return NULL;
+  }
+
+  // every op must take exactly its share of the deltas.
+  const uint8_t *ops = buffer + sizeof(int16_t) * header.num_deltas;
+  int64_t deltas = 0;
+  for (int i = 0; i < header.num_ops; ++i) {
+    if ((ops[i] & ~(PATH_OP_TYPE | PATH_OP_WIDE)) != 0) {
+      return NULL;
+    }
+    deltas += op_points[ops[i] & PATH_OP_TYPE] * 2 * (ops[i] & PATH_OP_WIDE ? 2 : 1);
+  }
+  if (deltas != header.num_deltas) {
+    return NULL;
+  }
+
+  // the bounds cull the path, they must be a real box. an empty path has
+  // the inverted ones path_extents() gives it whatever was sent.
+  double *bounds = header.bounds;
+  if (header.num_ops == 0) {
+    bounds[0] = bounds[1] = INFINITY;
+    bounds[2] = bounds[3] = -INFINITY;
+  } else if (!isfinite(bounds[0]) || !isfinite(bounds[1]) || !isfinite(bounds[2]) || !isfinite(bounds[3]) ||
+             bounds[0] > bounds[2] || bounds[1] > bounds[3]) {
+    return NULL;
+  }
+
+  Path *path = malloc(sizeof(Path));
+  PathShape *shape = shape_create(header.width);
+  if (path == NULL || shape == NULL) {
+    free(path);
+    free(shape);
+    return NULL;
+  }
+  shape->geometry = (PathGeometry){
+      .origin_x = header.origin_x,
+      .origin_y = header.origin_y,
+      .num_ops = header.num_ops,
+      .num_deltas = header.num_deltas,
+      .deltas = malloc(size - sizeof(header) + 1),
+  };
+  if (shape->geometry.deltas == NULL) {
+    free(shape);
+    free(path);
+    return NULL;
+  }
+  memcpy(shape->geometry.deltas, buffer, size - sizeof(header));
+  shape->geometry.ops = (uint8_t *)(shape->geometry.deltas + header.num_deltas);
+  if (!geometry_in_range(&shape->geometry)) {
+    shape_release(shape);
+    free(path);
+    return NULL;
+  }
+
+  *path = (Path){
+      .shape = shape,
+      .color = header.color,
+      .width = header.width,
+      .top_left = {header.bounds[0], header.bounds[1]},
+      .bottom_right = {header.bounds[2], header.bounds[3]},
+      .id = header.id,
+  };
+  return path;
+}
@@ -5,14 +5,108 @@
 #include "point.h"
 #include <cairo/cairo.h>
 #include <stdbool.h>
+#include <stdint.h>
+
+// coordinates are stored in fixed point with 1/PATH_FIXED_SCALE px precision
+#define PATH_FIXED_SCALE 16
+// board coordinates a stroke may reach, in px either way from the origin.
+// the fixed point difference of any two coordinates in range fits an int32.
+#define PATH_COORD_MAX (1 << 25)
+// an encoded op is a cairo_path_data_type_t, ops flagged wide store each
+// delta as two int16 (high, low) because it doesn't fit a single one.
+#define PATH_OP_TYPE 0x03
+#define PATH_OP_WIDE 0x80
+
+struct Sprite;
+struct Outline;
+struct Chunk;
+
+// compact path data, see path_create(). every point is stored as the
+// fixed point delta to the previous one, starting from the origin.
+typedef struct {
+  int32_t origin_x;
+  int32_t origin_y;
+  int num_ops;
+  int num_deltas;
+  uint8_t *ops;
+  int16_t *deltas;
+} PathGeometry;
+
+// encoded geometry shared by every copy of a stroke, see path_copy().
+// it never changes once encoded and is freed along with the last path
+// using it. paths live on the render thread, the count needs no lock.
+typedef struct PathShape {
+  int refs;
+  PathGeometry geometry;
+  // stroked outline of the geometry at width, owned by an OutlineCache.
+  // NULL if not cached.
+  struct Outline *outline;
+  double width;
+  // raster of small strokes, owned by a SpriteCache. NULL if not cached.
+  struct Sprite *sprite;
+} PathShape;
 
 typedef struct {
-  cairo_path_t *path;
+  PathShape *shape;
+  // fixed point translation of this copy from the shape
+  int32_t offset_x;
+  int32_t offset_y;
   unsigned int color; // store color as 0xRRGGBBAA
+  // the outline and the sprite of the shape are only used at its own width
   double width;
+  // bounding box of the stroked path, in board coordinates
+  Point top_left;
+  Point bottom_right;
+  // pending transform applied at draw time, NULL if there is none.
+  // the geometry itself is only rewritten by path_bake().
+  cairo_matrix_t *matrix;
+  // spatial chunk the path is paged in and out with, NULL if always resident.
+  struct Chunk *chunk;
+  int chunk_index;
+  // names the stroke to boards shared with other instances, 0 until it is
+  // first sent. a baked path keeps the id of the stroke it was baked from.
+  uint64_t id;
 } Path;
 
+// stroked outline of a shape at its width, filled instead of stroking the
+// geometry. only the outlines of the strokes drawn most recently are kept.
+typedef struct Outline {
+  struct OutlineCache *cache;
+  PathShape *shape;
+  PathGeometry geometry;
+  size_t size; // bytes
+  // least recently drawn order
+  struct Outline *prev;
+  struct Outline *next;
+} Outline;
+
+typedef struct OutlineCache {
+  Outline *head; // most recently drawn
+  Outline *tail; // next to be evicted
+  size_t size;
+  size_t capacity;
+} OutlineCache;
+
+OutlineCache *outline_cache_create(size_t capacity);
+void outline_cache_free(OutlineCache *cache);
+void outline_free(Outline *outline);
+bool path_coord_valid(double value);
 Path *path_create(cairo_path_t *path, unsigned int color, double width);
 void path_free(Path *path);
+Path *path_copy(Path *path, double dx, double dy, unsigned int color, double width);
+void path_append(Path *path, cairo_t *cr);
+void path_fill(Path *path, OutlineCache *cache, cairo_t *cr);
+cairo_path_t *path_decode(Path *path);
+size_t path_memory_usage(Path *path);
+Path *path_bake(Path *path);
+void path_extents(cairo_path_t *path, Point *top_left, Point *bottom_right);
+bool path_intersects_rect(Path *path, Point top_left, Point bottom_right);
+size_t path_stored_size(Path *path);
+unsigned char *path_store(Path *path, unsigned char *buffer);
+const unsigned char *path_restore(Path *path, const unsigned char *buffer);
+void path_evict(Path *path);
+size_t path_packed_size(Path *path);
+unsigned char *path_pack(Path *path, unsigned char *buffer);
+Path *path_unpack(const unsigned char *buffer, size_t size);
 
 #endif
@@ -73,14 +73,57 @@ pdll *pdll_init(pdll_free_node_data_func free_data) {
   list->free_data = free_data;
   list->latest_version = 0;
   list->capacity = INIT_CAPACITY;
+  list->changes = 0;
+  list->transaction_depth = 0;
+  list->pending = NULL;
+  list->pending_count = 0;
+  list->pending_capacity = 0;
+  list->observe = NULL;
+  list->observe_context = NULL;
   return list;
 }
 
-bool pdll_append(pdll *list, void *data) {
-  if (list == NULL) {
-    return false;
+// observe is called for every change to the list once it can't fail
+// anymore, with the appended data for PDLL_APPEND. the nodes a deletion,
+// replacement or commit applies to are still marked in the latest version
+// when it is called. a commit that fails is reported as PDLL_ROLLBACK.
+void pdll_observe(pdll *list, pdll_observe_func observe, void *context) {
+  list->observe = observe;
+  list->observe_context = context;
+}
+
+static void pdll_notify(pdll *list, pdll_event event, void *data) {
+  if (list->observe != NULL) {
+    list->observe(list, event, data, list->observe_context);
+  }
+}
+
+static void pdll_clear_marks(pdll *list) {
+  pdll_version *current_version = &list->versions[list->latest_version];
+  for (pdll_node *node = current_version->head; node != NULL;
+       node = node == current_version->tail ? NULL : node->next) {
+    node->to_delete = false;
   }
+}
 
+// a version created by appends on a non-empty version shares every node but
+// the appended ones at its end with the previous version, any other version
+// owns all of them. the shared nodes are older than the version.
+static pdll_node *pdll_version_first_owned(pdll *list, size_t version) {
+  pdll_version *current_version = &list->versions[version];
+  if (version > 0 && current_version->head != NULL && current_version->head == list->versions[version - 1].head) {
+    pdll_node *node = current_version->tail;
+    while (node->prev != NULL && node->prev->version == version) {
+      node = node->prev;
+    }
+    return node;
+  }
+  return current_version->head;
+}
+
+// a new version with count data appended to the latest one. it shares
+// the nodes of the latest version and owns only the appended ones.
+static bool pdll_append_version(pdll *list, void **data, size_t count) {
   if (pdll_ensure_capacity(list) == false) {
     return false;
   }
@@ -91,18 +134,56 @@ bool pdll_append(pdll *list, void *data) {
   size_t new_version_idx = current_version_idx + 1;
   pdll_version *new_version = &list->versions[new_version_idx];
 
-  pdll_node *new_node = pdll_node_new(data, new_version_idx, current_version->tail, NULL);
-  if (new_node == NULL) {
-    return false;
+  pdll_node *first = NULL;
+  pdll_node *last = NULL;
+  for (size_t i = 0; i < count; ++i) {
+    pdll_node *new_node = pdll_node_new(data[i], new_version_idx, last, NULL);
+    if (new_node == NULL) {
+      new_version->head = first;
+      pdll_version_free(new_version);
+      return false;
+    }
+    if (last != NULL) {
+      last->next = new_node;
+    } else {
+      first = new_node;
+    }
+    last = new_node;
   }
 
-  new_version->head = current_version->head ? current_version->head : new_node;
-  new_version->tail = new_node;
+  new_version->head = current_version->head ? current_version->head : first;
+  new_version->tail = last;
+  first->prev = current_version->tail;
   if (current_version->tail) {
-    current_version->tail->next = new_node;
+    current_version->tail->next = first;
   }
 
   list->latest_version = new_version_idx;
+  list->changes++;
+  return true;
+}
+
+bool pdll_append(pdll *list, void *data) {
+  if (list == NULL) {
+    return false;
+  }
+
+  if (list->transaction_depth > 0) {
+    if (list->pending_count == list->pending_capacity) {
+      size_t new_capacity = list->pending_capacity > 0 ? list->pending_capacity * GROWTH_RATE : INIT_CAPACITY;
+      void **tmp = realloc(list->pending, sizeof(*tmp) * new_capacity);
+      if (tmp == NULL) {
+        return false;
+      }
+      list->pending = tmp;
+      list->pending_capacity = new_capacity;
+    }
+    list->pending[list->pending_count++] = data;
+  } else if (!pdll_append_version(list, &data, 1)) {
+    return false;
+  }
+
+  pdll_notify(list, PDLL_APPEND, data);
   return true;
 }
 
@@ -111,6 +192,11 @@ bool pdll_delete_marked_nodes(pdll *list) {
     return false;
   }
 
+  // the marks are applied by pdll_commit()
+  if (list->transaction_depth > 0) {
+    return true;
+  }
+
   if (pdll_ensure_capacity(list) == false) {
     return false;
   }
@@ -128,14 +214,13 @@ bool pdll_delete_marked_nodes(pdll *list) {
 
   while (node != NULL) {
     if (node->to_delete) {
-      // reset marking of current version
-      node->to_delete = false;
       goto next_iteration;
     }
 
     pdll_node *copy = pdll_node_new(node->data, new_version_idx, prev_copy, NULL);
     if (copy == NULL) {
       pdll_version_free(new_version);
+      pdll_clear_marks(list);
       return false;
     }
 
@@ -157,12 +242,132 @@ bool pdll_delete_marked_nodes(pdll *list) {
     node = node->next;
   }
 
+  pdll_notify(list, PDLL_DELETE, NULL);
+  pdll_clear_marks(list);
+  list->latest_version = new_version_idx;
+  list->changes++;
+  return true;
+}
+
+// create a new version where the data of every marked node is swapped for
+// replace(data). the new data belongs to the new version, the old data stays
+// with the versions before it, so undo brings it back.
+bool pdll_replace_marked_nodes(pdll *list, pdll_replace_node_data_func replace) {
+  if (list == NULL || list->transaction_depth > 0) {
+    return false;
+  }
+
+  if (pdll_ensure_capacity(list) == false) {
+    return false;
+  }
+
+  size_t current_version_idx = list->latest_version;
+  pdll_version *current_version = &list->versions[current_version_idx];
+
+  size_t new_version_idx = current_version_idx + 1;
+  pdll_version *new_version = &list->versions[new_version_idx];
+
+  new_version->head = NULL;
+  new_version->tail = NULL;
+  pdll_node *prev_copy = NULL;
+  pdll_node *node = current_version->head;
+
+  while (node != NULL) {
+    void *data = node->data;
+    size_t version = node->version;
+    if (node->to_delete) {
+      data = replace(node->data);
+      version = new_version_idx;
+    }
+
+    pdll_node *copy = data == NULL ? NULL : pdll_node_new(data, version, prev_copy, NULL);
+    if (copy == NULL) {
+      if (data != NULL && version == new_version_idx) {
+        list->free_data(data);
+      }
+      for (pdll_node *n = new_version->head; n != NULL; n = n->next) {
+        if (n->version == new_version_idx) {
+          list->free_data(n->data);
+        }
+      }
+      pdll_version_free(new_version);
+      pdll_clear_marks(list);
+      return false;
+    }
+
+    if (prev_copy != NULL) {
+      prev_copy->next = copy;
+    } else {
+      new_version->head = copy;
+    }
+    new_version->tail = copy;
+    prev_copy = copy;
+
+    if (node == current_version->tail) {
+      break;
+    }
+
+    node = node->next;
+  }
+
+  pdll_notify(list, PDLL_REPLACE, NULL);
+  pdll_clear_marks(list);
   list->latest_version = new_version_idx;
+  list->changes++;
+  return true;
+}
+
+// delete marked nodes from the latest version in place, without creating
+// a new version. this is only possible when the latest version owns all of
+// its nodes, i.e. it was created by pdll_delete_marked_nodes().
+bool pdll_amend_marked_nodes(pdll *list) {
+  if (list == NULL || list->transaction_depth > 0) {
+    return false;
+  }
+
+  if (list->latest_version == 0) {
+    return false;
+  }
+
+  pdll_version *current_version = &list->versions[list->latest_version];
+  pdll_version *previous_version = &list->versions[list->latest_version - 1];
+  if (current_version->head != NULL && current_version->head == previous_version->head) {
+    // this version shares its nodes with the previous one.
+    return false;
+  }
+  pdll_notify(list, PDLL_AMEND, NULL);
+  list->changes++;
+
+  pdll_node *node = current_version->head;
+  while (node != NULL) {
+    pdll_node *next = node == current_version->tail ? NULL : node->next;
+    if (node->to_delete) {
+      if (node->prev != NULL) {
+        node->prev->next = node->next;
+      } else {
+        current_version->head = node->next;
+      }
+
+      if (node->next != NULL) {
+        node->next->prev = node->prev;
+      } else {
+        current_version->tail = node->prev;
+      }
+
+      // data created by this very version is not referenced by any other.
+      if (node->version == list->latest_version) {
+        list->free_data(node->data);
+      }
+      free(node);
+    }
+    node = next;
+  }
+
   return true;
 }
 
 bool pdll_undo(pdll *list) {
-  if (list == NULL) {
+  if (list == NULL || list->transaction_depth > 0) {
     return false;
   }
 
@@ -170,19 +375,24 @@ bool pdll_undo(pdll *list) {
     return false;
   }
 
+  pdll_notify(list, PDLL_UNDO, NULL);
   pdll_version *current_version = &list->versions[list->latest_version];
   size_t previous_version_idx = list->latest_version - 1;
   pdll_version *previous_version = &list->versions[previous_version_idx];
 
-  if (current_version->head == previous_version->head) {
-    // this version was created from append on a non-empty version
-    // meaning that this version has at least 2 nodes.
-    // delete last node and free its data
-    pdll_node *tail = current_version->tail;
-    list->free_data(tail->data);
-    current_version->tail = tail->prev;
+  // two empty versions share a NULL head without sharing any node.
+  if (current_version->head != NULL && current_version->head == previous_version->head) {
+    // this version was created from appends on a non-empty version,
+    // delete the appended nodes and free their data.
+    pdll_node *node = pdll_version_first_owned(list, list->latest_version);
+    current_version->tail = node->prev;
     current_version->tail->next = NULL;
-    free(tail);
+    while (node != NULL) {
+      pdll_node *next = node->next;
+      list->free_data(node->data);
+      free(node);
+      node = next;
+    }
   } else {
     // this version was created from delete or an append on an empty version
     // delete all the nodes in this version,
@@ -203,14 +413,239 @@ bool pdll_undo(pdll *list) {
   }
 
   list->latest_version--;
+  list->changes++;
+  return true;
+}
+
+// group every append and deletion until the matching pdll_commit() into a
+// single version, so they are undone as one step. appended data is held
+// aside and marked nodes stay in the latest version until the commit, which
+// builds the new version in one pass over the list. calls nest, only the
+// outermost commit creates the version.
+bool pdll_begin(pdll *list) {
+  if (list == NULL) {
+    return false;
+  }
+
+  pdll_notify(list, PDLL_BEGIN, NULL);
+  ++list->transaction_depth;
+  return true;
+}
+
+static void pdll_drop_pending(pdll *list) {
+  for (size_t i = 0; i < list->pending_count; ++i) {
+    list->free_data(list->pending[i]);
+  }
+  free(list->pending);
+  list->pending = NULL;
+  list->pending_count = 0;
+  list->pending_capacity = 0;
+}
+
+// leave the transaction without a new version. the appended data is freed,
+// the marks are cleared.
+static void pdll_discard(pdll *list) {
+  list->transaction_depth = 0;
+  pdll_clear_marks(list);
+  pdll_drop_pending(list);
+}
+
+void pdll_rollback(pdll *list) {
+  if (list == NULL || list->transaction_depth == 0) {
+    return;
+  }
+
+  pdll_notify(list, PDLL_ROLLBACK, NULL);
+  pdll_discard(list);
+}
+
+// on failure the whole transaction is rolled back.
+bool pdll_commit(pdll *list) {
+  if (list == NULL || list->transaction_depth == 0) {
+    return false;
+  }
+
+  if (--list->transaction_depth > 0) {
+    pdll_notify(list, PDLL_COMMIT, NULL);
+    return true;
+  }
+
+  if (pdll_ensure_capacity(list) == false) {
+    pdll_notify(list, PDLL_ROLLBACK, NULL);
+    pdll_discard(list);
+    return false;
+  }
+
+  size_t current_version_idx = list->latest_version;
+  pdll_version *current_version = &list->versions[current_version_idx];
+  bool marked = false;
+  for (pdll_node *node = current_version->head; node != NULL && !marked;
+       node = node == current_version->tail ? NULL : node->next) {
+    marked = node->to_delete;
+  }
+
+  // nothing deleted, the appended data follows the shared nodes as usual.
+  if (!marked) {
+    bool appended = list->pending_count == 0 || pdll_append_version(list, list->pending, list->pending_count);
+    if (appended) {
+      list->pending_count = 0;
+    }
+    pdll_notify(list, appended ? PDLL_COMMIT : PDLL_ROLLBACK, NULL);
+    pdll_drop_pending(list);
+    return appended;
+  }
+
+  // like pdll_delete_marked_nodes(), the new version owns a copy of every
+  // node kept, followed by the appended data.
+  size_t new_version_idx = current_version_idx + 1;
+  pdll_version *new_version = &list->versions[new_version_idx];
+  new_version->head = NULL;
+  new_version->tail = NULL;
+  pdll_node *prev_copy = NULL;
+  pdll_node *node = current_version->head;
+  size_t appended = 0;
+  while (node != NULL || appended < list->pending_count) {
+    void *data;
+    size_t version;
+    if (node != NULL) {
+      bool skip = node->to_delete;
+      data = node->data;
+      version = node->version;
+      node = node == current_version->tail ? NULL : node->next;
+      if (skip) {
+        continue;
+      }
+    } else {
+      data = list->pending[appended++];
+      version = new_version_idx;
+    }
+
+    pdll_node *copy = pdll_node_new(data, version, prev_copy, NULL);
+    if (copy == NULL) {
+      pdll_version_free(new_version);
+      pdll_notify(list, PDLL_ROLLBACK, NULL);
+      pdll_discard(list);
+      return false;
+    }
+
+    if (prev_copy != NULL) {
+      prev_copy->next = copy;
+    } else {
+      new_version->head = copy;
+    }
+    new_version->tail = copy;
+    prev_copy = copy;
+  }
+
+  // the pending data now belongs to the version.
+  pdll_notify(list, PDLL_COMMIT, NULL);
+  list->pending_count = 0;
+  pdll_drop_pending(list);
+  pdll_clear_marks(list);
+  list->latest_version = new_version_idx;
+  list->changes++;
   return true;
 }
 
+// visit the data the latest version added or removed compared to the
+// previous one, i.e. everything an undo would make appear or disappear.
+void pdll_diff_latest(pdll *list, pdll_visit_node_data_func visit, void *context) {
+  if (list == NULL || list->latest_version == 0) {
+    return;
+  }
+
+  pdll_version *current_version = &list->versions[list->latest_version];
+  pdll_version *previous_version = &list->versions[list->latest_version - 1];
+  if (current_version->head != NULL && current_version->head == previous_version->head) {
+    // appends, only the nodes after the shared ones are new.
+    for (pdll_node *node = pdll_version_first_owned(list, list->latest_version); node != NULL;
+         node = node == current_version->tail ? NULL : node->next) {
+      visit(node->data, context);
+    }
+    return;
+  }
+
+  // every other version keeps the order of the previous one, minus the
+  // deleted nodes and with new data (created by this version) in place of
+  // the replaced ones. walk both in step.
+  pdll_node *current = current_version->head;
+  pdll_node *previous = previous_version->head;
+  while (previous != NULL) {
+    if (current != NULL && current->data == previous->data) {
+      current = current == current_version->tail ? NULL : current->next;
+    } else {
+      visit(previous->data, context);
+      if (current != NULL && current->version == list->latest_version) {
+        visit(current->data, context);
+        current = current == current_version->tail ? NULL : current->next;
+      }
+    }
+    previous = previous == previous_version->tail ? NULL : previous->next;
+  }
+
+  for (; current != NULL; current = current == current_version->tail ? NULL : current->next) {
+    visit(current->data, context);
+  }
+}
+
+// amount of nodes allocated by version, i.e. what it costs on top of the
+// versions before it.
+size_t pdll_version_nodes(pdll *list, size_t version) {
+  if (list == NULL || version > list->latest_version) {
+    return 0;
+  }
+
+  size_t count = 0;
+  pdll_version *current_version = &list->versions[version];
+  for (pdll_node *node = pdll_version_first_owned(list, version); node != NULL;
+       node = node == current_version->tail ? NULL : node->next) {
+    ++count;
+  }
+  return count;
+}
+
+// walk every version once. data is measured with data_size, which may be NULL
+// to only account for the list itself.
+void pdll_memory_usage(pdll *list, pdll_node_data_size_func data_size, pdll_memory *usage) {
+  usage->versions = 0;
+  usage->nodes = 0;
+  usage->live_data = 0;
+  usage->history_data = 0;
+  if (list == NULL) {
+    return;
+  }
+
+  usage->versions = sizeof(pdll) + sizeof(pdll_version) * list->capacity;
+  size_t total_data = 0;
+  for (size_t version = 0; version <= list->latest_version; ++version) {
+    pdll_version *current_version = &list->versions[version];
+    for (pdll_node *node = pdll_version_first_owned(list, version); node != NULL;
+         node = node == current_version->tail ? NULL : node->next) {
+      usage->nodes += sizeof(pdll_node);
+      // copies keep the version their data was created by,
+      // so every data is counted once, by that version.
+      if (data_size != NULL && node->version == version) {
+        total_data += data_size(node->data);
+      }
+    }
+  }
+
+  if (data_size != NULL) {
+    pdll_iter(list, node) {
+      usage->live_data += data_size(node->data);
+    }
+  }
+  usage->history_data = total_data - usage->live_data;
+}
+
 void pdll_free(pdll *list) {
   if (list == NULL) {
     return;
   }
 
+  // tearing the list down isn't a change anybody replays.
+  list->observe = NULL;
+  pdll_rollback(list);
   while (list->latest_version > 0) {
     pdll_undo(list);
   }
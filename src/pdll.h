@@ -5,6 +5,9 @@
 #include <stddef.h>
 
 typedef void (*pdll_free_node_data_func)(void *data);
+typedef void *(*pdll_replace_node_data_func)(void *data);
+typedef size_t (*pdll_node_data_size_func)(void *data);
+typedef void (*pdll_visit_node_data_func)(void *data, void *context);
 typedef struct pdll_node {
   void *data;
   size_t version;
@@ -18,19 +21,62 @@ typedef struct {
   pdll_node *tail;
 } pdll_version;
 
-typedef struct {
+// what changes, see pdll_observe()
+typedef enum {
+  PDLL_APPEND,
+  PDLL_DELETE,
+  PDLL_AMEND,
+  PDLL_REPLACE,
+  PDLL_UNDO,
+  PDLL_BEGIN,
+  PDLL_COMMIT,
+  PDLL_ROLLBACK,
+} pdll_event;
+
+struct pdll;
+typedef void (*pdll_observe_func)(struct pdll *list, pdll_event event, void *data, void *context);
+
+typedef struct pdll {
   pdll_version *versions;
   pdll_free_node_data_func free_data;
   size_t latest_version;
   size_t capacity;
+  // bumped by every change to the latest version. version numbers are
+  // reused after an undo, this tells two states apart.
+  size_t changes;
+  // open pdll_begin() calls, and the data appended since the outermost one
+  int transaction_depth;
+  void **pending;
+  size_t pending_count;
+  size_t pending_capacity;
+  // told about every change that is made, NULL if nobody listens
+  pdll_observe_func observe;
+  void *observe_context;
 } pdll;
 
+// bytes held by a list, see pdll_memory_usage()
+typedef struct {
+  size_t versions;     // version table
+  size_t nodes;        // nodes of every version
+  size_t live_data;    // data reachable from the latest version
+  size_t history_data; // data only reachable through undo
+} pdll_memory;
+
 pdll *pdll_init(pdll_free_node_data_func free_data);
 void pdll_free(pdll *list);
 bool pdll_append(pdll *list, void *data);
 void pdll_node_mark_for_deletion(pdll_node *node);
 bool pdll_delete_marked_nodes(pdll *list);
+bool pdll_amend_marked_nodes(pdll *list);
+bool pdll_replace_marked_nodes(pdll *list, pdll_replace_node_data_func replace);
 bool pdll_undo(pdll *list);
+bool pdll_begin(pdll *list);
+bool pdll_commit(pdll *list);
+void pdll_rollback(pdll *list);
+void pdll_observe(pdll *list, pdll_observe_func observe, void *context);
+void pdll_diff_latest(pdll *list, pdll_visit_node_data_func visit, void *context);
+size_t pdll_version_nodes(pdll *list, size_t version);
+void pdll_memory_usage(pdll *list, pdll_node_data_size_func data_size, pdll_memory *usage);
 
 #define pdll_iter(list, node)                                                                                          \
   for (pdll_node *node = (list)->versions[(list)->latest_version].head; node != NULL;                                  \
@@ -0,0 +1,415 @@
+#include "render_thread.h"
+#include "board.h"
+#include "path.h"
+#include "point.h"
+#include <time.h>
+
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+#define BOUNDS_PADDING 3
+// maximum amount of queued stroke points rasterized as a single batch
+#define STROKE_BATCH_SIZE 64
+
+static cairo_path_t *merge_paths(cairo_t *cr, List *paths) {
+  // assume paths->type == VECTOR_PATHS
+  cairo_new_path(cr);
+  ListNode *node, *next_node;
+  list_foreach(paths, node, next_node) {
+    cairo_path_t *sub_path = node->data;
+    cairo_append_path(cr, sub_path);
+  }
+
+  cairo_path_t *merged_path = cairo_copy_path(cr);
+  return merged_path;
+}
+
+static SDL_Rect get_path_bounding_area(Board *board) {
+  double x1, y1, x2, y2;
+  cairo_stroke_extents(board->cr, &x1, &y1, &x2, &y2);
+  int x = x1 + board->dx - BOUNDS_PADDING;
+  int y = y1 + board->dy - BOUNDS_PADDING;
+  int w = x2 - x1 + 2 * BOUNDS_PADDING;
+  int h = y2 - y1 + 2 * BOUNDS_PADDING;
+  SDL_Rect area = {.x = MAX(0, x), .y = MAX(0, y), .w = w, .h = h};
+  return area;
+}
+
+// extend the current cairo path with the smoothed segment
+// ending at the last point of the stroke. nothing is drawn yet.
+static void append_smooth_segment(Board *board, List *stroke) {
+  switch (stroke->length) {
+  case 2: {
+    Point *prev = stroke->head->data;
+    cairo_move_to(board->cr, prev->x, prev->y);
+  } break;
+  case 3: {
+    Point *origin = stroke->head->data;
+    Point *dest = stroke->head->next->data;
+    Point *next = stroke->head->next->next->data;
+
+    Point *h1 = point_create(0, 0);
+    Point *h2 = point_create(0, 0);
+
+    create_handle_triple(origin, dest, next, h1, h2);
+    cairo_move_to(board->cr, origin->x, origin->y);
+    cairo_curve_to(board->cr, h1->x, h1->y, h2->x, h2->y, dest->x, dest->y);
+
+    point_free(h1);
+    point_free(h2);
+  } break;
+  default: {
+    Point *prev = stroke->tail->prev->prev->prev->data;
+    Point *origin = stroke->tail->prev->prev->data;
+    Point *dest = stroke->tail->prev->data;
+    Point *next = stroke->tail->data;
+
+    Point *h1 = point_create(0, 0);
+    Point *h2 = point_create(0, 0);
+
+    create_handle_quad(prev, origin, dest, next, h1, h2);
+    cairo_move_to(board->cr, origin->x, origin->y);
+    cairo_curve_to(board->cr, h1->x, h1->y, h2->x, h2->y, dest->x, dest->y);
+
+    point_free(h1);
+    point_free(h2);
+  } break;
+  }
+}
+
+// stroke the path built by append_smooth_segment() in one go.
+static void draw_smooth_stroke(Board *board) {
+  cairo_path_t *sub_path = cairo_copy_path(board->cr);
+  list_append(board->current_stroke_paths, sub_path);
+  SDL_Rect bounds = get_path_bounding_area(board);
+  cairo_stroke(board->cr);
+  board_invalidate(board, &bounds);
+}
+
+// erase with the path built by append_smooth_segment() and clear it.
+static void erase_smooth_stroke(Board *board) {
+  cairo_path_t *segment = cairo_copy_path(board->cr);
+  cairo_new_path(board->cr);
+  board_delete_intersecting_paths(board, segment);
+  cairo_path_destroy(segment);
+}
+
+// drag the selection along with the mouse, only the shared matrix changes.
+static void move_selection(Board *board) {
+  List *points = board->current_stroke_points;
+  Point *first = points->head->data;
+  Point *last = points->tail->data;
+  cairo_matrix_t transform;
+  cairo_matrix_init_translate(&transform, last->x - first->x, last->y - first->y);
+  board_transform_selection(board, &transform);
+
+  // only the last point is needed for the next delta.
+  board_reset_current_stroke(board);
+  list_append(points, point_create(board->mouse_x, board->mouse_y));
+}
+
+// select everything inside the rectangle or lasso the user dragged.
+static void select_area(Board *board) {
+  List *points = board->current_stroke_points;
+  Point *first = points->head->data;
+  Point *last = points->tail->data;
+
+  cairo_new_path(board->cr);
+  if (board->gesture == GESTURE_SELECT_RECT) {
+    cairo_rectangle(board->cr, first->x, first->y, last->x - first->x, last->y - first->y);
+  } else {
+    ListNode *node, *next_node;
+    list_foreach(points, node, next_node) {
+      Point *point = node->data;
+      cairo_line_to(board->cr, point->x, point->y);
+    }
+    cairo_close_path(board->cr);
+  }
+  cairo_path_t *area = cairo_copy_path(board->cr);
+  cairo_new_path(board->cr);
+
+  board_select(board, area);
+  cairo_path_destroy(area);
+}
+
+static void scale_selection(Board *board, double factor) {
+  Point top_left, bottom_right;
+  if (!board_selection_extents(board, &top_left, &bottom_right)) {
+    return;
+  }
+
+  // scale around the center of what is currently on screen.
+  double center_x = (top_left.x + bottom_right.x) / 2;
+  double center_y = (top_left.y + bottom_right.y) / 2;
+  cairo_matrix_t transform;
+  cairo_matrix_init_translate(&transform, center_x, center_y);
+  cairo_matrix_scale(&transform, factor, factor);
+  cairo_matrix_translate(&transform, -center_x, -center_y);
+  board_transform_selection(board, &transform);
+}
+
+static void on_stroke_begin(Board *board, Command *command) {
+  board_update_mouse_state(board, command->stroke.x, command->stroke.y);
+  board->current_stroke_color = command->stroke.color;
+  board->current_stroke_width = command->stroke.width;
+  board_reset_current_stroke(board);
+  Point *current_pos = point_create(board->mouse_x, board->mouse_y);
+  list_append(board->current_stroke_points, current_pos);
+
+  // dragging inside the selection moves it, anything else settles it first.
+  if (command->stroke.tool == TOOL_PEN && board_selection_contains(board, board->mouse_x, board->mouse_y)) {
+    board->gesture = GESTURE_MOVE_SELECTION;
+    return;
+  }
+  board_commit_selection(board);
+
+  if (command->stroke.tool != TOOL_PEN) {
+    board->gesture = command->stroke.tool == TOOL_SELECT_RECT ? GESTURE_SELECT_RECT : GESTURE_SELECT_LASSO;
+    return;
+  }
+  board->gesture = board->current_stroke_color == BOARD_BG ? GESTURE_ERASE : GESTURE_DRAW;
+
+  // draw the initial point where the user clicked.
+  board_setup_draw(board);
+  cairo_move_to(board->cr, board->mouse_x, board->mouse_y);
+  cairo_arc(board->cr, board->mouse_x, board->mouse_y, 0, 0, M_PI * 2);
+
+  // the eraser isn't drawn, it deletes whatever it touches right away.
+  if (board->gesture == GESTURE_ERASE) {
+    board->erase_version = 0;
+    erase_smooth_stroke(board);
+    return;
+  }
+
+  cairo_path_t *point_path = cairo_copy_path(board->cr);
+  list_append(board->current_stroke_paths, point_path);
+  cairo_stroke(board->cr);
+  SDL_Rect bounds = {
+      .x = command->stroke.x - board->current_stroke_width,
+      .y = command->stroke.y - board->current_stroke_width,
+      .w = 2 * board->current_stroke_width,
+      .h = 2 * board->current_stroke_width,
+  };
+  board_invalidate(board, &bounds);
+}
+
+static void on_stroke_points(Board *board, Command *command) {
+  // coalesce every queued point into a single batch,
+  // so fast strokes cost one rasterization instead of one per sample.
+  List *current_stroke = board->current_stroke_points;
+  bool has_new_points = false;
+  bool is_drawing = board->gesture == GESTURE_DRAW || board->gesture == GESTURE_ERASE;
+  Command next;
+  for (int i = 0; i < STROKE_BATCH_SIZE; ++i) {
+    board_update_mouse_state(board, command->stroke.x, command->stroke.y);
+
+    // don't draw the same point twice.
+    Point *last_point = list_top(current_stroke);
+    if (last_point->x != board->mouse_x || last_point->y != board->mouse_y) {
+      Point *current_pos = point_create(board->mouse_x, board->mouse_y);
+      list_append(current_stroke, current_pos);
+      if (is_drawing) {
+        append_smooth_segment(board, current_stroke);
+      }
+      has_new_points = true;
+    }
+
+    if (!ring_peek(board->commands, &next) || next.type != COMMAND_STROKE_POINT) {
+      break;
+    }
+    ring_pop(board->commands, &next);
+    command = &next;
+  }
+
+  if (!has_new_points) {
+    return;
+  }
+
+  switch (board->gesture) {
+  case GESTURE_SELECT_RECT:
+  case GESTURE_SELECT_LASSO:
+    board_update_selection_band(board);
+    return;
+  case GESTURE_MOVE_SELECTION:
+    move_selection(board);
+    return;
+  case GESTURE_DRAW:
+    draw_smooth_stroke(board);
+    return;
+  case GESTURE_ERASE:
+    break;
+  case GESTURE_NONE:
+    return;
+  }
+
+  // the first segment is only a move_to, there is nothing to erase with yet.
+  if (current_stroke->length < 3) {
+    cairo_new_path(board->cr);
+    return;
+  }
+  erase_smooth_stroke(board);
+}
+
+static void on_stroke_end(Board *board) {
+  switch (board->gesture) {
+  case GESTURE_SELECT_RECT:
+  case GESTURE_SELECT_LASSO: {
+    select_area(board);
+    // take the rubber band off the screen.
+    board->gesture = GESTURE_NONE;
+    board_reset_current_stroke(board);
+    board_update_selection_band(board);
+  } break;
+  case GESTURE_ERASE:
+    // the eraser already did its work while dragging.
+    cairo_new_path(board->cr);
+    break;
+  case GESTURE_DRAW: {
+    cairo_path_t *stroke = merge_paths(board->cr, board->current_stroke_paths);
+    cairo_new_path(board->cr);
+    Path *colored_stroke = path_create(stroke, board->current_stroke_color, board->current_stroke_width);
+    if (colored_stroke != NULL) {
+      board_add_path(board, colored_stroke);
+    }
+  } break;
+  case GESTURE_MOVE_SELECTION:
+  case GESTURE_NONE:
+    break;
+  }
+  board->gesture = GESTURE_NONE;
+}
+
+static void on_save(Board *board) {
+  time_t timer;
+  time(&timer);
+  struct tm *time_info = localtime(&timer);
+
+  char filename[128];
+  if (strftime(filename, sizeof(filename), SCREENSHOTS_PATH "sb_%Y_%m_%d-%H:%M:%S.png", time_info) == 0) {
+    return;
+  }
+
+  cairo_status_t status = board_save_image(board, filename);
+  if (status != CAIRO_STATUS_SUCCESS) {
+    fprintf(stderr, "save: can't write %s: %s\n", filename, cairo_status_to_string(status));
+  }
+}
+
+static bool on_command(Board *board, Command *command) {
+  switch (command->type) {
+  case COMMAND_STROKE_BEGIN:
+    on_stroke_begin(board, command);
+    break;
+  case COMMAND_STROKE_POINT:
+    on_stroke_points(board, command);
+    break;
+  case COMMAND_STROKE_END:
+    on_stroke_end(board);
+    break;
+  case COMMAND_TRANSLATE:
+    board_translate(board, command->translate.dx, command->translate.dy);
+    break;
+  case COMMAND_RESET_TRANSLATION:
+    board_reset_translation(board);
+    break;
+  case COMMAND_UNDO:
+    // a pending transform isn't in the history yet, undo just drops it.
+    if (board->selection.count > 0) {
+      board_cancel_selection(board);
+    } else {
+      board_undo(board);
+    }
+    break;
+  case COMMAND_SCALE_SELECTION:
+    scale_selection(board, command->scale.factor);
+    break;
+  case COMMAND_COMMIT_SELECTION:
+    board_commit_selection(board);
+    break;
+  case COMMAND_DUMP_MEMORY: {
+    BoardMemory usage;
+    board_memory_usage(board, &usage);
+    usage.tiles = command->memory.tiles;
+    board_print_memory(board, &usage);
+  } break;
+  case COMMAND_ADD_LAYER:
+    board_add_layer(board);
+    break;
+  case COMMAND_NEXT_LAYER:
+    board_select_layer(board, (board->active_layer + 1) % board->layers_count);
+    break;
+  case COMMAND_TOGGLE_LAYER:
+    board_toggle_layer(board, board->active_layer);
+    break;
+  case COMMAND_COPY:
+    board_copy_selection(board);
+    break;
+  case COMMAND_PASTE:
+    board_update_mouse_state(board, command->paste.x, command->paste.y);
+    board_paste(board, board->mouse_x, board->mouse_y);
+    break;
+  case COMMAND_DUPLICATE:
+    board_duplicate_selection(board);
+    break;
+  case COMMAND_IMPORT:
+    board_import(board, command->import.filename);
+    free(command->import.filename);
+    break;
+  case COMMAND_REFRESH:
+    board_refresh(board);
+    break;
+  case COMMAND_RESIZE:
+    board_resize_surface(board, command->resize.width, command->resize.height, command->resize.pixel_width,
+                         command->resize.pixel_height);
+    board_refresh(board);
+    break;
+  case COMMAND_SAVE:
+    on_save(board);
+    break;
+  case COMMAND_QUIT:
+    return false;
+  }
+  return true;
+}
+
+int render_thread_run(void *data) {
+  Board *board = data;
+  bool running = true;
+
+  while (running) {
+    // a refresh in progress only looks for new commands between its slices.
+    // a layer it finished while a stroke is drawn waits for the stroke to end.
+    bool refreshing = board->refresh.active && !board->refresh.drawn;
+    if (refreshing) {
+      SDL_SemTryWait(board->commands_available);
+    } else {
+      SDL_SemWait(board->commands_available);
+    }
+
+    // apply everything that is queued, then hand a single frame over.
+    Command command;
+    while (running && ring_pop(board->commands, &command)) {
+      running = on_command(board, &command);
+    }
+    // imported strokes and scripts wait for the drawing at hand to finish.
+    if (running && board->gesture == GESTURE_NONE) {
+      board_finish_imports(board);
+      board_run_controls(board);
+      board_sync(board);
+    }
+    if (running) {
+      board_refresh_step(board, REFRESH_BUDGET_MS);
+    }
+    // the changes of this iteration go out to the other instances at once.
+    sync_flush(board->sync);
+
+    // install chunks read ahead, and page out the ones left behind.
+    board_page_chunks(board);
+    board_publish_frame(board);
+
+    // with the frame handed over and nothing queued, get ahead of the pan.
+    if (running && !ring_peek(board->commands, &command)) {
+      board_prefetch(board);
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,8 @@
+#ifndef SB_RENDER_THREAD_H
+#define SB_RENDER_THREAD_H
+
+// entry point of the render thread, data is the Board.
+// consumes board->commands until COMMAND_QUIT.
+int render_thread_run(void *data);
+
+#endif // SB_RENDER_THREAD_H
@@ -0,0 +1,67 @@
+#include "ring.h"
+#include <stdlib.h>
+#include <string.h>
+
+Ring *ring_create(size_t item_size, size_t capacity) {
+  // indices wrap with a mask, so capacity must be a power of two.
+  if (capacity == 0 || (capacity & (capacity - 1)) != 0) {
+    return NULL;
+  }
+
+  Ring *ring = malloc(sizeof(*ring));
+  if (ring == NULL) {
+    return NULL;
+  }
+
+  ring->items = malloc(item_size * capacity);
+  if (ring->items == NULL) {
+    free(ring);
+    return NULL;
+  }
+
+  ring->item_size = item_size;
+  ring->capacity = capacity;
+  atomic_init(&ring->head, 0);
+  atomic_init(&ring->tail, 0);
+  return ring;
+}
+
+void ring_free(Ring *ring) {
+  free(ring->items);
+  free(ring);
+}
+
+bool ring_push(Ring *ring, const void *item) {
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  size_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  if (tail - head == ring->capacity) {
+    return false;
+  }
+
+  memcpy(ring->items + (tail & (ring->capacity - 1)) * ring->item_size, item, ring->item_size);
+  // publish the item only after it is fully written.
+  atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+  return true;
+}
+
+bool ring_peek(Ring *ring, void *item) {
+  size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  size_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+  if (head == tail) {
+    return false;
+  }
+
+  memcpy(item, ring->items + (head & (ring->capacity - 1)) * ring->item_size, ring->item_size);
+  return true;
+}
+
+bool ring_pop(Ring *ring, void *item) {
+  if (!ring_peek(ring, item)) {
+    return false;
+  }
+
+  // hand the slot back to the producer only after it was copied out.
+  size_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+  return true;
+}
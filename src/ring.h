@@ -0,0 +1,24 @@
+#ifndef SB_RING_H
+#define SB_RING_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// lock-free single producer, single consumer ring buffer.
+// items are copied in and out by value.
+typedef struct Ring {
+  unsigned char *items;
+  size_t item_size;
+  size_t capacity;     // always a power of two
+  _Atomic size_t head; // next item to read, written by the consumer only
+  _Atomic size_t tail; // next slot to write, written by the producer only
+} Ring;
+
+Ring *ring_create(size_t item_size, size_t capacity);
+void ring_free(Ring *ring);
+bool ring_push(Ring *ring, const void *item);
+bool ring_peek(Ring *ring, void *item);
+bool ring_pop(Ring *ring, void *item);
+
+#endif // SB_RING_H
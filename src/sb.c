@@ -1,76 +1,72 @@
 #include "board.h"
-#include "path.h"
-#include "point.h"
+#include "render_thread.h"
 #include <SDL2/SDL_events.h>
 #include <stdbool.h>
-#include <time.h>
+#include <stdlib.h>
+#include <string.h>
 
-#define MAX(a, b) ((a) > (b) ? (a) : (b))
-#define BOUNDS_PADDING 3
-#define FPS 60
-#define FPS_DURATION (1000 / FPS)
+// how long to sleep waiting for events when there is nothing to draw
+#define IDLE_TIMEOUT 1000
+// how long the window size must stay put before the canvas is rebuilt
+#define RESIZE_DEBOUNCE 150
 
-cairo_path_t *merge_paths(cairo_t *cr, List *paths) {
-  // assume paths->type == VECTOR_PATHS
-  cairo_new_path(cr);
-  ListNode *node, *next_node;
-  list_foreach(paths, node, next_node) {
-    cairo_path_t *sub_path = node->data;
-    cairo_append_path(cr, sub_path);
-  }
-
-  cairo_path_t *merged_path = cairo_copy_path(cr);
-  return merged_path;
-}
-
-SDL_Rect get_path_bounding_area(Board *board) {
-  double x1, y1, x2, y2;
-  cairo_stroke_extents(board->cr, &x1, &y1, &x2, &y2);
-  int x = x1 + board->dx - BOUNDS_PADDING;
-  int y = y1 + board->dy - BOUNDS_PADDING;
-  int w = x2 - x1 + 2 * BOUNDS_PADDING;
-  int h = y2 - y1 + 2 * BOUNDS_PADDING;
-  SDL_Rect area = {.x = MAX(0, x), .y = MAX(0, y), .w = w, .h = h};
-  return area;
-}
+// input handlers run on the main thread. they only track the input state
+// and forward the work to the render thread as commands.
 
 void on_window_event(Board *board, SDL_Event *sdl_event) {
   switch (sdl_event->window.event) {
   case SDL_WINDOWEVENT_RESIZED:
-    board_resize_surface(board);
-    board_refresh(board);
+    // rebuilding the canvas is expensive and dragging a window edge
+    // resizes it many times a second. wait for the size to settle,
+    // meanwhile the last frame is stretched over the window.
+    board->resize_pending = true;
+    board->resize_deadline = SDL_GetTicks() + RESIZE_DEBOUNCE;
+    board->present_pending = true;
     break;
   case SDL_WINDOWEVENT_EXPOSED:
-    board_refresh(board);
+    // the tiles still hold the last frame, just show it again.
+    board->present_pending = true;
     break;
   }
 }
 
-void on_mouse_left_button_down(Board *board) {
-  board_update_mouse_state(board);
+void resize_if_settled(Board *board) {
+  if (!board->resize_pending || !SDL_TICKS_PASSED(SDL_GetTicks(), board->resize_deadline)) {
+    return;
+  }
+
+  board->resize_pending = false;
+  Command command = {.type = COMMAND_RESIZE};
+  SDL_GetWindowSize(board->window, &command.resize.width, &command.resize.height);
+  SDL_GetRendererOutputSize(board->renderer, &command.resize.pixel_width, &command.resize.pixel_height);
+  board_push_command(board, &command);
+}
 
-  // draw the initial point where the user clicked.
+void on_mouse_left_button_down(Board *board, SDL_Event *event) {
   board->state = STATE_DRAWING;
-  board_reset_current_stroke(board);
-  Point *current_pos = point_create(board->mouse_x, board->mouse_y);
-  list_append(board->current_stroke_points, current_pos);
-  board_setup_draw(board);
-  cairo_move_to(board->cr, board->mouse_x, board->mouse_y);
-  cairo_arc(board->cr, board->mouse_x, board->mouse_y, 0, 0, M_PI * 2);
-  cairo_path_t *point_path = cairo_copy_path(board->cr);
-  list_append(board->current_stroke_paths, point_path);
-  cairo_stroke(board->cr);
-  SDL_Rect bounds = {
-      .x = board->mouse_x_raw - board->stroke_width,
-      .y = board->mouse_y_raw - board->stroke_width,
-      .w = 2 * board->stroke_width,
-      .h = 2 * board->stroke_width,
+  // shift+drag selects a rectangle, ctrl+drag a lasso.
+  const Uint8 *keys = SDL_GetKeyboardState(NULL);
+  StrokeTool tool = TOOL_PEN;
+  if (keys[SDL_SCANCODE_LSHIFT]) {
+    tool = TOOL_SELECT_RECT;
+  } else if (keys[SDL_SCANCODE_LCTRL]) {
+    tool = TOOL_SELECT_LASSO;
+  }
+
+  Command command = {
+      .type = COMMAND_STROKE_BEGIN,
+      .stroke = {.x = event->button.x,
+                 .y = event->button.y,
+                 .color = board->stroke_color,
+                 .width = board->stroke_width,
+                 .tool = tool},
   };
-  board_render(board, &bounds);
+  board_push_command(board, &command);
 }
 
-void on_mouse_right_button_down(Board *board) {
-  board_update_mouse_state(board);
+void on_mouse_right_button_down(Board *board, SDL_Event *event) {
+  board->mouse_x_raw = event->button.x;
+  board->mouse_y_raw = event->button.y;
   board->state = STATE_MOVING;
   SDL_ShowCursor(false);
   return;
@@ -83,10 +79,10 @@ void on_mouse_button_down(Board *board, SDL_Event *event) {
 
   switch (event->button.button) {
   case SDL_BUTTON_LEFT:
-    on_mouse_left_button_down(board);
+    on_mouse_left_button_down(board, event);
     break;
   case SDL_BUTTON_RIGHT:
-    on_mouse_right_button_down(board);
+    on_mouse_right_button_down(board, event);
     break;
   }
 }
@@ -96,20 +92,8 @@ void on_mouse_left_button_up(Board *board) {
     return;
   }
 
-  cairo_path_t *stroke = merge_paths(board->cr, board->current_stroke_paths);
-  cairo_new_path(board->cr);
-
-  if (board->stroke_color != BOARD_BG) {
-    Path *colored_stroke = path_create(stroke, board->stroke_color, board->stroke_width);
-    pdll_append(board->strokes, colored_stroke);
-    board->state = STATE_IDLE;
-    return;
-  }
-
-  // remove all paths that intersect colored_stroke
-  board_delete_intersecting_paths(board, stroke);
-  board_refresh(board);
-  cairo_path_destroy(stroke);
+  Command command = {.type = COMMAND_STROKE_END};
+  board_push_command(board, &command);
   board->state = STATE_IDLE;
 }
 
@@ -131,83 +115,29 @@ void on_mouse_button_up(Board *board, SDL_Event *event) {
   }
 }
 
-void draw_smooth_stroke(Board *board, List *stroke) {
-  switch (stroke->length) {
-  case 2: {
-    Point *prev = stroke->head->data;
-    cairo_move_to(board->cr, prev->x, prev->y);
-  } break;
-  case 3: {
-    Point *origin = stroke->head->data;
-    Point *dest = stroke->head->next->data;
-    Point *next = stroke->head->next->next->data;
-
-    Point *h1 = point_create(0, 0);
-    Point *h2 = point_create(0, 0);
-
-    create_handle_triple(origin, dest, next, h1, h2);
-    cairo_move_to(board->cr, origin->x, origin->y);
-    cairo_curve_to(board->cr, h1->x, h1->y, h2->x, h2->y, dest->x, dest->y);
-
-    point_free(h1);
-    point_free(h2);
-  } break;
-  default: {
-    Point *prev = stroke->tail->prev->prev->prev->data;
-    Point *origin = stroke->tail->prev->prev->data;
-    Point *dest = stroke->tail->prev->data;
-    Point *next = stroke->tail->data;
-
-    Point *h1 = point_create(0, 0);
-    Point *h2 = point_create(0, 0);
-
-    create_handle_quad(prev, origin, dest, next, h1, h2);
-    cairo_move_to(board->cr, origin->x, origin->y);
-    cairo_curve_to(board->cr, h1->x, h1->y, h2->x, h2->y, dest->x, dest->y);
-
-    point_free(h1);
-    point_free(h2);
-  } break;
-  }
-
-  cairo_path_t *sub_path = cairo_copy_path(board->cr);
-  list_append(board->current_stroke_paths, sub_path);
-  SDL_Rect bounds = get_path_bounding_area(board);
-  cairo_stroke(board->cr);
-  board_render(board, &bounds);
-}
-
-void on_mouse_motion(Board *board) {
+void on_mouse_motion(Board *board, SDL_Event *event) {
   if (board->state == STATE_IDLE) {
     return;
   }
 
   if (board->state == STATE_MOVING) {
-    double prev_raw_x = board->mouse_x_raw;
-    double prev_raw_y = board->mouse_y_raw;
-    board_update_mouse_state(board);
-    double dx = board->mouse_x_raw - prev_raw_x;
-    double dy = board->mouse_y_raw - prev_raw_y;
-    board_translate(board, dx, dy);
-    return;
-  }
-
-  // it is now guaranteed that board->state == STATE_DRAWING
-  board_update_mouse_state(board);
-
-  // don't draw the same point twice.
-  Point *last_point = list_top(board->current_stroke_points);
-  if (last_point->x == board->mouse_x && last_point->y == board->mouse_y) {
+    Command command = {
+        .type = COMMAND_TRANSLATE,
+        .translate = {.dx = event->motion.x - board->mouse_x_raw, .dy = event->motion.y - board->mouse_y_raw},
+    };
+    board->mouse_x_raw = event->motion.x;
+    board->mouse_y_raw = event->motion.y;
+    board_push_command(board, &command);
     return;
   }
 
-  Point *current_pos = point_create(board->mouse_x, board->mouse_y);
-  list_append(board->current_stroke_points, current_pos);
-
-  // now that we know that board->current_stroke_points
-  // won't mutate, alias it for readability.
-  List *current_stroke = board->current_stroke_points;
-  draw_smooth_stroke(board, current_stroke);
+  // it is now guaranteed that board->state == STATE_DRAWING.
+  // every sample is forwarded, the render thread batches them.
+  Command command = {
+      .type = COMMAND_STROKE_POINT,
+      .stroke = {.x = event->motion.x, .y = event->motion.y},
+  };
+  board_push_command(board, &command);
 }
 
 void on_key_down(Board *board) {
@@ -215,14 +145,14 @@ void on_key_down(Board *board) {
 
   // ctrl+z -> undo last stroke
   if (keys[SDL_SCANCODE_LCTRL] && keys[SDL_SCANCODE_Z]) {
-    if (pdll_undo(board->strokes)) {
-      board_refresh(board);
-    }
+    Command command = {.type = COMMAND_UNDO};
+    board_push_command(board, &command);
     return;
   }
 
   if (keys[SDL_SCANCODE_0]) {
-    board_reset_translation(board);
+    Command command = {.type = COMMAND_RESET_TRANSLATION};
+    board_push_command(board, &command);
     return;
   }
 
@@ -271,61 +201,159 @@ void on_key_down(Board *board) {
   }
 
   if (keys[SDL_SCANCODE_LCTRL] && keys[SDL_SCANCODE_S]) {
-    time_t timer;
-    time(&timer);
-    struct tm *time_info = localtime(&timer);
+    Command command = {.type = COMMAND_SAVE};
+    board_push_command(board, &command);
+  }
 
-    char filename[128];
-    if (strftime(filename, sizeof(filename), SCREENSHOTS_PATH "sb_%Y_%m_%d-%H:%M:%S.png", time_info) == 0) {
-      return;
-    }
+  // ctrl+m -> print where the memory goes
+  if (keys[SDL_SCANCODE_LCTRL] && keys[SDL_SCANCODE_M]) {
+    Command command = {.type = COMMAND_DUMP_MEMORY, .memory = {.tiles = board_tiles_memory_usage(board)}};
+    board_push_command(board, &command);
+  }
+
+  // ctrl+l -> new layer on top, tab -> edit the next layer,
+  // ctrl+h -> hide or show the layer being edited
+  if (keys[SDL_SCANCODE_LCTRL] && keys[SDL_SCANCODE_L]) {
+    Command command = {.type = COMMAND_ADD_LAYER};
+    board_push_command(board, &command);
+  }
 
-    board_save_image(board, filename);
+  if (keys[SDL_SCANCODE_TAB]) {
+    Command command = {.type = COMMAND_NEXT_LAYER};
+    board_push_command(board, &command);
+  }
+
+  if (keys[SDL_SCANCODE_LCTRL] && keys[SDL_SCANCODE_H]) {
+    Command command = {.type = COMMAND_TOGGLE_LAYER};
+    board_push_command(board, &command);
+  }
+
+  // ctrl+c -> copy the selection, ctrl+v -> paste it under the mouse,
+  // ctrl+d -> duplicate the selection in place
+  if (keys[SDL_SCANCODE_LCTRL] && keys[SDL_SCANCODE_C]) {
+    Command command = {.type = COMMAND_COPY};
+    board_push_command(board, &command);
+  }
+
+  if (keys[SDL_SCANCODE_LCTRL] && keys[SDL_SCANCODE_V]) {
+    Command command = {.type = COMMAND_PASTE};
+    SDL_GetMouseState(&command.paste.x, &command.paste.y);
+    board_push_command(board, &command);
+  }
+
+  if (keys[SDL_SCANCODE_LCTRL] && keys[SDL_SCANCODE_D]) {
+    Command command = {.type = COMMAND_DUPLICATE};
+    board_push_command(board, &command);
+  }
+
+  // [ and ] shrink and grow the selection
+  if (keys[SDL_SCANCODE_LEFTBRACKET] || keys[SDL_SCANCODE_RIGHTBRACKET]) {
+    double factor = keys[SDL_SCANCODE_LEFTBRACKET] ? 1 / SELECTION_SCALE_STEP : SELECTION_SCALE_STEP;
+    Command command = {.type = COMMAND_SCALE_SELECTION, .scale = {.factor = factor}};
+    board_push_command(board, &command);
+  }
+
+  // escape -> drop the selection, keeping it where it was moved to
+  if (keys[SDL_SCANCODE_ESCAPE]) {
+    Command command = {.type = COMMAND_COMMIT_SELECTION};
+    board_push_command(board, &command);
+  }
+}
+
+// strokes are read from the file by the render thread, see import.h.
+void import_file(Board *board, const char *filename) {
+  Command command = {.type = COMMAND_IMPORT, .import = {.filename = strdup(filename)}};
+  if (command.import.filename != NULL) {
+    board_push_command(board, &command);
   }
 }
 
-int main() {
+bool on_event(Board *board, SDL_Event *event) {
+  switch (event->type) {
+  case SDL_QUIT:
+    return false;
+  case SDL_WINDOWEVENT:
+    on_window_event(board, event);
+    break;
+  case SDL_MOUSEBUTTONDOWN:
+    on_mouse_button_down(board, event);
+    break;
+  case SDL_MOUSEBUTTONUP:
+    on_mouse_button_up(board, event);
+    break;
+  case SDL_MOUSEMOTION:
+    on_mouse_motion(board, event);
+    break;
+  case SDL_KEYDOWN:
+    on_key_down(board);
+    break;
+  case SDL_DROPFILE:
+    import_file(board, event->drop.file);
+    SDL_free(event->drop.file);
+    break;
+  default:
+    // board->frame_event only needs to wake the loop up.
+    break;
+  }
+  return true;
+}
+
+// every argument is a stroke feed to import, "-" reads stdin.
+int main(int argc, char **argv) {
   SDL_Init(SDL_INIT_VIDEO);
   Board *board = board_create(600, 480);
   bool running = true;
   board_update_cursor(board);
-  // used for evaluating fps
-  Uint32 start, loop_duration;
+  // SB_SOCKET=path lets scripts drive the board, see control.h.
+  const char *socket_path = getenv("SB_SOCKET");
+  if (socket_path != NULL && socket_path[0] != '\0') {
+    board->control = control_start(socket_path, board->commands_available);
+  }
+  // SB_SYNC=path shares the board with the other instances given the same
+  // path, see sync.h.
+  const char *sync_path = getenv("SB_SYNC");
+  if (sync_path != NULL && sync_path[0] != '\0') {
+    board_share(board, sync_path);
+  }
+  SDL_Thread *render_thread = SDL_CreateThread(render_thread_run, "render", board);
+
+  // draw the first frame.
+  Command refresh = {.type = COMMAND_REFRESH};
+  board_push_command(board, &refresh);
+  for (int i = 1; i < argc; ++i) {
+    import_file(board, argv[i]);
+  }
 
   while (running) {
     SDL_Event event;
-    start = SDL_GetTicks();
-    while (SDL_PollEvent(&event)) {
-      switch (event.type) {
-      case SDL_QUIT:
-        running = false;
-        break;
-      case SDL_WINDOWEVENT:
-        on_window_event(board, &event);
-        break;
-      case SDL_MOUSEBUTTONDOWN:
-        on_mouse_button_down(board, &event);
-        break;
-      case SDL_MOUSEBUTTONUP:
-        on_mouse_button_up(board, &event);
-        break;
-      case SDL_MOUSEMOTION:
-        on_mouse_motion(board);
-        break;
-      case SDL_KEYDOWN:
-        on_key_down(board);
-        break;
-      default:
-        break;
-      }
+    // sleep until there is either input or a new frame from the render thread,
+    // or until a pending resize settles.
+    int timeout = IDLE_TIMEOUT;
+    if (board->resize_pending) {
+      Sint32 remaining = board->resize_deadline - SDL_GetTicks();
+      timeout = remaining > 0 ? remaining : 0;
+    }
+    if (SDL_WaitEventTimeout(&event, timeout)) {
+      running = on_event(board, &event);
     }
 
-    loop_duration = SDL_GetTicks() - start;
-    if (loop_duration <= FPS_DURATION) {
-      SDL_Delay(FPS_DURATION - loop_duration);
+    // handle everything that is already queued before drawing.
+    while (running && SDL_PollEvent(&event)) {
+      running = on_event(board, &event);
     }
+    resize_if_settled(board);
+    board_flush_commands(board);
+
+    // present the latest published frame, if any.
+    // vsync blocks here until the next vblank.
+    board_render(board);
   }
 
+  Command quit = {.type = COMMAND_QUIT};
+  board_push_command(board, &quit);
+  board_flush_commands(board);
+  SDL_WaitThread(render_thread, NULL);
+
   board_free(board);
   SDL_Quit();
 }
@@ -0,0 +1,215 @@
+#include "simd.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+static bool any_nonzero_scalar(const uint8_t *data, size_t size) {
+  size_t i = 0;
+  uint64_t any = 0;
+  for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, data + i, sizeof(word));
+    any |= word;
+  }
+  for (; i < size; ++i) {
+    any |= data[i];
+  }
+  return any != 0;
+}
+
+static void copy_rect_scalar(uint8_t *dst, size_t dst_stride, const uint8_t *src, size_t src_stride, size_t row_bytes,
+                             int rows) {
+  for (int y = 0; y < rows; ++y) {
+    memcpy(dst + y * dst_stride, src + y * src_stride, row_bytes);
+  }
+}
+
+static void fill_rect_scalar(uint8_t *dst, size_t stride, uint32_t value, int width, int rows) {
+  for (int y = 0; y < rows; ++y) {
+    uint32_t *row = (uint32_t *)(dst + y * stride);
+    for (int x = 0; x < width; ++x) {
+      row[x] = value;
+    }
+  }
+}
+
+SimdKernels simd = {"scalar", any_nonzero_scalar, copy_rect_scalar, fill_rect_scalar};
+
+#ifdef SIMD_X86
+
+// every flavor walks whole vectors with unaligned loads and stores,
+// and leaves the tail of a row to the scalar code.
+
+__attribute__((target("sse2"))) static bool any_nonzero_sse2(const uint8_t *data, size_t size) {
+  size_t i = 0;
+  __m128i any = _mm_setzero_si128();
+  for (; i + 64 <= size; i += 64) {
+    __m128i a = _mm_or_si128(_mm_loadu_si128((const __m128i *)(data + i)),
+                             _mm_loadu_si128((const __m128i *)(data + i + 16)));
+    __m128i b = _mm_or_si128(_mm_loadu_si128((const __m128i *)(data + i + 32)),
+                             _mm_loadu_si128((const __m128i *)(data + i + 48)));
+    any = _mm_or_si128(any, _mm_or_si128(a, b));
+  }
+  for (; i + 16 <= size; i += 16) {
+    any = _mm_or_si128(any, _mm_loadu_si128((const __m128i *)(data + i)));
+  }
+  if (_mm_movemask_epi8(_mm_cmpeq_epi8(any, _mm_setzero_si128())) != 0xFFFF) {
+    return true;
+  }
+  return any_nonzero_scalar(data + i, size - i);
+}
+
+__attribute__((target("sse2"))) static void copy_rect_sse2(uint8_t *dst, size_t dst_stride, const uint8_t *src,
+                                                           size_t src_stride, size_t row_bytes, int rows) {
+  for (int y = 0; y < rows; ++y) {
+    uint8_t *d = dst + y * dst_stride;
+    const uint8_t *s = src + y * src_stride;
+    size_t i = 0;
+    for (; i + 16 <= row_bytes; i += 16) {
+      _mm_storeu_si128((__m128i *)(d + i), _mm_loadu_si128((const __m128i *)(s + i)));
+    }
+    memcpy(d + i, s + i, row_bytes - i);
+  }
+}
+
+__attribute__((target("sse2"))) static void fill_rect_sse2(uint8_t *dst, size_t stride, uint32_t value, int width,
+                                                           int rows) {
+  __m128i pixels = _mm_set1_epi32(value);
+  for (int y = 0; y < rows; ++y) {
+    uint32_t *row = (uint32_t *)(dst + y * stride);
+    int x = 0;
+    for (; x + 4 <= width; x += 4) {
+      _mm_storeu_si128((__m128i *)(row + x), pixels);
+    }
+    for (; x < width; ++x) {
+      row[x] = value;
+    }
+  }
+}
+
+__attribute__((target("avx2"))) static bool any_nonzero_avx2(const uint8_t *data, size_t size) {
+  size_t i = 0;
+  __m256i any = _mm256_setzero_si256();
+  for (; i + 128 <= size; i += 128) {
+    __m256i a = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(data + i)),
+                                _mm256_loadu_si256((const __m256i *)(data + i + 32)));
+    __m256i b = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(data + i + 64)),
+                                _mm256_loadu_si256((const __m256i *)(data + i + 96)));
+    any = _mm256_or_si256(any, _mm256_or_si256(a, b));
+  }
+  for (; i + 32 <= size; i += 32) {
+    any = _mm256_or_si256(any, _mm256_loadu_si256((const __m256i *)(data + i)));
+  }
+  if (!_mm256_testz_si256(any, any)) {
+    return true;
+  }
+  return any_nonzero_scalar(data + i, size - i);
+}
+
+__attribute__((target("avx2"))) static void copy_rect_avx2(uint8_t *dst, size_t dst_stride, const uint8_t *src,
+                                                           size_t src_stride, size_t row_bytes, int rows) {
+  for (int y = 0; y < rows; ++y) {
+    uint8_t *d = dst + y * dst_stride;
+    const uint8_t *s = src + y * src_stride;
+    size_t i = 0;
+    for (; i + 32 <= row_bytes; i += 32) {
+      _mm256_storeu_si256((__m256i *)(d + i), _mm256_loadu_si256((const __m256i *)(s + i)));
+    }
+    memcpy(d + i, s + i, row_bytes - i);
+  }
+}
+
+__attribute__((target("avx2"))) static void fill_rect_avx2(uint8_t *dst, size_t stride, uint32_t value, int width,
+                                                           int rows) {
+  __m256i pixels = _mm256_set1_epi32(value);
+  for (int y = 0; y < rows; ++y) {
+    uint32_t *row = (uint32_t *)(dst + y * stride);
+    int x = 0;
+    for (; x + 8 <= width; x += 8) {
+      _mm256_storeu_si256((__m256i *)(row + x), pixels);
+    }
+    for (; x < width; ++x) {
+      row[x] = value;
+    }
+  }
+}
+
+// avx-512 handles the tail of a row with a masked load or store as well.
+
+__attribute__((target("avx512f"))) static bool any_nonzero_avx512(const uint8_t *data, size_t size) {
+  size_t i = 0;
+  __m512i any = _mm512_setzero_si512();
+  for (; i + 256 <= size; i += 256) {
+    __m512i a = _mm512_or_si512(_mm512_loadu_si512(data + i), _mm512_loadu_si512(data + i + 64));
+    __m512i b = _mm512_or_si512(_mm512_loadu_si512(data + i + 128), _mm512_loadu_si512(data + i + 192));
+    any = _mm512_or_si512(any, _mm512_or_si512(a, b));
+  }
+  for (; i + 64 <= size; i += 64) {
+    any = _mm512_or_si512(any, _mm512_loadu_si512(data + i));
+  }
+  if (_mm512_test_epi64_mask(any, any) != 0) {
+    return true;
+  }
+  return any_nonzero_scalar(data + i, size - i);
+}
+
+__attribute__((target("avx512f"))) static void copy_rect_avx512(uint8_t *dst, size_t dst_stride, const uint8_t *src,
+                                                               size_t src_stride, size_t row_bytes, int rows) {
+  for (int y = 0; y < rows; ++y) {
+    uint8_t *d = dst + y * dst_stride;
+    const uint8_t *s = src + y * src_stride;
+    size_t i = 0;
+    for (; i + 64 <= row_bytes; i += 64) {
+      _mm512_storeu_si512(d + i, _mm512_loadu_si512(s + i));
+    }
+    // the rows copied are whole pixels, the tail is in 32 bit lanes
+    // except for odd sizes, which are left to memcpy.
+    size_t lanes = (row_bytes - i) / 4;
+    __mmask16 mask = (__mmask16)((1u << lanes) - 1);
+    _mm512_mask_storeu_epi32(d + i, mask, _mm512_maskz_loadu_epi32(mask, s + i));
+    i += lanes * 4;
+    memcpy(d + i, s + i, row_bytes - i);
+  }
+}
+
+__attribute__((target("avx512f"))) static void fill_rect_avx512(uint8_t *dst, size_t stride, uint32_t value, int width,
+                                                               int rows) {
+  __m512i pixels = _mm512_set1_epi32(value);
+  for (int y = 0; y < rows; ++y) {
+    uint32_t *row = (uint32_t *)(dst + y * stride);
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+      _mm512_storeu_si512(row + x, pixels);
+    }
+    _mm512_mask_storeu_epi32(row + x, (__mmask16)((1u << (width - x)) - 1), pixels);
+  }
+}
+
+#endif
+
+void simd_init(void) {
+  const char *cap = getenv("SB_SIMD");
+  if (cap != NULL && cap[0] == '\0') {
+    cap = NULL;
+  }
+  if (cap != NULL && strcmp(cap, "scalar") == 0) {
+    return;
+  }
+
+#ifdef SIMD_X86
+  __builtin_cpu_init();
+  bool allow_avx2 = cap == NULL || strcmp(cap, "avx2") == 0 || strcmp(cap, "avx512") == 0;
+  bool allow_avx512 = cap == NULL || strcmp(cap, "avx512") == 0;
+  if (allow_avx512 && __builtin_cpu_supports("avx512f")) {
+    simd = (SimdKernels){"avx512", any_nonzero_avx512, copy_rect_avx512, fill_rect_avx512};
+  } else if (allow_avx2 && __builtin_cpu_supports("avx2")) {
+    simd = (SimdKernels){"avx2", any_nonzero_avx2, copy_rect_avx2, fill_rect_avx2};
+  } else if (__builtin_cpu_supports("sse2")) {
+    simd = (SimdKernels){"sse2", any_nonzero_sse2, copy_rect_sse2, fill_rect_sse2};
+  }
+#endif
+}
@@ -0,0 +1,27 @@
+#ifndef SB_SIMD_H
+#define SB_SIMD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// pixel kernels in scalar, SSE2, AVX2 and AVX-512 flavors. the binary is
+// built for the baseline instruction set, simd_init() picks the widest
+// flavor the cpu supports. SB_SIMD=scalar|sse2|avx2|avx512 caps the choice.
+typedef struct SimdKernels {
+  const char *name;
+  // true if any of the size bytes at data isn't zero
+  bool (*any_nonzero)(const uint8_t *data, size_t size);
+  // copy rows of row_bytes from src to dst, the two must not overlap
+  void (*copy_rect)(uint8_t *dst, size_t dst_stride, const uint8_t *src, size_t src_stride, size_t row_bytes,
+                    int rows);
+  // set width 32 bit pixels of every row to value
+  void (*fill_rect)(uint8_t *dst, size_t stride, uint32_t value, int width, int rows);
+} SimdKernels;
+
+// scalar until simd_init() runs
+extern SimdKernels simd;
+
+void simd_init(void);
+
+#endif // SB_SIMD_H
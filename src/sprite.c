@@ -0,0 +1,187 @@
+#include "sprite.h"
+#include <math.h>
+#include <stdlib.h>
+
+SpriteCache *sprite_cache_create(size_t capacity) {
+  SpriteCache *cache = malloc(sizeof(SpriteCache));
+  if (cache == NULL) {
+    return NULL;
+  }
+
+  cache->head = NULL;
+  cache->tail = NULL;
+  cache->size = 0;
+  cache->capacity = capacity;
+  cache->scale_x = 1;
+  cache->scale_y = 1;
+  return cache;
+}
+
+static void sprite_unlink(Sprite *sprite) {
+  SpriteCache *cache = sprite->cache;
+  if (sprite->prev != NULL) {
+    sprite->prev->next = sprite->next;
+  } else {
+    cache->head = sprite->next;
+  }
+
+  if (sprite->next != NULL) {
+    sprite->next->prev = sprite->prev;
+  } else {
+    cache->tail = sprite->prev;
+  }
+  sprite->prev = NULL;
+  sprite->next = NULL;
+}
+
+static void sprite_push_front(Sprite *sprite) {
+  SpriteCache *cache = sprite->cache;
+  sprite->prev = NULL;
+  sprite->next = cache->head;
+  if (cache->head != NULL) {
+    cache->head->prev = sprite;
+  } else {
+    cache->tail = sprite;
+  }
+  cache->head = sprite;
+}
+
+// also called when a shape is freed or paged out, it takes its sprite along.
+void sprite_free(Sprite *sprite) {
+  if (sprite == NULL) {
+    return;
+  }
+
+  sprite_unlink(sprite);
+  sprite->cache->size -= sprite->size;
+  sprite->shape->sprite = NULL;
+  cairo_surface_destroy(sprite->surface);
+  free(sprite);
+}
+
+void sprite_cache_clear(SpriteCache *cache) {
+  while (cache->head != NULL) {
+    sprite_free(cache->head);
+  }
+}
+
+void sprite_cache_free(SpriteCache *cache) {
+  if (cache == NULL) {
+    return;
+  }
+
+  sprite_cache_clear(cache);
+  free(cache);
+}
+
+static Sprite *sprite_create(SpriteCache *cache, Path *path) {
+  // snap the sprite to device pixels, so drawing it at a whole pixel
+  // translation is a plain copy.
+  double x = floor(path->top_left.x * cache->scale_x) / cache->scale_x;
+  double y = floor(path->top_left.y * cache->scale_y) / cache->scale_y;
+  int width = ceil((path->bottom_right.x - x) * cache->scale_x);
+  int height = ceil((path->bottom_right.y - y) * cache->scale_y);
+
+  cairo_surface_t *surface = cairo_image_surface_create(CAIRO_FORMAT_A8, width, height);
+  if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS) {
+    cairo_surface_destroy(surface);
+    return NULL;
+  }
+  cairo_surface_set_device_scale(surface, cache->scale_x, cache->scale_y);
+
+  Sprite *sprite = malloc(sizeof(Sprite));
+  if (sprite == NULL) {
+    cairo_surface_destroy(surface);
+    return NULL;
+  }
+
+  // render the coverage the same way the board draws strokes.
+  cairo_t *sprite_cr = cairo_create(surface);
+  cairo_translate(sprite_cr, -x, -y);
+  cairo_set_line_cap(sprite_cr, CAIRO_LINE_CAP_ROUND);
+  cairo_set_line_join(sprite_cr, CAIRO_LINE_JOIN_ROUND);
+  cairo_set_source_rgba(sprite_cr, 0, 0, 0, 1);
+  // drawn once, the outline wouldn't pay off.
+  path_fill(path, NULL, sprite_cr);
+  cairo_destroy(sprite_cr);
+  cairo_surface_flush(surface);
+
+  sprite->cache = cache;
+  sprite->shape = path->shape;
+  sprite->width = path->width;
+  sprite->offset_x = path->offset_x;
+  sprite->offset_y = path->offset_y;
+  sprite->surface = surface;
+  sprite->x = x;
+  sprite->y = y;
+  sprite->size = sizeof(Sprite) + (size_t)cairo_image_surface_get_stride(surface) * height;
+  sprite->prev = NULL;
+  sprite->next = NULL;
+  return sprite;
+}
+
+// draw path from its sprite with the current source of cr, creating the
+// sprite when needed. returns false if the stroke has to be drawn as a
+// vector instead: it is too big, transformed, or cr isn't pixel aligned.
+bool sprite_cache_draw(SpriteCache *cache, Path *path, cairo_t *cr) {
+  if (cache == NULL || cache->capacity == 0 || path->matrix != NULL) {
+    return false;
+  }
+
+  double scale_x, scale_y;
+  cairo_surface_get_device_scale(cairo_get_target(cr), &scale_x, &scale_y);
+  if ((path->bottom_right.x - path->top_left.x) * scale_x > SPRITE_MAX_SIZE ||
+      (path->bottom_right.y - path->top_left.y) * scale_y > SPRITE_MAX_SIZE) {
+    return false;
+  }
+
+  // sprites are only blitted at whole device pixel translations.
+  cairo_matrix_t matrix;
+  cairo_get_matrix(cr, &matrix);
+  if (matrix.xx != 1 || matrix.yy != 1 || matrix.xy != 0 || matrix.yx != 0 ||
+      matrix.x0 * scale_x != floor(matrix.x0 * scale_x) || matrix.y0 * scale_y != floor(matrix.y0 * scale_y)) {
+    return false;
+  }
+
+  // a change of display density makes every sprite the wrong size.
+  if (scale_x != cache->scale_x || scale_y != cache->scale_y) {
+    sprite_cache_clear(cache);
+    cache->scale_x = scale_x;
+    cache->scale_y = scale_y;
+  }
+
+  Sprite *sprite = path->shape->sprite;
+  double shift_x = 0;
+  double shift_y = 0;
+  if (sprite == NULL) {
+    sprite = sprite_create(cache, path);
+    if (sprite == NULL) {
+      return false;
+    }
+
+    // make room by evicting the least recently drawn sprites.
+    while (cache->tail != NULL && cache->size + sprite->size > cache->capacity) {
+      sprite_free(cache->tail);
+    }
+    path->shape->sprite = sprite;
+    cache->size += sprite->size;
+    sprite_push_front(sprite);
+  } else {
+    // a copy of the stroke uses the same sprite, unless it would have to
+    // be resampled.
+    shift_x = (double)(path->offset_x - sprite->offset_x) / PATH_FIXED_SCALE;
+    shift_y = (double)(path->offset_y - sprite->offset_y) / PATH_FIXED_SCALE;
+    if (path->width != sprite->width || shift_x * scale_x != floor(shift_x * scale_x) ||
+        shift_y * scale_y != floor(shift_y * scale_y)) {
+      return false;
+    }
+
+    if (sprite != cache->head) {
+      sprite_unlink(sprite);
+      sprite_push_front(sprite);
+    }
+  }
+
+  cairo_mask_surface(cr, sprite->surface, sprite->x + shift_x, sprite->y + shift_y);
+  return true;
+}
@@ -0,0 +1,49 @@
+#ifndef SB_SPRITE_H
+#define SB_SPRITE_H
+
+#include "path.h"
+#include <cairo/cairo.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// strokes whose bounding box fits this many pixels a side get a sprite
+#define SPRITE_MAX_SIZE 96
+
+typedef struct SpriteCache SpriteCache;
+
+// pre-rendered coverage of a small stroke, tinted with its color when drawn.
+// it belongs to the shape, copies of the stroke at the same width blit it
+// too when they are a whole number of pixels away from where it was drawn.
+typedef struct Sprite {
+  SpriteCache *cache;
+  PathShape *shape;
+  cairo_surface_t *surface; // A8, pixel aligned to the board
+  double x;                 // board coordinates of the top left pixel
+  double y;
+  // the copy of the stroke it was drawn from
+  double width;
+  int32_t offset_x;
+  int32_t offset_y;
+  size_t size; // bytes
+  // least recently drawn order
+  struct Sprite *prev;
+  struct Sprite *next;
+} Sprite;
+
+struct SpriteCache {
+  Sprite *head; // most recently drawn
+  Sprite *tail; // next to be evicted
+  size_t size;
+  size_t capacity;
+  // device scale the sprites were rendered at
+  double scale_x;
+  double scale_y;
+};
+
+SpriteCache *sprite_cache_create(size_t capacity);
+void sprite_cache_free(SpriteCache *cache);
+void sprite_cache_clear(SpriteCache *cache);
+bool sprite_cache_draw(SpriteCache *cache, Path *path, cairo_t *cr);
+void sprite_free(Sprite *sprite);
+
+#endif // SB_SPRITE_H
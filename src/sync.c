@@ -0,0 +1,780 @@
+#include "sync.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// bytes asked for by every read of a connection
+#define SYNC_READ_SIZE (64 * 1024)
+
+// numbers are sent in host order, every end of the socket is on this machine.
+static uint32_t read_u32(const unsigned char *data) {
+  uint32_t value;
+  memcpy(&value, data, sizeof(value));
+  return value;
+}
+
+static void write_u32(unsigned char *data, uint32_t value) {
+  memcpy(data, &value, sizeof(value));
+}
+
+void sync_frame_free(SyncFrame *frame) {
+  free(frame->data);
+  free(frame);
+}
+
+static void frames_free(SyncFrame *frame) {
+  while (frame != NULL) {
+    SyncFrame *next = frame->next;
+    sync_frame_free(frame);
+    frame = next;
+  }
+}
+
+static void frames_push(SyncFrame **list, SyncFrame *frame) {
+  SyncFrame **last = list;
+  while (*last != NULL) {
+    last = &(*last)->next;
+  }
+  frame->next = NULL;
+  *last = frame;
+}
+
+static void sync_wake_network(Sync *sync) {
+  // a full pipe already has the thread awake.
+  while (write(sync->wake_pipe[1], "", 1) < 0 && errno == EINTR) {
+  }
+}
+
+// hand a frame to the render thread.
+static void sync_receive(Sync *sync, SyncFrame *frame) {
+  SDL_LockMutex(sync->lock);
+  frames_push(&sync->inbox, frame);
+  sync->inbox_size += frame->size;
+  SDL_UnlockMutex(sync->lock);
+  SDL_SemPost(sync->wake);
+}
+
+// hand a frame to the network thread.
+static void sync_send(Sync *sync, SyncFrame *frame) {
+  SDL_LockMutex(sync->lock);
+  frames_push(&sync->outbox, frame);
+  SDL_UnlockMutex(sync->lock);
+  sync_wake_network(sync);
+}
+
+static SyncFrame *frame_create(SyncFrameKind kind, size_t length, uint32_t peer) {
+  SyncFrame *frame = calloc(1, sizeof(SyncFrame));
+  if (frame == NULL) {
+    return NULL;
+  }
+  frame->data = malloc(SYNC_FRAME_HEADER + length);
+  if (frame->data == NULL) {
+    free(frame);
+    return NULL;
+  }
+  write_u32(frame->data, length);
+  frame->data[4] = kind;
+  frame->kind = kind;
+  frame->size = SYNC_FRAME_HEADER + length;
+  frame->peer = peer;
+  return frame;
+}
+
+static void frame_release(SyncFrame *frame) {
+  if (--frame->refs == 0) {
+    sync_frame_free(frame);
+  }
+}
+
+// network thread
+
+static void peer_queue(SyncPeer *peer, SyncFrame *frame) {
+  SyncSend *send = malloc(sizeof(SyncSend));
+  if (send == NULL) {
+    // the peer misses a change, it asks for a snapshot once it notices.
+    return;
+  }
+  send->frame = frame;
+  send->next = NULL;
+  if (peer->last_send != NULL) {
+    peer->last_send->next = send;
+  } else {
+    peer->sends = send;
+  }
+  peer->last_send = send;
+  frame->refs++;
+  if (frame->kind == SYNC_FRAME_OPS) {
+    peer->backlog += frame->size;
+  }
+}
+
+// drop what the peer hasn't started reading and have the render thread
+// send it a snapshot instead.
+static void peer_resync(Sync *sync, SyncPeer *peer) {
+  SyncSend **link = &peer->sends;
+  if (*link != NULL && peer->sent > 0) {
+    link = &(*link)->next;
+  }
+  peer->last_send = link == &peer->sends ? NULL : peer->sends;
+  while (*link != NULL) {
+    SyncSend *send = *link;
+    *link = send->next;
+    frame_release(send->frame);
+    free(send);
+  }
+  peer->backlog = 0;
+  peer->awaiting_snapshot = true;
+
+  SyncFrame *request = frame_create(SYNC_FRAME_RESYNC, 0, peer->tag);
+  if (request != NULL) {
+    sync_receive(sync, request);
+  }
+}
+
+static bool peer_wants(SyncPeer *peer, SyncFrame *frame) {
+  if (peer->closed || (frame->peer != SYNC_EVERYONE && frame->peer != peer->tag) || frame->exclude == peer->tag) {
+    return false;
+  }
+  if (peer->awaiting_snapshot) {
+    if (frame->kind != SYNC_FRAME_SNAPSHOT) {
+      return false;
+    }
+    peer->awaiting_snapshot = false;
+  }
+  return true;
+}
+
+static void sync_distribute(Sync *sync) {
+  SDL_LockMutex(sync->lock);
+  SyncFrame *frames = sync->outbox;
+  sync->outbox = NULL;
+  SDL_UnlockMutex(sync->lock);
+
+  while (frames != NULL) {
+    SyncFrame *frame = frames;
+    frames = frame->next;
+    // held so a resync dropping it from a peer doesn't free it mid-loop.
+    frame->refs = 1;
+    for (SyncPeer *peer = sync->peers; peer != NULL; peer = peer->next) {
+      if (!peer_wants(peer, frame)) {
+        continue;
+      }
+      peer_queue(peer, frame);
+      if (sync->hub && peer->backlog > SYNC_MAX_BACKLOG) {
+        peer_resync(sync, peer);
+      }
+    }
+    frame_release(frame);
+  }
+}
+
+static SyncPeer *peer_create(int fd, uint32_t tag) {
+  SyncPeer *peer = calloc(1, sizeof(SyncPeer));
+  if (peer == NULL) {
+    return NULL;
+  }
+  fcntl(fd, F_SETFD, FD_CLOEXEC);
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  peer->fd = fd;
+  peer->tag = tag;
+  return peer;
+}
+
+static void peer_free(SyncPeer *peer) {
+  while (peer->sends != NULL) {
+    SyncSend *send = peer->sends;
+    peer->sends = send->next;
+    frame_release(send->frame);
+    free(send);
+  }
+  close(peer->fd);
+  free(peer->in);
+  free(peer);
+}
+
+// a new peer is told its tag, then waits for its snapshot.
+static void sync_accept(Sync *sync) {
+  int fd = accept(sync->fd, NULL, NULL);
+  if (fd < 0) {
+    return;
+  }
+  SyncPeer *peer = peer_create(fd, sync->next_tag);
+  SyncFrame *hello = frame_create(SYNC_FRAME_HELLO, sizeof(uint32_t), sync->next_tag);
+  if (peer == NULL || hello == NULL) {
+    close(fd);
+    free(peer);
+    if (hello != NULL) {
+      sync_frame_free(hello);
+    }
+    return;
+  }
+  sync->next_tag++;
+  peer->next = sync->peers;
+  sync->peers = peer;
+  peer_resync(sync, peer);
+  write_u32(hello->data + SYNC_FRAME_HEADER, peer->tag);
+  peer_queue(peer, hello);
+}
+
+// the complete frames read from a peer. false once it should be closed.
+static bool peer_read(Sync *sync, SyncPeer *peer) {
+  if (peer->in_capacity - peer->in_size < SYNC_READ_SIZE) {
+    // snapshots come in many reads, grow by more than one.
+    size_t capacity = peer->in_size + SYNC_READ_SIZE;
+    capacity = capacity > peer->in_capacity * 2 ? capacity : peer->in_capacity * 2;
+    unsigned char *grown = realloc(peer->in, capacity);
+    if (grown == NULL) {
+      return false;
+    }
+    peer->in = grown;
+    peer->in_capacity = capacity;
+  }
+  ssize_t got = read(peer->fd, peer->in + peer->in_size, peer->in_capacity - peer->in_size);
+  if (got < 0) {
+    return errno == EINTR || errno == EAGAIN;
+  }
+  if (got == 0) {
+    return false;
+  }
+  peer->in_size += got;
+
+  size_t offset = 0;
+  while (peer->in_size - offset >= SYNC_FRAME_HEADER) {
+    uint32_t length = read_u32(peer->in + offset);
+    SyncFrameKind kind = peer->in[offset + 4];
+    if (length > SYNC_MAX_FRAME || kind > SYNC_FRAME_RESYNC) {
+      return false;
+    }
+    if (peer->in_size - offset - SYNC_FRAME_HEADER < length) {
+      break;
+    }
+    const unsigned char *payload = peer->in + offset + SYNC_FRAME_HEADER;
+    offset += SYNC_FRAME_HEADER + length;
+
+    // peers send changes and ask for snapshots, the hub sends anything but the latter.
+    if (sync->hub && kind == SYNC_FRAME_RESYNC) {
+      peer_resync(sync, peer);
+      continue;
+    }
+    if (sync->hub ? kind != SYNC_FRAME_OPS : kind == SYNC_FRAME_RESYNC) {
+      continue;
+    }
+    SyncFrame *frame = frame_create(kind, length, peer->tag);
+    if (frame == NULL) {
+      return false;
+    }
+    memcpy(frame->data + SYNC_FRAME_HEADER, payload, length);
+    sync_receive(sync, frame);
+  }
+  peer->in_size -= offset;
+  memmove(peer->in, peer->in + offset, peer->in_size);
+  return true;
+}
+
+// write what the socket takes without blocking. false once it should be closed.
+static bool peer_write(SyncPeer *peer) {
+  while (peer->sends != NULL) {
+    SyncFrame *frame = peer->sends->frame;
+    ssize_t written = send(peer->fd, frame->data + peer->sent, frame->size - peer->sent, MSG_NOSIGNAL);
+    if (written < 0) {
+      return errno == EINTR || errno == EAGAIN;
+    }
+    peer->sent += written;
+    if (peer->sent < frame->size) {
+      continue;
+    }
+
+    SyncSend *send = peer->sends;
+    peer->sends = send->next;
+    if (peer->sends == NULL) {
+      peer->last_send = NULL;
+    }
+    if (frame->kind == SYNC_FRAME_OPS) {
+      peer->backlog -= frame->size;
+    }
+    peer->sent = 0;
+    frame_release(frame);
+    free(send);
+  }
+  return true;
+}
+
+static bool sync_quitting(Sync *sync) {
+  SDL_LockMutex(sync->lock);
+  bool quit = sync->quit;
+  SDL_UnlockMutex(sync->lock);
+  return quit;
+}
+
+static int sync_run(void *data) {
+  Sync *sync = data;
+  struct pollfd *fds = NULL;
+  int capacity = 0;
+
+  while (!sync_quitting(sync)) {
+    int count = 2;
+    for (SyncPeer *peer = sync->peers; peer != NULL; peer = peer->next) {
+      count++;
+    }
+    if (count > capacity) {
+      struct pollfd *grown = realloc(fds, sizeof(struct pollfd) * count * 2);
+      if (grown == NULL) {
+        SDL_Delay(10);
+        continue;
+      }
+      fds = grown;
+      capacity = count * 2;
+    }
+
+    // nothing is read while the render thread is behind, the peers
+    // sending are held back by their sockets filling up.
+    SDL_LockMutex(sync->lock);
+    bool full = sync->inbox_size >= SYNC_MAX_INBOX;
+    SDL_UnlockMutex(sync->lock);
+    fds[0] = (struct pollfd){.fd = sync->wake_pipe[0], .events = POLLIN};
+    fds[1] = (struct pollfd){.fd = sync->hub ? sync->fd : -1, .events = POLLIN};
+    int i = 2;
+    for (SyncPeer *peer = sync->peers; peer != NULL; peer = peer->next) {
+      short events = (full ? 0 : POLLIN) | (peer->sends != NULL ? POLLOUT : 0);
+      // a hung up peer would wake poll over and over until it is read.
+      fds[i++] = (struct pollfd){.fd = events != 0 ? peer->fd : -1, .events = events};
+    }
+    if (poll(fds, count, -1) < 0) {
+      continue;
+    }
+
+    if (fds[0].revents & POLLIN) {
+      char drain[64];
+      while (read(sync->wake_pipe[0], drain, sizeof(drain)) > 0) {
+      }
+    }
+    // accepted peers go in front of the ones polled.
+    SyncPeer *peer = sync->peers;
+    if (fds[1].revents & POLLIN) {
+      sync_accept(sync);
+    }
+    for (i = 2; i < count; ++i, peer = peer->next) {
+      short events = fds[i].revents;
+      if (!full && (events & (POLLIN | POLLERR | POLLHUP))) {
+        peer->closed = !peer_read(sync, peer);
+      }
+      if (!peer->closed && (events & (POLLOUT | POLLERR | POLLHUP))) {
+        peer->closed = !peer_write(peer);
+      }
+    }
+    // changes made since, queued behind what was already waiting.
+    sync_distribute(sync);
+    for (peer = sync->peers; peer != NULL; peer = peer->next) {
+      if (!peer->closed && peer->sends != NULL) {
+        peer->closed = !peer_write(peer);
+      }
+    }
+
+    SyncPeer **link = &sync->peers;
+    while (*link != NULL) {
+      peer = *link;
+      if (peer->closed) {
+        if (!sync->hub) {
+          fprintf(stderr, "sync: lost the hub, the board is no longer shared\n");
+        }
+        *link = peer->next;
+        peer_free(peer);
+      } else {
+        link = &peer->next;
+      }
+    }
+  }
+
+  free(fds);
+  return 0;
+}
+
+// setting up
+
+static int sync_connect(struct sockaddr_un *address) {
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd >= 0 && connect(fd, (struct sockaddr *)address, sizeof(*address)) != 0) {
+    close(fd);
+    fd = -1;
+  }
+  return fd;
+}
+
+// join the board shared on socket_path, or share this one on it if no
+// instance does yet. wake is posted for every frame received.
+// returns NULL if the socket can't be set up.
+Sync *sync_start(const char *socket_path, SDL_sem *wake) {
+  Sync *sync = calloc(1, sizeof(Sync));
+  if (sync == NULL) {
+    return NULL;
+  }
+  sync->fd = -1;
+  sync->wake_pipe[0] = sync->wake_pipe[1] = -1;
+  sync->wake = wake;
+  sync->next_tag = SYNC_HUB_TAG + 1;
+
+  struct sockaddr_un address = {.sun_family = AF_UNIX};
+  if (strlen(socket_path) >= sizeof(address.sun_path)) {
+    fprintf(stderr, "sync: socket path too long: %s\n", socket_path);
+    goto defer;
+  }
+  strcpy(address.sun_path, socket_path);
+
+  sync->lock = SDL_CreateMutex();
+  if (sync->lock == NULL || pipe(sync->wake_pipe) != 0) {
+    goto defer;
+  }
+  for (int i = 0; i < 2; ++i) {
+    fcntl(sync->wake_pipe[i], F_SETFD, FD_CLOEXEC);
+    fcntl(sync->wake_pipe[i], F_SETFL, O_NONBLOCK);
+  }
+
+  int fd = sync_connect(&address);
+  if (fd >= 0) {
+    sync->peers = peer_create(fd, SYNC_HUB_TAG);
+    if (sync->peers == NULL) {
+      close(fd);
+      goto defer;
+    }
+    fprintf(stderr, "sync: joining the board shared on %s\n", socket_path);
+  } else {
+    // nobody answers, a socket left behind is replaced.
+    unlink(socket_path);
+    sync->hub = true;
+    sync->joined = true;
+    sync->tag = SYNC_HUB_TAG;
+    sync->socket_path = strdup(socket_path);
+    sync->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sync->socket_path == NULL || sync->fd < 0) {
+      goto defer;
+    }
+    // a connection given up on between poll and accept mustn't block the thread.
+    fcntl(sync->fd, F_SETFL, O_NONBLOCK);
+    // only the user running the board gets to see it.
+    mode_t mask = umask(0077);
+    int bound = bind(sync->fd, (struct sockaddr *)&address, sizeof(address));
+    umask(mask);
+    if (bound != 0 || listen(sync->fd, SOMAXCONN) != 0) {
+      fprintf(stderr, "sync: can't listen on %s: %s\n", socket_path, strerror(errno));
+      goto defer;
+    }
+    fprintf(stderr, "sync: sharing the board on %s\n", socket_path);
+  }
+
+  sync->thread = SDL_CreateThread(sync_run, "sync", sync);
+  if (sync->thread == NULL) {
+    goto defer;
+  }
+  return sync;
+
+defer:
+  if (sync->hub && sync->fd >= 0)
+    unlink(socket_path);
+  if (sync->fd >= 0)
+    close(sync->fd);
+  if (sync->peers != NULL)
+    peer_free(sync->peers);
+  if (sync->wake_pipe[0] >= 0) {
+    close(sync->wake_pipe[0]);
+    close(sync->wake_pipe[1]);
+  }
+  if (sync->lock != NULL)
+    SDL_DestroyMutex(sync->lock);
+  free(sync->socket_path);
+  free(sync);
+  return NULL;
+}
+
+// hangs up on every other instance. changes not sent yet are lost.
+void sync_free(Sync *sync) {
+  if (sync == NULL) {
+    return;
+  }
+
+  SDL_LockMutex(sync->lock);
+  sync->quit = true;
+  SDL_UnlockMutex(sync->lock);
+  sync_wake_network(sync);
+  SDL_WaitThread(sync->thread, NULL);
+
+  while (sync->peers != NULL) {
+    SyncPeer *peer = sync->peers;
+    sync->peers = peer->next;
+    peer_free(peer);
+  }
+  frames_free(sync->inbox);
+  frames_free(sync->outbox);
+  if (sync->hub) {
+    close(sync->fd);
+    unlink(sync->socket_path);
+  }
+  close(sync->wake_pipe[0]);
+  close(sync->wake_pipe[1]);
+  SDL_DestroyMutex(sync->lock);
+  free(sync->socket_path);
+  free(sync->pending);
+  free(sync->base_versions);
+  free(sync);
+}
+
+// render thread
+
+// whether changes to the strokes are being sent to the other instances.
+bool sync_recording(Sync *sync) {
+  return sync != NULL && sync->joined && !sync->applying;
+}
+
+// room for length more bytes in the pending frame, its header included.
+static bool pending_reserve(Sync *sync, size_t length) {
+  size_t size = sync->pending_size > 0 ? sync->pending_size : SYNC_FRAME_HEADER;
+  size_t needed = size + length;
+  if (needed > sync->pending_capacity) {
+    size_t capacity = sync->pending_capacity == 0 ? 4096 : sync->pending_capacity;
+    while (capacity < needed) {
+      capacity *= 2;
+    }
+    unsigned char *pending = realloc(sync->pending, capacity);
+    if (pending == NULL) {
+      return false;
+    }
+    sync->pending = pending;
+    sync->pending_capacity = capacity;
+  }
+  sync->pending_size = size;
+  return true;
+}
+
+// room for a message in the pending frame, NULL if there is none. the
+// message is lost then, the peers ask for a snapshot once they notice.
+static unsigned char *message_begin(Sync *sync, SyncOp op, int layer, size_t length) {
+  if (!pending_reserve(sync, SYNC_MESSAGE_HEADER + length)) {
+    return NULL;
+  }
+  unsigned char *message = sync->pending + sync->pending_size;
+  message[0] = op;
+  message[1] = layer;
+  write_u32(message + 2, length);
+  sync->pending_size += SYNC_MESSAGE_HEADER + length;
+  return message + SYNC_MESSAGE_HEADER;
+}
+
+// the ids of what undoing the latest version of a list takes away or brings
+// back, in the order pdll_diff_latest() visits them. counted and written
+// out when recording, compared when replaying.
+typedef struct UndoIds {
+  unsigned char *out;
+  const unsigned char *expected;
+  size_t length;
+  size_t count;
+  bool same;
+} UndoIds;
+
+static void undo_ids_write(void *data, void *context) {
+  UndoIds *ids = context;
+  if (ids->out != NULL) {
+    memcpy(ids->out + ids->count * sizeof(uint64_t), &((Path *)data)->id, sizeof(uint64_t));
+  }
+  ids->count++;
+}
+
+static void undo_ids_match(void *data, void *context) {
+  UndoIds *ids = context;
+  size_t offset = ids->count++ * sizeof(uint64_t);
+  ids->same = ids->same && offset + sizeof(uint64_t) <= ids->length &&
+              memcmp(ids->expected + offset, &((Path *)data)->id, sizeof(uint64_t)) == 0;
+}
+
+// record a change to the strokes of a layer: the path appended, the
+// strokes an undo changes, or the nodes marked in list for the ops
+// working on those.
+void sync_record(Sync *sync, SyncOp op, int layer, pdll *list, Path *path) {
+  if (!sync_recording(sync) || layer < 0 || layer > UINT8_MAX) {
+    return;
+  }
+
+  if (op == SYNC_APPEND) {
+    // ids are handed out once, copies and baked strokes keep theirs.
+    if (path->id == 0) {
+      path->id = (uint64_t)sync->tag << 40 | ++sync->next_id;
+    }
+    unsigned char *payload = message_begin(sync, op, layer, path_packed_size(path));
+    if (payload != NULL) {
+      path_pack(path, payload);
+    }
+    return;
+  }
+  if (op == SYNC_UNDO) {
+    UndoIds ids = {0};
+    pdll_diff_latest(list, undo_ids_write, &ids);
+    ids.out = message_begin(sync, op, layer, ids.count * sizeof(uint64_t));
+    if (ids.out != NULL) {
+      ids.count = 0;
+      pdll_diff_latest(list, undo_ids_write, &ids);
+    }
+    return;
+  }
+  if (op != SYNC_DELETE && op != SYNC_AMEND && op != SYNC_REPLACE && op != SYNC_COMMIT) {
+    message_begin(sync, op, layer, 0);
+    return;
+  }
+
+  size_t count = 0;
+  Path *first = NULL;
+  pdll_iter(list, node) {
+    if (node->to_delete) {
+      first = first != NULL ? first : node->data;
+      count++;
+    }
+  }
+  size_t matrix_size = op == SYNC_REPLACE ? sizeof(double) * 6 : 0;
+  unsigned char *payload = message_begin(sync, op, layer, matrix_size + count * sizeof(uint64_t));
+  if (payload == NULL) {
+    return;
+  }
+  if (op == SYNC_REPLACE) {
+    cairo_matrix_t matrix;
+    cairo_matrix_init_identity(&matrix);
+    if (first != NULL && first->matrix != NULL) {
+      matrix = *first->matrix;
+    }
+    double values[6] = {matrix.xx, matrix.yx, matrix.xy, matrix.yy, matrix.x0, matrix.y0};
+    memcpy(payload, values, matrix_size);
+    payload += matrix_size;
+  }
+  pdll_iter(list, node) {
+    if (node->to_delete) {
+      Path *marked = node->data;
+      memcpy(payload, &marked->id, sizeof(uint64_t));
+      payload += sizeof(uint64_t);
+    }
+  }
+}
+
+// send what was recorded since the last frame as a frame of the given
+// kind, to one peer or SYNC_EVERYONE. empty frames only go out if they
+// mean something by themselves.
+void sync_flush_frame(Sync *sync, SyncFrameKind kind, uint32_t peer) {
+  if (sync == NULL || (kind == SYNC_FRAME_OPS && sync->pending_size <= SYNC_FRAME_HEADER)) {
+    return;
+  }
+  SyncFrame *frame = calloc(1, sizeof(SyncFrame));
+  if (frame == NULL || !pending_reserve(sync, 0)) {
+    free(frame);
+    return;
+  }
+  write_u32(sync->pending, sync->pending_size - SYNC_FRAME_HEADER);
+  sync->pending[4] = kind;
+  frame->kind = kind;
+  frame->data = sync->pending;
+  frame->size = sync->pending_size;
+  frame->peer = peer;
+  sync->pending = NULL;
+  sync->pending_size = sync->pending_capacity = 0;
+  sync_send(sync, frame);
+}
+
+// send the changes of this render loop iteration.
+void sync_flush(Sync *sync) {
+  sync_flush_frame(sync, SYNC_FRAME_OPS, SYNC_EVERYONE);
+}
+
+// a peer that can't follow the changes anymore starts over from a
+// snapshot. what it recorded in the meantime is lost.
+void sync_request_snapshot(Sync *sync) {
+  if (sync->hub) {
+    return;
+  }
+  sync->joined = false;
+  sync->pending_size = 0;
+  sync_flush_frame(sync, SYNC_FRAME_RESYNC, SYNC_EVERYONE);
+}
+
+// the oldest frame received, NULL if there is none.
+SyncFrame *sync_take(Sync *sync) {
+  SDL_LockMutex(sync->lock);
+  SyncFrame *frame = sync->inbox;
+  bool was_full = sync->inbox_size >= SYNC_MAX_INBOX;
+  if (frame != NULL) {
+    sync->inbox = frame->next;
+    sync->inbox_size -= frame->size;
+    frame->next = NULL;
+  }
+  bool full = sync->inbox_size >= SYNC_MAX_INBOX;
+  SDL_UnlockMutex(sync->lock);
+  // the network thread stopped reading, it can go on.
+  if (was_full && !full) {
+    sync_wake_network(sync);
+  }
+  return frame;
+}
+
+// pass a frame the hub applied on to the peers but the one it came from.
+void sync_relay(Sync *sync, SyncFrame *frame) {
+  frame->exclude = frame->peer;
+  frame->peer = SYNC_EVERYONE;
+  sync_send(sync, frame);
+}
+
+// the next message of a frame's payload, false at its end or if the
+// rest doesn't make a message.
+bool sync_next_message(const unsigned char **cursor, const unsigned char *end, SyncMessage *message) {
+  if (end - *cursor < SYNC_MESSAGE_HEADER) {
+    return false;
+  }
+  const unsigned char *data = *cursor;
+  size_t length = read_u32(data + 2);
+  if ((size_t)(end - data - SYNC_MESSAGE_HEADER) < length || data[0] > SYNC_LAYER) {
+    return false;
+  }
+  *message = (SyncMessage){data[0], data[1], data + SYNC_MESSAGE_HEADER, length};
+  *cursor = data + SYNC_MESSAGE_HEADER + length;
+  return true;
+}
+
+static int compare_ids(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+// the ids in a message, sorted for sync_has_id(). NULL if there are none
+// or they don't fit in memory, count tells which.
+uint64_t *sync_read_ids(const unsigned char *data, size_t length, size_t *count) {
+  *count = length / sizeof(uint64_t);
+  uint64_t *ids = *count > 0 ? malloc(length) : NULL;
+  if (ids == NULL) {
+    return NULL;
+  }
+  memcpy(ids, data, *count * sizeof(uint64_t));
+  qsort(ids, *count, sizeof(uint64_t), compare_ids);
+  return ids;
+}
+
+bool sync_has_id(const uint64_t *ids, size_t count, uint64_t id) {
+  return count > 0 && bsearch(&id, ids, count, sizeof(uint64_t), compare_ids) != NULL;
+}
+
+// whether undoing the latest version of list changes the strokes a
+// SYNC_UNDO says it does. edits made at the same time elsewhere can leave
+// another change latest here.
+bool sync_undo_matches(pdll *list, const unsigned char *data, size_t length) {
+  UndoIds ids = {.expected = data, .length = length, .same = true};
+  pdll_diff_latest(list, undo_ids_match, &ids);
+  return ids.same && ids.count * sizeof(uint64_t) == length;
+}
+
+// whether the latest version of a layer can be undone. a peer only has
+// the history since its snapshot.
+bool sync_can_undo(Sync *sync, int layer, size_t version) {
+  if (sync == NULL || layer >= sync->base_count) {
+    return true;
+  }
+  return version > sync->base_versions[layer];
+}
@@ -0,0 +1,151 @@
+#ifndef SB_SYNC_H
+#define SB_SYNC_H
+
+#include "path.h"
+#include "pdll.h"
+#include <SDL2/SDL.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// bytes of changes queued for a peer before they are dropped, and the peer
+// is sent a snapshot instead
+#define SYNC_MAX_BACKLOG (64 * 1024 * 1024)
+// bytes of frames received and not applied yet before the peers aren't
+// read from anymore
+#define SYNC_MAX_INBOX (64 * 1024 * 1024)
+// largest frame read, a connection sending more is closed
+#define SYNC_MAX_FRAME (1024 * 1024 * 1024)
+// a frame starts with the uint32 length of what follows and its kind
+#define SYNC_FRAME_HEADER 5
+// a message starts with its op, layer, and the uint32 length of its payload
+#define SYNC_MESSAGE_HEADER 6
+// frames meant for every peer, and tags of connections
+#define SYNC_EVERYONE 0
+#define SYNC_HUB_TAG 1
+
+// several instances showing the same board. the first one started on a
+// socket path listens on it and is the hub, the ones started after it
+// connect to it as peers. every change to the strokes is recorded as the
+// pdll operation that made it, see pdll_observe(), and the changes of a
+// render loop iteration are sent as one frame. the hub applies what the
+// peers send and relays it to the others in the order it applied it.
+// a joining peer is sent a snapshot of the board first, so is a peer that
+// falls too far behind or finds it can't replay a change. a frame the hub
+// can't replay isn't relayed, every peer is sent a snapshot instead.
+//
+// edits made at the same time on two instances reach the others in the
+// order the hub got them, so the latest change isn't always the same
+// everywhere. an undo names the strokes it changes, an instance where the
+// latest change differs doesn't replay it but starts over from a snapshot.
+typedef enum SyncFrameKind {
+  SYNC_FRAME_OPS,      // messages, see SyncOp
+  SYNC_FRAME_SNAPSHOT, // messages rebuilding every layer from scratch
+  SYNC_FRAME_HELLO,    // uint32 tag the hub gave the peer
+  SYNC_FRAME_RESYNC,   // a peer asking for a snapshot
+} SyncFrameKind;
+
+typedef enum SyncOp {
+  SYNC_APPEND,  // the packed path, see path_pack()
+  SYNC_DELETE,  // uint64 ids of the marked strokes
+  SYNC_AMEND,   // same
+  SYNC_REPLACE, // the 6 doubles of the matrix baked into the marked strokes, their ids
+  SYNC_UNDO,    // uint64 ids of the strokes the undo takes away or brings back
+  SYNC_BEGIN,
+  SYNC_COMMIT, // ids of the strokes marked when the transaction is closed
+  SYNC_ROLLBACK,
+  SYNC_LAYER, // the layer was added
+} SyncOp;
+
+typedef struct SyncMessage {
+  SyncOp op;
+  int layer;
+  const unsigned char *data;
+  size_t length;
+} SyncMessage;
+
+typedef struct SyncFrame {
+  SyncFrameKind kind;
+  unsigned char *data; // as sent, header included
+  size_t size;
+  // received: the connection it came from. queued: the only peer it is
+  // for, or SYNC_EVERYONE.
+  uint32_t peer;
+  uint32_t exclude; // queued: a peer it isn't sent to, or SYNC_EVERYONE
+  int refs;         // connections still sending it
+  struct SyncFrame *next;
+} SyncFrame;
+
+typedef struct SyncSend {
+  SyncFrame *frame;
+  struct SyncSend *next;
+} SyncSend;
+
+// the hub's end of a peer, or the peer's end of the hub
+typedef struct SyncPeer {
+  int fd;
+  uint32_t tag;
+  unsigned char *in;
+  size_t in_size;
+  size_t in_capacity;
+  SyncSend *sends; // oldest first
+  SyncSend *last_send;
+  size_t sent;    // bytes of the first frame written
+  size_t backlog; // bytes of changes queued
+  // frames are dropped until the snapshot for the peer is queued
+  bool awaiting_snapshot;
+  bool closed;
+  struct SyncPeer *next;
+} SyncPeer;
+
+typedef struct Sync {
+  bool hub;
+  char *socket_path;
+  int fd; // the hub's listening socket, or the peer's connection to it
+  int wake_pipe[2];
+  SDL_Thread *thread;
+  SDL_sem *wake; // posted for every frame received
+  SDL_mutex *lock;
+  bool quit;
+  // frames received and frames to send, oldest first, under lock
+  SyncFrame *inbox;
+  SyncFrame *outbox;
+  size_t inbox_size; // bytes
+
+  // owned by the network thread
+  SyncPeer *peers;
+  uint32_t next_tag;
+
+  // owned by the render thread
+  // messages recorded since the last frame, after room for its header
+  unsigned char *pending;
+  size_t pending_size;
+  size_t pending_capacity;
+  uint32_t tag;     // high bits of the ids handed out
+  uint64_t next_id; // low bits
+  bool joined;      // a peer records nothing until it has a snapshot
+  bool applying;    // changes replayed from others aren't recorded again
+  // per layer, the version a peer's snapshot left it at. history older
+  // than the snapshot isn't there to undo.
+  size_t *base_versions;
+  int base_count;
+  cairo_matrix_t matrix; // baked by the SYNC_REPLACE being replayed
+} Sync;
+
+Sync *sync_start(const char *socket_path, SDL_sem *wake);
+void sync_free(Sync *sync);
+bool sync_recording(Sync *sync);
+void sync_record(Sync *sync, SyncOp op, int layer, pdll *list, Path *path);
+void sync_flush_frame(Sync *sync, SyncFrameKind kind, uint32_t peer);
+void sync_flush(Sync *sync);
+void sync_request_snapshot(Sync *sync);
+SyncFrame *sync_take(Sync *sync);
+void sync_relay(Sync *sync, SyncFrame *frame);
+void sync_frame_free(SyncFrame *frame);
+bool sync_next_message(const unsigned char **cursor, const unsigned char *end, SyncMessage *message);
+uint64_t *sync_read_ids(const unsigned char *data, size_t length, size_t *count);
+bool sync_has_id(const uint64_t *ids, size_t count, uint64_t id);
+bool sync_undo_matches(pdll *list, const unsigned char *data, size_t length);
+bool sync_can_undo(Sync *sync, int layer, size_t version);
+
+#endif // SB_SYNC_H